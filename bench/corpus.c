@@ -0,0 +1,157 @@
+#include "corpus.h"
+#include <string.h>
+
+static const char* corpus_shape_names[CORPUS_SHAPE_TOTAL]={
+    [CORPUS_SHAPE_IDENTIFIER]="identifier",
+    [CORPUS_SHAPE_COMMENT]="comment",
+    [CORPUS_SHAPE_OPERATOR]="operator",
+    [CORPUS_SHAPE_STRING]="string",
+    [CORPUS_SHAPE_PARENTHESES]="parentheses",
+    [CORPUS_SHAPE_CONSTANT]="constant"
+};
+
+static const char* corpus_words[]={
+    "count", "index", "value", "buffer", "length", "offset", "result", "node",
+    "token", "process", "current", "previous", "next_char", "line_start", "table", "entry"
+};
+
+//和标识符随机排在一起，不组成语句；sizeof会让语法分析开始读表达式，不放在这里
+static const char* corpus_keywords[]={
+    "int", "unsigned", "char", "return", "if", "while", "struct", "const", "static", "else"
+};
+
+static const char* corpus_operators[]={
+    "+", "-", "*", "/", "%", "<<", ">>", "&", "|", "^", "&&", "||", "==", "!=",
+    "<=", ">=", "<", ">", "+=", "-=", "*=", "<<=", ">>=", "|=", "&=", "->", "++", "--"
+};
+
+#define CORPUS_COUNT(array) (sizeof(array)/sizeof(array[0]))
+
+//xorshift32，只要求快和可以复现
+static uint32_t corpus_random(uint32_t* state){
+    uint32_t x=*state;
+    x^=x<<13;
+    x^=x>>17;
+    x^=x<<5;
+    *state=x;
+    return x;
+}
+
+static size_t corpus_identifier(FILE* fp, uint32_t* state){
+    uint32_t r=corpus_random(state);
+    if(r%5==0){
+        return fprintf(fp, "%s ", corpus_keywords[(r>>8)%CORPUS_COUNT(corpus_keywords)]);
+    }
+    //一部分标识符反复出现，一部分带编号的几乎不重复
+    if(r%3==0){
+        return fprintf(fp, "%s_%u ", corpus_words[(r>>8)%CORPUS_COUNT(corpus_words)], (r>>12)%4096);
+    }
+    return fprintf(fp, "%s ", corpus_words[(r>>8)%CORPUS_COUNT(corpus_words)]);
+}
+
+static size_t corpus_line_identifier(FILE* fp, uint32_t* state){
+    size_t written=0;
+    for(int i=0;i<12;i++){
+        written+=corpus_identifier(fp, state);
+    }
+    return written+fprintf(fp, ";\n");
+}
+
+static size_t corpus_line_comment(FILE* fp, uint32_t* state){
+    uint32_t r=corpus_random(state);
+    size_t written=fprintf(fp, "%s = %u;\n", corpus_words[r%CORPUS_COUNT(corpus_words)], r>>16);
+    if(r&0x100){
+        return written+fprintf(fp, "// %s is updated here before the next %s is read from the %s, keep them in step\n",
+            corpus_words[(r>>4)%CORPUS_COUNT(corpus_words)], corpus_words[(r>>8)%CORPUS_COUNT(corpus_words)], corpus_words[(r>>12)%CORPUS_COUNT(corpus_words)]);
+    }
+    return written+fprintf(fp, "/*\n * The %s table is rebuilt whenever the %s changes.\n * Entries that are still referenced by the %s are kept.\n */\n",
+        corpus_words[(r>>4)%CORPUS_COUNT(corpus_words)], corpus_words[(r>>8)%CORPUS_COUNT(corpus_words)], corpus_words[(r>>12)%CORPUS_COUNT(corpus_words)]);
+}
+
+static size_t corpus_line_operator(FILE* fp, uint32_t* state){
+    size_t written=fprintf(fp, "%s", corpus_words[corpus_random(state)%CORPUS_COUNT(corpus_words)]);
+    for(int i=0;i<16;i++){
+        uint32_t r=corpus_random(state);
+        const char* op=corpus_operators[r%CORPUS_COUNT(corpus_operators)];
+        //运算符之间随机接标识符或者数字，不关心语义
+        if(r&0x100){
+            written+=fprintf(fp, "%s%s", op, corpus_words[(r>>9)%CORPUS_COUNT(corpus_words)]);
+        } else {
+            written+=fprintf(fp, "%s%u", op, (r>>9)%1000);
+        }
+    }
+    return written+fprintf(fp, ";\n");
+}
+
+static size_t corpus_line_string(FILE* fp, uint32_t* state){
+    uint32_t r=corpus_random(state);
+    return fprintf(fp, "%s = \"the %s of %s is out of range\\n\\tcheck %s before calling %s again\";\n",
+        corpus_words[r%CORPUS_COUNT(corpus_words)], corpus_words[(r>>4)%CORPUS_COUNT(corpus_words)],
+        corpus_words[(r>>8)%CORPUS_COUNT(corpus_words)], corpus_words[(r>>12)%CORPUS_COUNT(corpus_words)],
+        corpus_words[(r>>16)%CORPUS_COUNT(corpus_words)]);
+}
+
+static size_t corpus_line_parentheses(FILE* fp, uint32_t* state){
+    uint32_t r=corpus_random(state);
+    int depth=8+r%56;
+    size_t written=fprintf(fp, "%s = ", corpus_words[(r>>8)%CORPUS_COUNT(corpus_words)]);
+    for(int i=0;i<depth;i++){
+        written+=fprintf(fp, "(");
+    }
+    written+=fprintf(fp, "%s", corpus_words[(r>>12)%CORPUS_COUNT(corpus_words)]);
+    for(int i=0;i<depth;i++){
+        written+=fprintf(fp, " + %u)", (r>>i%16)&0xff);
+    }
+    return written+fprintf(fp, ";\n");
+}
+
+static size_t corpus_line_constant(FILE* fp, uint32_t* state){
+    uint32_t r=corpus_random(state);
+    return fprintf(fp, "%s = ((%uu << %u) | 0x%x) * sizeof(int) + (unsigned char)(%u - %u) / (%u > %u ? %u : %u) + (long)(%u.5 * %u) + %s;\n",
+        corpus_words[r%CORPUS_COUNT(corpus_words)], (r>>4)&0xff, (r>>12)%16, (r>>8)&0xfff,
+        (r>>16)&0x3ff, (r>>6)&0x3ff, (r>>3)&0x7f, (r>>20)&0x7f, (r>>24)%64+1, (r>>10)%64+1,
+        (r>>14)&0xff, (r>>22)%100, corpus_words[(r>>28)%CORPUS_COUNT(corpus_words)]);
+}
+
+const char* corpus_shape_name(int shape){
+    return corpus_shape_names[shape];
+}
+
+int corpus_shape_lookup(const char* name){
+    for(int i=0;i<CORPUS_SHAPE_TOTAL;i++){
+        if(strcmp(corpus_shape_names[i], name)==0){
+            return i;
+        }
+    }
+    return -1;
+}
+
+size_t corpus_generate(FILE* fp, int shape, size_t size, uint32_t seed){
+    uint32_t state=seed?seed:1;
+    size_t written=0;
+    while(written<size){
+        switch(shape){
+            case CORPUS_SHAPE_IDENTIFIER:
+            written+=corpus_line_identifier(fp, &state);
+            break;
+            case CORPUS_SHAPE_COMMENT:
+            written+=corpus_line_comment(fp, &state);
+            break;
+            case CORPUS_SHAPE_OPERATOR:
+            written+=corpus_line_operator(fp, &state);
+            break;
+            case CORPUS_SHAPE_STRING:
+            written+=corpus_line_string(fp, &state);
+            break;
+            case CORPUS_SHAPE_PARENTHESES:
+            written+=corpus_line_parentheses(fp, &state);
+            break;
+            case CORPUS_SHAPE_CONSTANT:
+            written+=corpus_line_constant(fp, &state);
+            break;
+            default:
+            return written;
+        }
+    }
+    return written;
+}
@@ -0,0 +1,32 @@
+#ifndef LINYCOMPILOR_BENCH_CORPUS_H
+#define LINYCOMPILOR_BENCH_CORPUS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//合成的测试源码，每种形状突出前端的一类开销
+enum{
+    //标识符和关键字为主，考验标识符读取、关键字查找和驻留表
+    CORPUS_SHAPE_IDENTIFIER,
+    //大段的单行和多行注释，考验注释的跳过速度
+    CORPUS_SHAPE_COMMENT,
+    //密集的运算符，考验运算符状态机
+    CORPUS_SHAPE_OPERATOR,
+    //长字符串字面量
+    CORPUS_SHAPE_STRING,
+    //很深的括号嵌套，考验括号内文本的记录
+    CORPUS_SHAPE_PARENTHESES,
+    //生成代码里常见的常量运算、cast和sizeof，考验常量折叠
+    CORPUS_SHAPE_CONSTANT,
+    CORPUS_SHAPE_TOTAL
+};
+
+const char* corpus_shape_name(int shape);
+//按名字查找形状，找不到返回-1
+int corpus_shape_lookup(const char* name);
+
+//向fp写入大约size字节指定形状的源码，相同的seed总是生成相同的内容
+size_t corpus_generate(FILE* fp, int shape, size_t size, uint32_t seed);
+
+#endif // LINYCOMPILOR_BENCH_CORPUS_H
@@ -0,0 +1,176 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "corpus.h"
+#include "helpers/scan.h"
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+// 前端基准：为每种形状生成一份合成源码，在进程内分别计时lex()和parse()，
+// 输出吞吐量、分配次数和峰值内存。链接时用--wrap把malloc系列函数换成下面的计数版本
+#define FRONTEND_BENCH_DEFAULT_MB 8
+#define FRONTEND_BENCH_DEFAULT_ROUNDS 3
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+static size_t frontend_bench_allocs;
+static size_t frontend_bench_alloc_bytes;
+
+void* __wrap_malloc(size_t size){
+    frontend_bench_allocs++;
+    frontend_bench_alloc_bytes+=size;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t nmemb, size_t size){
+    frontend_bench_allocs++;
+    frontend_bench_alloc_bytes+=nmemb*size;
+    return __real_calloc(nmemb, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size){
+    frontend_bench_allocs++;
+    frontend_bench_alloc_bytes+=size;
+    return __real_realloc(ptr, size);
+}
+
+struct frontend_bench_phase
+{
+    //所有轮次中最快的一次
+    double seconds;
+    size_t allocs;
+    size_t alloc_bytes;
+};
+
+static double frontend_bench_now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static void frontend_bench_phase_begin(double* start){
+    frontend_bench_allocs=0;
+    frontend_bench_alloc_bytes=0;
+    *start=frontend_bench_now();
+}
+
+static void frontend_bench_phase_end(struct frontend_bench_phase* phase, double start){
+    double seconds=frontend_bench_now()-start;
+    if(phase->seconds==0||seconds<phase->seconds){
+        phase->seconds=seconds;
+    }
+    phase->allocs=frontend_bench_allocs;
+    phase->alloc_bytes=frontend_bench_alloc_bytes;
+}
+
+static void frontend_bench_shape(int shape, size_t size, int rounds){
+    char filename[]="/tmp/linycompiler_corpus_XXXXXX";
+    int fd=mkstemp(filename);
+    if(fd<0){
+        exit(-1);
+    }
+    FILE* fp=fdopen(fd, "w");
+    size_t bytes=corpus_generate(fp, shape, size, 1);
+    fclose(fp);
+
+    struct frontend_bench_phase lex_phase={0};
+    struct frontend_bench_phase parse_phase={0};
+    int tokens=0;
+    int nodes=0;
+    for(int r=0;r<rounds;r++){
+        //随机生成的源码里常量移位的位数经常超出范围，警告只会拖慢测量
+        struct compile_process* process=compile_process_create(filename, NULL, COMPILE_PROCESS_FLAG_NO_WARNINGS);
+        struct lex_process* lex_process=lex_process_create(process, process->lex_functions, NULL);
+
+        double start;
+        frontend_bench_phase_begin(&start);
+        lex(lex_process);
+        frontend_bench_phase_end(&lex_phase, start);
+
+        //语法分析阶段包括把token转换成结构数组
+        frontend_bench_phase_begin(&start);
+        process->token_vec=lex_process_tokens(lex_process);
+        process->token_stream=token_stream_from_vector(process->token_vec);
+        parse(process);
+        frontend_bench_phase_end(&parse_phase, start);
+
+        tokens=vector_count(process->token_vec);
+        nodes=vector_count(process->nodes)-1;
+        lex_process_free(lex_process);
+        compile_process_free(process);
+    }
+    unlink(filename);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double mb=bytes/(1024.0*1024.0);
+    printf("%-12s %8.2f %10.1f %10.2f %10.2f %10.1f %9zu/%-9zu %8.1f/%-8.1f %8ld\n",
+        corpus_shape_name(shape), mb,
+        mb/lex_phase.seconds, tokens/lex_phase.seconds/1e6, nodes/parse_phase.seconds/1e6,
+        mb/(lex_phase.seconds+parse_phase.seconds),
+        lex_phase.allocs, parse_phase.allocs,
+        lex_phase.alloc_bytes/(1024.0*1024.0), parse_phase.alloc_bytes/(1024.0*1024.0),
+        usage.ru_maxrss/1024);
+}
+
+static void frontend_bench_usage(const char* program){
+    fprintf(stderr, "用法：%s [-s 每种形状的MB数] [-r 轮数] [-k avx2|sse2|scalar] [形状...]\n", program);
+}
+
+int main(int argc, char** argv){
+    size_t size=FRONTEND_BENCH_DEFAULT_MB*1024*1024;
+    int rounds=FRONTEND_BENCH_DEFAULT_ROUNDS;
+    bool selected[CORPUS_SHAPE_TOTAL]={0};
+    bool any_selected=false;
+    for(int i=1;i<argc;i++){
+        if(S_EQ(argv[i], "-s")&&i+1<argc){
+            size=strtod(argv[++i], NULL)*1024*1024;
+        } else if(S_EQ(argv[i], "-r")&&i+1<argc){
+            rounds=atoi(argv[++i]);
+        } else if(S_EQ(argv[i], "-k")&&i+1<argc){
+            //指定词法分析整段扫描用的指令集，方便和标量版本对比
+            if(!scan_select(argv[++i])){
+                fprintf(stderr, "当前CPU不支持%s\n", argv[i]);
+                return -1;
+            }
+        } else {
+            int shape=corpus_shape_lookup(argv[i]);
+            if(shape<0){
+                frontend_bench_usage(argv[0]);
+                return -1;
+            }
+            selected[shape]=true;
+            any_selected=true;
+        }
+    }
+    if(rounds<1){
+        rounds=1;
+    }
+
+    printf("扫描指令集：%s\n", scan_kernel_name());
+    printf("%-12s %8s %10s %10s %10s %10s %19s %17s %8s\n",
+        "形状", "MB", "词法MB/s", "百万token/s", "百万node/s", "总MB/s", "分配次数(词法/语法)", "分配MB(词法/语法)", "峰值RSS(MB)");
+    for(int shape=0;shape<CORPUS_SHAPE_TOTAL;shape++){
+        if(any_selected&&!selected[shape]){
+            continue;
+        }
+        //每种形状在单独的子进程里跑，峰值RSS才不会被前一种形状抬高
+        fflush(stdout);
+        pid_t pid=fork();
+        if(pid==0){
+            frontend_bench_shape(shape, size, rounds);
+            fflush(stdout);
+            _exit(0);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        if(!WIFEXITED(status)||WEXITSTATUS(status)!=0){
+            printf("%-12s 运行失败\n", corpus_shape_name(shape));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,19 @@
+#include "corpus.h"
+#include <stdlib.h>
+
+//生成合成的测试源码：gen_corpus 形状 字节数 [随机种子]，结果写到标准输出
+int main(int argc, char** argv){
+    int shape=argc>2?corpus_shape_lookup(argv[1]):-1;
+    if(shape<0){
+        fprintf(stderr, "用法：%s 形状 字节数 [随机种子]\n形状：", argv[0]);
+        for(int i=0;i<CORPUS_SHAPE_TOTAL;i++){
+            fprintf(stderr, "%s ", corpus_shape_name(i));
+        }
+        fprintf(stderr, "\n");
+        return -1;
+    }
+    size_t size=strtoull(argv[2], NULL, 10);
+    uint32_t seed=argc>3?strtoul(argv[3], NULL, 10):1;
+    corpus_generate(stdout, shape, size, seed);
+    return 0;
+}
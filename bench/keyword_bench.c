@@ -0,0 +1,89 @@
+#include "compiler.h"
+#include <stdlib.h>
+#include <time.h>
+
+// 关键字识别的微基准：对比原先逐个S_EQ的判断链和完美哈希查表，输出每秒识别的标识符数量
+#define KEYWORD_BENCH_IDENTIFIERS 4096
+#define KEYWORD_BENCH_ROUNDS 2000
+
+static const char* keyword_bench_words[]={
+    "int", "return", "buffer", "i", "len", "struct", "node", "process", "if", "token",
+    "unsigned", "vector", "while", "compiler_error", "char", "x", "for", "lex_process",
+    "const", "static", "value", "sizeof", "data", "else", "count", "void", "index"
+};
+
+//原先lexer.c中的实现，保留下来作为对照
+static bool is_keyword_strcmp_chain(const char* str){
+    return S_EQ(str, "unsigned")||
+           S_EQ(str, "signed")||
+           S_EQ(str, "char")||
+           S_EQ(str, "int")||
+           S_EQ(str, "short")||
+           S_EQ(str, "long")||
+           S_EQ(str, "float")||
+           S_EQ(str, "double")||
+           S_EQ(str, "void")||
+           S_EQ(str, "struct")||
+           S_EQ(str, "union")||
+           S_EQ(str, "static")||
+           S_EQ(str, "__ignore_typecheck")||
+           S_EQ(str, "return")||
+           S_EQ(str, "include")||
+           S_EQ(str, "sizeof")||
+           S_EQ(str, "if")||
+           S_EQ(str, "else")||
+           S_EQ(str, "while")||
+           S_EQ(str, "for")||
+           S_EQ(str, "do")||
+           S_EQ(str, "break")||
+           S_EQ(str, "continue")||
+           S_EQ(str, "switch")||
+           S_EQ(str, "case")||
+           S_EQ(str, "default")||
+           S_EQ(str, "goto")||
+           S_EQ(str, "typedef")||
+           S_EQ(str, "const")||
+           S_EQ(str, "extern")||
+           S_EQ(str, "restrict");
+}
+
+static double keyword_bench_now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+int main(){
+    //每个标识符单独复制一份，避免字符串常量地址相同让S_EQ走捷径
+    static char words[KEYWORD_BENCH_IDENTIFIERS][32];
+    static size_t lens[KEYWORD_BENCH_IDENTIFIERS];
+    int total_words=sizeof(keyword_bench_words)/sizeof(keyword_bench_words[0]);
+    srand(1);
+    for(int i=0;i<KEYWORD_BENCH_IDENTIFIERS;i++){
+        const char* word=keyword_bench_words[rand()%total_words];
+        strcpy(words[i], word);
+        lens[i]=strlen(word);
+    }
+
+    volatile int sink=0;
+    double start=keyword_bench_now();
+    for(int r=0;r<KEYWORD_BENCH_ROUNDS;r++){
+        for(int i=0;i<KEYWORD_BENCH_IDENTIFIERS;i++){
+            sink+=is_keyword_strcmp_chain(words[i]);
+        }
+    }
+    double chain_time=keyword_bench_now()-start;
+
+    start=keyword_bench_now();
+    for(int r=0;r<KEYWORD_BENCH_ROUNDS;r++){
+        for(int i=0;i<KEYWORD_BENCH_IDENTIFIERS;i++){
+            sink+=keyword_lookup(words[i], lens[i])!=KEYWORD_NONE;
+        }
+    }
+    double hash_time=keyword_bench_now()-start;
+
+    double total=(double)KEYWORD_BENCH_IDENTIFIERS*KEYWORD_BENCH_ROUNDS;
+    printf("关键字识别（S_EQ判断链）：%.1f 百万标识符/秒\n", total/chain_time/1e6);
+    printf("关键字识别（完美哈希）：  %.1f 百万标识符/秒\n", total/hash_time/1e6);
+    return 0;
+}
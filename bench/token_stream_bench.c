@@ -0,0 +1,76 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// token存储的基准：同一份token分别以struct token数组和结构数组形式存放，
+// 输出每MB能装下的token数量，以及语法分析那样取出每个有意义token的线性扫描速度
+// token数组里要逐个跳过换行注释，token_stream中它们已经在附属表里
+#define TOKEN_STREAM_BENCH_LINES 200000
+#define TOKEN_STREAM_BENCH_ROUNDS 20
+
+static double token_stream_bench_now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static void token_stream_bench_write_source(const char* filename){
+    FILE* fp=fopen(filename, "w");
+    for(int i=0;i<TOKEN_STREAM_BENCH_LINES;i++){
+        fprintf(fp, "value%d = (count + %d) * index; // step %d\n", i%100, i, i);
+    }
+    fclose(fp);
+}
+
+int main(){
+    char filename[]="/tmp/linycompiler_bench_XXXXXX";
+    int fd=mkstemp(filename);
+    if(fd<0){
+        return -1;
+    }
+    close(fd);
+    token_stream_bench_write_source(filename);
+
+    struct compile_process* process=compile_process_create(filename, NULL, 0);
+    struct lex_process* lex_process=lex_process_create(process, process->lex_functions, NULL);
+    lex(lex_process);
+    struct vector* token_vec=lex_process_tokens(lex_process);
+    struct token_stream* stream=token_stream_from_vector(token_vec);
+    int total=vector_count(token_vec);
+    int significant=token_stream_count(stream);
+
+    volatile int sink=0;
+    double start=token_stream_bench_now();
+    for(int r=0;r<TOKEN_STREAM_BENCH_ROUNDS;r++){
+        for(int i=0;i<total;i++){
+            struct token* token=vector_at(token_vec, i);
+            if(!token_is_nl_or_newline_seperator(token)){
+                sink+=token->type;
+            }
+        }
+    }
+    double vector_time=token_stream_bench_now()-start;
+
+    start=token_stream_bench_now();
+    for(int r=0;r<TOKEN_STREAM_BENCH_ROUNDS;r++){
+        for(int i=0;i<significant;i++){
+            sink+=token_stream_type(stream, i);
+        }
+    }
+    double stream_time=token_stream_bench_now()-start;
+
+    double scanned=(double)significant*TOKEN_STREAM_BENCH_ROUNDS;
+    printf("token数量：%d，其中有意义的%d，换行和注释%d\n", total, significant, vector_count(stream->trivia));
+    printf("struct token数组：%zu字节/token，%.0f token/MB，扫描%.1f 百万token/秒\n",
+        sizeof(struct token), 1048576.0/sizeof(struct token), scanned/vector_time/1e6);
+    printf("结构数组token_stream：%zu字节/token，%.0f token/MB，扫描%.1f 百万token/秒\n",
+        token_stream_bytes_per_token(stream), 1048576.0/token_stream_bytes_per_token(stream), scanned/stream_time/1e6);
+
+    token_stream_free(stream);
+    lex_process_free(lex_process);
+    compile_process_free(process);
+    unlink(filename);
+    return 0;
+}
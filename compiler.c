@@ -1,52 +1,195 @@
 #include "compiler.h"
+#include "helpers/vector.h"
 #include <stdarg.h>
 #include <stdlib.h>
-
-struct lex_process_functions compiler_lex_functions={
-    .next_char=compile_process_next_char,
-    .peek_char=compile_process_peek_char,
-    .push_char=compile_process_push_char
-};
+#include <time.h>
 
 void compiler_error(struct compile_process* compiler, const char* msg, ...){
     va_list args;
     va_start(args, msg);
     vfprintf(stderr, msg, args);
     va_end(args);
-    fprintf(stderr, "在第%i行,第%i列,%s文件\n", compiler->pos.line, compiler->pos.col, compiler->pos.filename);
+    //还没有登记任何源码时（比如第一份源码就放不下）没有位置可以报告
+    struct pos pos=compile_process_resolve_offset(compiler, compiler->offset);
+    if(pos.filename){
+        fprintf(stderr, "在第%i行,第%i列,%s文件\n", pos.line, pos.col, pos.filename);
+    }
+    //同一进程里可能还有别的文件在编译，只结束当前这一个
+    if(compiler->error_jmp){
+        longjmp(*compiler->error_jmp, 1);
+    }
     exit(-1);
 }
 
 void compiler_warning(struct compile_process* compiler, const char* msg, ...){
+    if(compiler->flags&COMPILE_PROCESS_FLAG_NO_WARNINGS){
+        return;
+    }
     va_list args;
     va_start(args, msg);
     vfprintf(stderr, msg, args);
     va_end(args);
-    fprintf(stderr, "在第%i行\n,第%i列,%s文件\n", compiler->pos.line, compiler->pos.col, compiler->pos.filename);
+    struct pos pos=compile_process_resolve_offset(compiler, compiler->offset);
+    fprintf(stderr, "在第%i行\n,第%i列,%s文件\n", pos.line, pos.col, pos.filename);
+}
+
+static double compile_clock_seconds(clockid_t clock){
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+//记下阶段开始的时刻，CPU时间按线程统计，多个文件同时编译时互不影响
+static void compile_phase_begin(struct compile_phase_time* start){
+    start->wall=compile_clock_seconds(CLOCK_MONOTONIC);
+    start->cpu=compile_clock_seconds(CLOCK_THREAD_CPUTIME_ID);
+}
+
+static void compile_phase_end(struct compile_process* process, int phase, struct compile_phase_time* start){
+    struct compile_phase_time* time=&process->stats.phases[phase];
+    time->wall+=compile_clock_seconds(CLOCK_MONOTONIC)-start->wall;
+    time->cpu+=compile_clock_seconds(CLOCK_THREAD_CPUTIME_ID)-start->cpu;
+}
+
+//对准备好输入的编译过程依次做词法分析、预处理、语法分析
+static int compile_process_run(struct compile_process* process, struct lex_process* lex_process, struct source_file* source){
+    int res=COMPILOR_FILE_COMPLETE_OK;
+    struct compile_phase_time start;
+    jmp_buf error_jmp;
+    if(setjmp(error_jmp)){
+        res=COMPILOR_FAILED_WITH_ERRORS;
+        goto out;
+    }
+    process->error_jmp=&error_jmp;
+
+    if(!process->token_stream){
+        process->token_stream=token_stream_create();
+    }
+    if(!process->lexed_tokens){
+        process->lexed_tokens=token_stream_create();
+    }
+    struct token_stream* lexed=process->lexed_tokens;
+    //生成预编译头文件需要完整的预处理结果，不能流式读取
+    bool emit_pch=process->flags&COMPILE_PROCESS_FLAG_EMIT_PCH;
+    bool streaming=(process->flags&COMPILE_PROCESS_FLAG_STREAMING)&&!emit_pch;
+
+    //缓存里有同样内容的源码的token时不需要词法分析
+    compile_phase_begin(&start);
+    process->stats.token_cache_hit=token_cache_load(process, lexed, source);
+    compile_phase_end(process, COMPILE_PHASE_LEX, &start);
+    if(!process->stats.token_cache_hit){
+        if(streaming){
+            //流式：语法分析边分析边向词法分析器要token，内存占用不随文件大小增长
+            lexed->lexer=lex_process;
+        } else {
+            //词法分析
+            compile_phase_begin(&start);
+            if(lex(lex_process)!=LEXICAL_ANALYSIS_ALL_OK){
+                res=COMPILOR_FAILED_WITH_ERRORS;
+                goto out;
+            }
+            process->token_vec=lex_process->token_vec;
+            token_stream_push_vector(lexed, process->token_vec);
+            token_cache_store(process, lexed, source, 0);
+            compile_phase_end(process, COMPILE_PHASE_LEX, &start);
+        }
+    }
+
+    //预处理
+    compile_phase_begin(&start);
+    if(!streaming&&!process->options.include_pch&&!preprocessor_has_directives(lexed)){
+        //没有预处理指令，语法分析直接读取词法分析的结果
+        process->lexed_tokens=process->token_stream;
+        process->token_stream=lexed;
+    } else {
+        if(!process->preprocessor){
+            process->preprocessor=preprocessor_create(process);
+        }
+        preprocessor_begin(process->preprocessor, lexed);
+        if(process->options.include_pch){
+            //预编译头文件的token排在编译文件的前面，宏和头文件在预处理编译文件之前登记好
+            pch_load(process, process->token_stream);
+        }
+        if(streaming){
+            process->token_stream->preprocessor=process->preprocessor;
+        } else {
+            preprocessor_run(process->preprocessor, process->token_stream);
+        }
+    }
+    compile_phase_end(process, COMPILE_PHASE_PREPROCESS, &start);
+    if(emit_pch){
+        //头文件不做语法分析，写出预编译头文件的时间算在代码生成里
+        compile_phase_begin(&start);
+        pch_write(process);
+        compile_phase_end(process, COMPILE_PHASE_CODEGEN, &start);
+        goto out;
+    }
+    if(!streaming){
+        //节点数不会比token多太多，按token数一次分配好节点数组
+        vector_reserve(process->nodes, token_stream_count(process->token_stream)+1);
+    }
+    //语义分析
+    compile_phase_begin(&start);
+    if(parse(process)!=PARSE_ALL_OK){
+        res=COMPILOR_FAILED_WITH_ERRORS;
+        goto out;
+    }
+    compile_phase_end(process, COMPILE_PHASE_PARSE, &start);
+
+    //代码生成
+    compile_phase_begin(&start);
+    compile_phase_end(process, COMPILE_PHASE_CODEGEN, &start);
+
+out:
+    process->error_jmp=NULL;
+    if(process->flags&COMPILE_PROCESS_FLAG_TIME_REPORT){
+        compile_process_time_report(process, stderr);
+    }
+    return res;
 }
 
 //编译函数入口
-int compile_file(const char *filename, const char *out_filename, int flags){
+int compile_file(const char *filename, const char *out_filename, int flags, struct compile_options* options){
     struct compile_process* process=compile_process_create(filename, out_filename, flags);
     if(!process){
         return COMPILOR_FAILED_WITH_ERRORS;
     }
-    //词法分析
-    struct lex_process* lex_process=lex_process_create(process, &compiler_lex_functions, NULL);
+    if(options){
+        process->options=*options;
+    }
+    struct lex_process* lex_process=lex_process_create(process, process->lex_functions, NULL);
     if(!lex_process){
+        compile_process_free(process);
         return COMPILOR_FAILED_WITH_ERRORS;
     }
 
-    if(lex(lex_process)!=LEXICAL_ANALYSIS_ALL_OK){
-        return COMPILOR_FAILED_WITH_ERRORS;
-    }
+    int res=compile_process_run(process, lex_process, process->cfile.source);
+    //token文本引用映射进来的源码和text_pool，随编译过程一起释放
+    lex_process_free(lex_process);
+    compile_process_free(process);
+    return res;
+}
 
-    process->token_vec=lex_process->token_vec;
-    //语义分析
-    if(parse(process)!=PARSE_ALL_OK){
+//编译内存中的一段源码，不访问文件系统，输出用compile_process_output取得
+//process由compile_process_create_for_memory创建，每次编译前清掉上一次的结果但保留申请的内存
+//要使用token缓存时在process->options里设置cache_dir
+//字符串和注释token直接引用data，data要在下一次编译或者释放process之前一直有效
+int compile_memory(struct compile_process* process, const char* name, const char* data, size_t size){
+    compile_process_reset(process);
+    //源码太大时compiler_error跳回这里
+    jmp_buf error_jmp;
+    if(setjmp(error_jmp)){
         return COMPILOR_FAILED_WITH_ERRORS;
     }
-    
-    //代码生成
-    return COMPILOR_FILE_COMPLETE_OK;
-} 
\ No newline at end of file
+    process->error_jmp=&error_jmp;
+    struct source_file* source=compile_process_add_source(process, name, data, size);
+    process->error_jmp=NULL;
+    if(!process->lexer){
+        process->lexer=lex_process_create(process, &lexer_source_functions, source);
+    } else {
+        lex_process_reset(process->lexer, &lexer_source_functions, source);
+    }
+    vector_reserve(process->lexer->token_vec, size/LEX_AVERAGE_BYTES_PER_TOKEN);
+    process->lexer->offset=source->base;
+    return compile_process_run(process, process->lexer, source);
+}
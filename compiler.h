@@ -4,17 +4,36 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include "helpers/counters.h"
 
-//判断两个char*是否相等的宏
-#define S_EQ(str1, str2) (str1&&str2&&(strcmp(str1, str2)==0))
+//判断两个char*是否相等的宏，地址相同时直接相等，否则仍用strcmp比较内容
+//两边都是驻留过的字符串时地址不同就一定不相等，这时可以直接用==，省掉strcmp
+#define S_EQ(str1, str2) (str1&&str2&&((str1)==(str2)||strcmp(str1, str2)==0))
 
 //标志编译文件（文件名）的第几行第几列
+//token和语法树节点只保存32位的源码偏移，需要报错或调试输出时才换算成struct pos
 struct pos{
     int line;
     int col;
     const char* filename;
 };
 
+//参与编译的一份源码，所有源码共用一个偏移空间，base是这份源码第一个字节的偏移
+struct source_file{
+    const char* filename;
+    //源码内容，读取时没有保留内容（管道输入）则为NULL
+    const char* data;
+    uint32_t base;
+    uint32_t size;
+    //uint32_t，每一行第一个字节在这份源码中的偏移，第一次换算位置时才建立
+    struct vector* line_starts;
+};
+//所有源码共用的偏移空间的大小，源码的每个字节和末尾的EOF都要在这之内
+//最高位留给TOKEN_SPAN_POOL，偏移只能用到它下面
+#define SOURCE_OFFSET_LIMIT TOKEN_SPAN_POOL
+
 #define NUMERIC_CASE \
     case '0': \
     case '1': \
@@ -81,95 +100,556 @@ enum{
     TOKEN_TYPE_NUMBER,
     TOKEN_TYPE_STRING,
     TOKEN_TYPE_COMMENT,
-    TOKEN_TYPE_NEWLINE
+    TOKEN_TYPE_NEWLINE,
+    TOKEN_TYPE_TOTAL
+};
+
+enum{
+    KEYWORD_NONE=-1,
+    KEYWORD_UNSIGNED,
+    KEYWORD_SIGNED,
+    KEYWORD_CHAR,
+    KEYWORD_INT,
+    KEYWORD_SHORT,
+    KEYWORD_LONG,
+    KEYWORD_FLOAT,
+    KEYWORD_DOUBLE,
+    KEYWORD_VOID,
+    KEYWORD_STRUCT,
+    KEYWORD_UNION,
+    KEYWORD_STATIC,
+    KEYWORD_IGNORE_TYPECHECK,
+    KEYWORD_RETURN,
+    KEYWORD_INCLUDE,
+    KEYWORD_SIZEOF,
+    KEYWORD_IF,
+    KEYWORD_ELSE,
+    KEYWORD_WHILE,
+    KEYWORD_FOR,
+    KEYWORD_DO,
+    KEYWORD_BREAK,
+    KEYWORD_CONTINUE,
+    KEYWORD_SWITCH,
+    KEYWORD_CASE,
+    KEYWORD_DEFAULT,
+    KEYWORD_GOTO,
+    KEYWORD_TYPEDEF,
+    KEYWORD_CONST,
+    KEYWORD_EXTERN,
+    KEYWORD_RESTRICT,
+    KEYWORD_TOTAL
+};
+
+enum{
+    //同时也是运算符状态机的初始状态
+    OPERATOR_NONE,
+    OPERATOR_PLUS,
+    OPERATOR_MINUS,
+    OPERATOR_STAR,
+    OPERATOR_SLASH,
+    OPERATOR_PERCENT,
+    OPERATOR_NOT,
+    OPERATOR_XOR,
+    OPERATOR_BITWISE_NOT,
+    OPERATOR_QUESTION,
+    OPERATOR_COMMA,
+    OPERATOR_DOT,
+    OPERATOR_LEFT_PAREN,
+    OPERATOR_LEFT_BRACKET,
+    OPERATOR_ASSIGN,
+    OPERATOR_LESS,
+    OPERATOR_GREATER,
+    OPERATOR_BITWISE_OR,
+    OPERATOR_BITWISE_AND,
+    OPERATOR_PLUS_ASSIGN,
+    OPERATOR_MINUS_ASSIGN,
+    OPERATOR_STAR_ASSIGN,
+    OPERATOR_SLASH_ASSIGN,
+    OPERATOR_PERCENT_ASSIGN,
+    OPERATOR_XOR_ASSIGN,
+    OPERATOR_OR_ASSIGN,
+    OPERATOR_AND_ASSIGN,
+    OPERATOR_SHIFT_LEFT_ASSIGN,
+    OPERATOR_SHIFT_RIGHT_ASSIGN,
+    OPERATOR_INCREMENT,
+    OPERATOR_DECREMENT,
+    OPERATOR_SHIFT_LEFT,
+    OPERATOR_SHIFT_RIGHT,
+    OPERATOR_LESS_EQUAL,
+    OPERATOR_GREATER_EQUAL,
+    OPERATOR_EQUAL,
+    OPERATOR_NOT_EQUAL,
+    OPERATOR_LOGICAL_AND,
+    OPERATOR_LOGICAL_OR,
+    OPERATOR_ARROW,
+    OPERATOR_ELLIPSIS,
+    OPERATOR_TOTAL
 };
 
 enum{
     NUMBER_TYPE_NORMAL,
     NUMBER_TYPE_LONG,
+    NUMBER_TYPE_LONG_LONG,
     NUMBER_TYPE_FLOAT,
     NUMBER_TYPE_DOUBLE
 };
 
+//token文本在源码中的位置，源码一直保留到编译过程重置或释放，不需要另外拷贝
+//转义改变了内容或者源码没有保留在内存中时，文本放在compile_process->text_pool里，offset带上TOKEN_SPAN_POOL
+struct token_span{
+    uint32_t offset;
+    uint32_t len;
+};
+
+//源码偏移不会用到最高位，见SOURCE_OFFSET_LIMIT
+#define TOKEN_SPAN_POOL 0x80000000u
+
 struct token
 {
     int type;
     int flags;
-    struct pos pos;
+    //token第一个字符的源码偏移
+    uint32_t offset;
     union{
         char cval;
         const char* sval;
         unsigned int inum;
         unsigned long lnum;
         unsigned long long llnum;
+        //浮点数常量的值，float类型的也按double存放
+        double dnum;
+        //TOKEN_TYPE_STRING和TOKEN_TYPE_COMMENT的文本，用compile_process_text取得
+        struct token_span span;
         void* any;
+        //TOKEN_TYPE_KEYWORD的token存放关键字枚举KEYWORD_*
+        int kw;
+        //TOKEN_TYPE_OPERATOR的token存放运算符枚举OPERATOR_*
+        int op;
     };
 
+    //数字常量的类型NUMBER_TYPE_*，以及有没有u后缀或者因为放不下而成为无符号数
     struct token_number{
         int type;
+        bool is_unsigned;
     } num;
 
-    //与下一个token之间是否有空白需要跳过
+    //与下一个token之间是否有空白需要跳过，后面是换行或注释时也算
     bool whitespace;
+    //是一行中第一个有意义的token，前面的换行在token_stream的trivia附属表里
+    bool line_start;
 
-    const char* between_brackets;
-
-
+    //在括号里时是最外层'('后面第一个字节的源码偏移，括号里的文本从这里开始；0表示不在括号里
+    uint32_t between_brackets;
 };
 
+//预估token数量时假设的平均每个token占用的源码字节数（含空白）
+#define LEX_AVERAGE_BYTES_PER_TOKEN 6
+//预估行数时假设的平均每行字节数
+#define LEX_AVERAGE_BYTES_PER_LINE 32
+
 struct lex_process;
 typedef char (*LEX_PROCESS_NEXT_CHAR)(struct lex_process* process);
 typedef char (*LEX_PROCESS_PEEK_CHAR)(struct lex_process* process);
 typedef void (*LEX_PROCESS_PUSH_CHAR)(struct lex_process* process, char c);
+//返回从当前位置开始还没有读取的源码，*len为剩余的字节数，可以整段扫描而不用一个个字符读取
+typedef const char* (*LEX_PROCESS_SPAN)(struct lex_process* process, size_t* len);
+//向前跳过n个字节，这些字节必须来自span返回的内容，词法分析器自己的偏移由调用者更新
+typedef void (*LEX_PROCESS_SKIP)(struct lex_process* process, size_t n);
 
 struct lex_process_functions{
     LEX_PROCESS_NEXT_CHAR next_char;
     LEX_PROCESS_PEEK_CHAR peek_char;
     LEX_PROCESS_PUSH_CHAR push_char;
+    //源码不在内存中的读取方式（比如getc）没有这两个函数，为NULL
+    LEX_PROCESS_SPAN span;
+    LEX_PROCESS_SKIP skip;
 };
 
 struct lex_process{
-    struct pos pos;
+    //下一个要读取的字符的源码偏移
+    uint32_t offset;
+    //当前正在读取的token的起始偏移
+    uint32_t token_offset;
     struct vector* token_vec;
     struct compile_process* compiler;
 
     int current_expression_count;
-    struct buffer* parentheses_buffer;
+    //最外层'('后面第一个字节的源码偏移，括号里的token都记下它
+    uint32_t brackets_start;
+    // 读取token文本时共用的临时缓冲区，源码不在内存中或者转义改变了内容时文本才从这里拷贝到text_pool
+    struct buffer* scratch_buffer;
+    // 正在生成的token，加入token_vec之前暂存在这里
+    struct token tmp_token;
     struct lex_process_functions* functions;
 
     void* private;
     
 };
 
+//源码中的一处编辑：把从offset开始的removed个字节换成了inserted个字节，offset相对编辑之前的源码
+struct lex_edit{
+    uint32_t offset;
+    uint32_t removed;
+    uint32_t inserted;
+};
+
+//增量词法分析的结果：token_vec中[first, old_end)的旧token被替换成了[first, new_end)
+struct lex_relex_result{
+    int first;
+    int old_end;
+    int new_end;
+};
+
+//换行、注释和续行的反斜杠不进入token_stream的数组，按顺序记在附属表里
+//语法分析和预处理只看数组里有意义的token，需要还原源码的工具从这里读取
+struct token_trivia{
+    //后面第一个有意义的token的序号，文件末尾的为token总数
+    int next;
+    uint32_t offset;
+    //TOKEN_TYPE_NEWLINE、TOKEN_TYPE_COMMENT，续行的反斜杠是TOKEN_TYPE_SYMBOL
+    int type;
+    //注释的文本，其余的len为0
+    struct token_span span;
+};
+
+//token的结构数组（SoA）存储，每个数组的下标就是token的序号
+struct token_stream{
+    //uint8_t，TOKEN_TYPE_*
+    struct vector* types;
+    //uint8_t，whitespace、行首标志和数字类型
+    struct vector* flags;
+    //unsigned long long，token联合体中的值
+    struct vector* values;
+    //uint32_t，源码偏移
+    struct vector* offsets;
+    //uint32_t，between_brackets
+    struct vector* brackets;
+
+    //语法分析读取到的位置
+    int pindex;
+
+    //流式读取时token从这个词法分析器按需读取，读完或者不是流式读取时为NULL
+    struct lex_process* lexer;
+    //流式读取时token从这个预处理器按需读取，和lexer不会同时设置
+    struct preprocessor* preprocessor;
+    //数组里第一个token的序号，之前的token已经被丢弃
+    int base;
+    //int，token_stream_save保存的读取位置
+    struct vector* saves;
+    //struct token_trivia，按next从小到大排列，流式读取时随token一起丢弃
+    struct vector* trivia;
+    //上一个有意义的token之后读到过换行，下一个token在行首
+    bool line_start;
+    //上一个附属项是续行的反斜杠，紧跟的换行不开始新的一行
+    bool continuation;
+};
+
 enum{
     COMPILOR_FILE_COMPLETE_OK,
     COMPILOR_FAILED_WITH_ERRORS
 };
 
+enum{
+    // 编译结束时打印arena的使用情况
+    COMPILE_PROCESS_FLAG_ARENA_REPORT=0b00000001,
+    // 不先完成整个文件的词法分析，语法分析需要token时才读取
+    COMPILE_PROCESS_FLAG_STREAMING=0b00000010,
+    // 每次编译结束时打印各阶段的耗时和计数
+    COMPILE_PROCESS_FLAG_TIME_REPORT=0b00000100,
+    // 编译的是头文件，预处理之后把token和宏写成预编译头文件，不做语法分析
+    COMPILE_PROCESS_FLAG_EMIT_PCH=0b00001000,
+    // 不打印警告，和gcc的-w一样
+    COMPILE_PROCESS_FLAG_NO_WARNINGS=0b00010000
+};
+
+//命令行上除了标志位以外的编译选项，没有给出的为NULL
+struct compile_options{
+    //token缓存所在的目录，相同内容的源码再次编译时直接读取缓存的token
+    const char* cache_dir;
+    //-I给出的头文件目录，按顺序查找
+    const char** include_dirs;
+    int include_dir_count;
+    //-include-pch给出的预编译头文件，编译开始时先读入它的token和宏
+    const char* include_pch;
+};
+
+//token缓存和预编译头文件中的一段token，各段的位置都相对文件开头，每段按8字节对齐
+struct token_cache_tokens{
+    uint32_t token_count;
+    uint32_t identifier_count;
+    uint32_t trivia_count;
+    //uint8_t，TOKEN_TYPE_*
+    uint64_t types;
+    //uint8_t，与token_stream中的标志相同
+    uint64_t flags;
+    //unsigned long long，标识符是identifiers的下标，其余是原值
+    //字符串和注释是相对源码开头的span，文本不在源码里时offset带上TOKEN_SPAN_POOL，是strings中的偏移
+    uint64_t values;
+    //uint32_t，相对源码开头的偏移
+    uint64_t offsets;
+    //uint32_t，0表示不在括号里，否则是between_brackets相对源码开头的偏移，'('占了一个字节所以不会是0
+    uint64_t brackets;
+    //struct token_cache_trivia，附属表
+    uint64_t trivia;
+    //uint32_t，每个不同的标识符在strings中的偏移
+    uint64_t identifiers;
+    //以'\0'结尾的文本依次存放
+    uint64_t strings;
+    uint64_t strings_size;
+};
+
+//写进缓存的附属项，next和offset都是相对值
+struct token_cache_trivia{
+    uint32_t next;
+    uint32_t offset;
+    uint32_t type;
+    //注释的文本，和字符串token的值一样保存
+    struct token_span span;
+};
+
+struct compile_process_mapping{
+    void* data;
+    size_t size;
+};
+
+enum{
+    COMPILE_PHASE_LEX,
+    COMPILE_PHASE_PREPROCESS,
+    COMPILE_PHASE_PARSE,
+    COMPILE_PHASE_CODEGEN,
+    COMPILE_PHASE_TOTAL
+};
+
+//单位都是秒，cpu是当前线程占用的CPU时间
+struct compile_phase_time{
+    double wall;
+    double cpu;
+};
+
 struct compile_process
 {
     // 标志文件应该如何被编译的标志位，比如-o, -c, -S等
     int flags;
-    // 记录编译到的位置和编译文件名等信息
-    struct pos pos;
+    // 记录编译到的位置，报错时再换算成行列和文件名
+    uint32_t offset;
     // fp即被打开编译的文件，abs_path是文件的绝对路径
     struct compile_process_input_file
     {
         FILE* fp;
         const char* abs_path;
+        // 普通文件会被整个mmap进来，data为映射的起始地址，offset为当前读取位置
+        // 无法映射时（管道、空文件等）data为NULL，退回用fp读取
+        const char* data;
+        size_t size;
+        size_t offset;
+        // 编译文件在source_files中的记录
+        struct source_file* source;
     } cfile;
 
+    // struct source_file*，按base从小到大排列
+    struct vector* source_files;
+
+    // compile_process_create根据输入文件选择的读取字符的函数表
+    struct lex_process_functions* lex_functions;
+
     //完成词法分析后的token数组
     struct vector* token_vec;
-
-    //用来管理语法树节点的push&pop等操作（没太懂）
+    //编译文件词法分析的结果，预处理从这里读取
+    struct token_stream* lexed_tokens;
+    //预处理之后的token，语法分析只读取这里
+    struct token_stream* token_stream;
+    //编译过程中第一次遇到预处理指令时创建，之后一直复用
+    struct preprocessor* preprocessor;
+
+    //语法树的全部节点，node_ref就是节点在这里的下标，0号是表示空的节点
+    //整棵树连续存放，编译结束时一次释放
+    struct vector* nodes;
+    //node_ref，每个节点的子节点列表都是这里连续的一段
+    struct vector* node_children;
+    //node_ref，用来管理语法树节点的push&pop等操作
     struct vector* node_vec;
-    //语法树的根节点
+    //node_ref，语法树的根节点
     struct vector* node_tree_vec;
+    //struct parser_operator，表达式语法分析用的运算符栈，嵌套再深也不会占用调用栈
+    struct vector* parser_operators;
 
     // ofile是编译后的输出文件
     FILE* ofile;
-    
+    // 在内存中编译时ofile由open_memstream打开，输出的内容在output里
+    bool in_memory;
+    char* output;
+    size_t output_size;
+    // compile_memory每次都复用这个词法分析器
+    struct lex_process* lexer;
+
+    struct compile_options options;
+    // struct compile_process_mapping，头文件和命中的token缓存文件映射进来的内存
+    // token的文本可能直接指向这里，编译过程重置或释放时才解除映射
+    struct vector* mappings;
+    // char，不在源码里的字符串和注释文本，token_span的offset带上TOKEN_SPAN_POOL时是这里的下标
+    struct vector* text_pool;
+
+    // 存放token文本等随编译过程一起释放的内存
+    struct arena* arena;
+
+    // 标识符的驻留表，token的sval指向表中唯一的一份文本
+    struct intern_table* interns;
+
+    // 语法分析器的状态，每个编译过程各自一份，多个文件可以同时编译
+    struct parser_state
+    {
+        // token_next和token_peek_next返回的token存放在这里
+        struct token last_token;
+        struct token peek_token;
+    } parser;
+
+    // -ftime-report需要的统计，每次编译开始时清零
+    struct compile_process_stats
+    {
+        struct compile_phase_time phases[COMPILE_PHASE_TOTAL];
+        // 各种类型的token的数量，按TOKEN_TYPE_*下标
+        size_t tokens[TOKEN_TYPE_TOTAL];
+        // 编译文件的token是否直接从缓存读取
+        bool token_cache_hit;
+        // 读取过的头文件数，#include的次数和其中因为#pragma once或者include guard直接跳过的次数
+        size_t headers;
+        size_t includes;
+        size_t includes_skipped;
+        // 从预编译头文件读入的token数
+        size_t pch_tokens;
+        // 编译开始时helpers的计数，报告时取差值
+        struct helper_counters counters_start;
+    } stats;
+
+    // compile_file设置的出错返回点，compiler_error跳回这里而不是结束整个进程
+    jmp_buf* error_jmp;
+};
+
+//头文件在一次编译中只读取和词法分析一次，之后每次包含都重放这里的token
+struct preprocessor_header{
+    //realpath得到的路径，已驻留，也是preprocessor->headers的键
+    const char* path;
+    struct source_file* source;
+    //从预编译头文件登记的头文件在第一次需要重放时才做词法分析，之前为NULL
+    struct token_stream* tokens;
+    //整个文件被#ifndef X ... #endif包住时是已驻留的X，否则为NULL
+    const char* guard;
+    //文件中出现过#pragma once
+    bool pragma_once;
+    //已经被包含过
+    bool included;
+};
+
+struct preprocessor_macro{
+    //已驻留的宏名
+    const char* name;
+    //宏的内容，不包括名字和参数列表
+    struct token* body;
+    int body_count;
+    //带参数的宏，名字后面紧跟着'('
+    bool function_like;
+    //已驻留的参数名
+    const char** params;
+    int param_count;
+    //最后一个参数是...
+    bool variadic;
+    //#define所在的位置
+    uint32_t offset;
+};
+
+//宏展开时不能再展开的宏名，只在链表头部追加，多个token共用后面的部分
+struct preprocessor_hideset{
+    const char* name;
+    struct preprocessor_hideset* next;
+};
+
+//宏展开过程中的token和它的hide set
+struct preprocessor_pending{
+    struct token token;
+    struct preprocessor_hideset* hideset;
+};
+
+//函数宏的一个实参，都是preprocessor->macro_args中的下标范围
+struct preprocessor_macro_arg{
+    int start;
+    int end;
+    //单独展开之后的结果，还没有展开时expanded_start为-1
+    int expanded_start;
+    int expanded_end;
+};
+
+//正在读取的一个文件
+struct preprocessor_frame{
+    struct token_stream* tokens;
+    //下一个要读取的token
+    int index;
+    //编译文件本身为NULL
+    struct preprocessor_header* header;
+    //进入这个文件时条件编译的层数，文件结束时必须回到这里
+    int conditional_depth;
+};
+
+//一层#if/#ifdef/#ifndef
+struct preprocessor_conditional{
+    //当前分支中的token要输出
+    bool active;
+    //已经选中过一个分支，或者外层没有被选中，之后的#elif和#else都不再选中
+    bool done;
+    bool seen_else;
+    uint32_t offset;
+};
+
+struct preprocessor{
+    struct compile_process* compiler;
+    //struct preprocessor_frame，#include的嵌套，栈顶是正在读取的文件
+    struct vector* frames;
+    //struct preprocessor_conditional
+    struct vector* conditionals;
+    //已驻留的宏名->struct preprocessor_macro*，#undef之后值为NULL
+    struct ptr_map* macros;
+    //已驻留的realpath->struct preprocessor_header*
+    struct ptr_map* headers;
+    //已驻留的"所在目录\n定界符文件名"->struct preprocessor_header*，同一处#include不需要再查找文件
+    struct ptr_map* include_paths;
+    //struct token，正在处理的一行预处理指令，不含开头的#，续行和注释已经去掉
+    struct vector* line;
+    //读取头文件时复用的词法分析器
+    struct lex_process* lexer;
+    //编译文件本身出现过#pragma once，只有生成预编译头文件时才有用
+    bool main_pragma_once;
+
+    //struct preprocessor_pending，宏展开的结果，栈顶是下一个要读取的token，读完才继续读文件
+    struct vector* pending;
+    //单独展开实参或者#if的条件时pending读到这里就结束，-1表示读完pending之后继续读文件
+    int pending_floor;
+    //struct preprocessor_pending，正在展开的宏的实参和实参展开的结果，嵌套的宏调用接着往后放
+    struct vector* macro_args;
+    //struct preprocessor_macro_arg
+    struct vector* macro_arg_ranges;
+    //struct preprocessor_pending，替换参数之后的宏内容，压进pending之前放在这里
+    struct vector* macro_output;
+    //#和##拼出的文本
+    struct buffer* spelling;
+
+    //已驻留的指令名，比较指针就能识别指令，if、else和include是关键字不在这里
+    struct preprocessor_names{
+        const char* define;
+        const char* undef;
+        const char* ifdef;
+        const char* ifndef;
+        const char* elif;
+        const char* endif;
+        const char* pragma;
+        const char* once;
+        const char* defined;
+        const char* error;
+        const char* warning;
+        const char* line;
+        const char* va_args;
+    } names;
+
+    //preprocessor_next_token返回的token存放在这里
+    struct token token;
 };
 
 enum{
@@ -207,59 +687,226 @@ enum{
     NODE_TYPE_UNION,
     NODE_TYPE_BRACKET,
     NODE_TYPE_CAST,
+    NODE_TYPE_SIZEOF,
     //空类型，类似null，不存在语法中的类型
-    NODE_TYPE_BLANK
+    NODE_TYPE_BLANK,
+    NODE_TYPE_TOTAL
+};
+
+//语法树节点的引用，是节点在compile_process->nodes中的下标
+//节点数组扩容时地址会变，但下标不会，节点之间只用下标互相引用
+typedef uint32_t node_ref;
+#define NODE_REF_NULL 0
+
+//node_children中从start开始的count个node_ref
+struct node_list{
+    uint32_t start;
+    uint32_t count;
+};
+
+enum{
+    //后缀的++、--
+    NODE_FLAG_POSTFIX=0b00000001,
+    //sizeof的是类型名，节点的datatype有效，没有表达式子节点
+    NODE_FLAG_SIZEOF_TYPE=0b00000010
+};
+
+enum{
+    DATA_TYPE_VOID,
+    DATA_TYPE_CHAR,
+    DATA_TYPE_SHORT,
+    DATA_TYPE_INT,
+    DATA_TYPE_LONG,
+    DATA_TYPE_LONG_LONG,
+    DATA_TYPE_FLOAT,
+    DATA_TYPE_DOUBLE,
+    DATA_TYPE_STRUCT,
+    DATA_TYPE_UNION
+};
+
+enum{
+    DATA_TYPE_FLAG_UNSIGNED=0b00000001,
+    DATA_TYPE_FLAG_SIGNED=0b00000010,
+    DATA_TYPE_FLAG_CONST=0b00000100
+};
+
+//cast和sizeof中的类型名，struct、union的名字放在一个NODE_TYPE_STRUCT或NODE_TYPE_UNION子节点的sval里
+struct node_datatype{
+    //DATA_TYPE_*
+    uint8_t type;
+    //DATA_TYPE_FLAG_*
+    uint8_t flags;
+    uint16_t pointer_depth;
 };
 
 struct node{
     int type;
     int flags;
 
-    struct pos pos;
+    uint32_t offset;
     struct node_binded{
         //指向body node
-        struct node* owner;
+        node_ref owner;
 
         //指向该node所在的function node
-        struct node* function;
+        node_ref function;
     } binded;
 
+    //子节点列表
+    struct node_list children;
+
+    //NODE_TYPE_NUMBER的类型DATA_TYPE_CHAR到DATA_TYPE_DOUBLE，以及是不是无符号数
+    //放在union前面对齐留下的空隙里，不增加节点的大小
+    struct node_number{
+        uint8_t type;
+        bool is_unsigned;
+    } num;
+
     union{
         char cval;
         const char* sval;
         unsigned int inum;
         unsigned long lnum;
+        //NODE_TYPE_NUMBER的整数值，按num的类型截断，有符号数做了符号扩展
         unsigned long long llnum;
+        //NODE_TYPE_NUMBER的浮点数值，float类型的已经舍入成float
+        double dnum;
+        //NODE_TYPE_EXPRESSION和NODE_TYPE_NUARY的运算符OPERATOR_*
+        int op;
+        //NODE_TYPE_CAST的目标类型，NODE_TYPE_SIZEOF带NODE_FLAG_SIZEOF_TYPE时的类型
+        struct node_datatype datatype;
+        //NODE_TYPE_STRING的文本，和token中的一样
+        struct token_span span;
     };
 };
 
-int compile_file(const char *filename, const char *output_filename, int flags);
+//表达式语法分析时还没有归约的运算符或者还没有结束的括号
+struct parser_operator{
+    //PARSER_OPERATOR_*
+    int kind;
+    int op;
+    int precedence;
+    uint32_t offset;
+    //PARSER_OPERATOR_CALL、PARSER_OPERATOR_BRACKET：压入时操作数栈的深度，结束时之上的都是它的操作数
+    //PARSER_OPERATOR_CAST：目标类型，struct、union的名字节点已经在操作数栈上
+    int operands;
+    struct node_datatype datatype;
+};
+
+int compile_file(const char *filename, const char *output_filename, int flags, struct compile_options* options);
+int compile_memory(struct compile_process* process, const char* name, const char* data, size_t size);
 struct compile_process* compile_process_create(const char* filename, const char* filename_out, int flags);
+struct compile_process* compile_process_create_for_memory(int flags);
+void compile_process_reset(struct compile_process* process);
+const char* compile_process_output(struct compile_process* process, size_t* size);
+void compile_process_free(struct compile_process* process);
+void compile_process_arena_report(struct compile_process* process, FILE* out);
+void compile_process_time_report(struct compile_process* process, FILE* out);
+struct source_file* compile_process_add_source(struct compile_process* process, const char* filename, const char* data, size_t size);
+void compile_process_add_mapping(struct compile_process* process, void* data, size_t size);
+struct source_file* compile_process_source_for_offset(struct compile_process* process, uint32_t offset);
+const char* compile_process_text(struct compile_process* process, struct token_span span);
+struct token_span compile_process_pool_text(struct compile_process* process, const char* text, size_t len);
+struct pos compile_process_resolve_offset(struct compile_process* process, uint32_t offset);
 
 char compile_process_next_char(struct lex_process* lex_process);
 char compile_process_peek_char(struct lex_process* lex_process);
 void compile_process_push_char(struct lex_process* lex_process, char c);
+char compile_process_mmap_next_char(struct lex_process* lex_process);
+char compile_process_mmap_peek_char(struct lex_process* lex_process);
+void compile_process_mmap_push_char(struct lex_process* lex_process, char c);
+const char* compile_process_mmap_span(struct lex_process* lex_process, size_t* len);
+void compile_process_mmap_skip(struct lex_process* lex_process, size_t n);
 
 void compiler_error(struct compile_process* compiler, const char* msg, ...);
 void compiler_warning(struct compile_process* compiler, const char* msg, ...);
 
 struct lex_process* lex_process_create(struct compile_process* compiler, struct lex_process_functions* functions, void* private);
+void lex_process_reset(struct lex_process* process, struct lex_process_functions* functions, void* private);
 void lex_process_free(struct lex_process* process);
 void* lex_process_private(struct lex_process* process);
 struct vector* lex_process_tokens(struct lex_process* process);
 
 int lex(struct lex_process* process);
+struct token* lex_next_token(struct lex_process* process);
+bool lex_is_in_expression(struct lex_process* lex_process);
 int parse(struct compile_process* process);
 struct lex_process* tokens_build_for_string(struct compile_process* compiler, const char* str);
-bool token_is_keyword(struct token *token, const char* value);
-
+extern struct lex_process_functions lexer_source_functions;
+int lex_relex(struct compile_process* compiler, struct vector* token_vec, struct source_file* source, const char* data, size_t size, struct lex_edit* edits, int total, struct lex_relex_result* result);
+bool token_is_keyword(struct token *token, int keyword);
+int keyword_lookup(const char* str, size_t len);
+const char* keyword_name(int kw);
+int operator_next_state(int state, char c);
+bool operator_state_is_accepting(int state);
+const char* operator_name(int op);
+
+const char* token_type_name(int type);
 bool token_is_symbol(struct token *token, char c);
+bool token_is_operator(struct token *token, int op);
 bool token_is_nl_or_newline_seperator(struct token* token);
 
-struct node* node_create(struct node* _node);
-struct node* node_pop();
-struct node* node_peek();
-struct node* node_peek_or_null();
-void node_push(struct node* node);
-void node_set_vector(struct vector* vec, struct vector* root_vec);
+bool token_cache_load(struct compile_process* process, struct token_stream* stream, struct source_file* source);
+void token_cache_store(struct compile_process* process, struct token_stream* stream, struct source_file* source, int first);
+bool token_cache_read_tokens(struct compile_process* process, struct token_stream* stream, const char* data, size_t size, struct token_cache_tokens* tokens, uint32_t text_size, uint32_t base);
+void token_cache_write_tokens(struct compile_process* process, FILE* fp, struct token_cache_tokens* tokens, struct token_stream* stream, int first, int total, uint32_t base);
+uint64_t token_cache_write_data(FILE* fp, const void* data, size_t size);
+
+bool macro_next_token(struct preprocessor* preprocessor, struct token* out);
+int macro_param_index(struct preprocessor* preprocessor, struct preprocessor_macro* macro, struct token* token);
+void macro_expand_line(struct preprocessor* preprocessor, struct vector* line, int start);
+
+void pch_write(struct compile_process* process);
+void pch_load(struct compile_process* process, struct token_stream* out);
+
+struct preprocessor* preprocessor_create(struct compile_process* compiler);
+void preprocessor_begin(struct preprocessor* preprocessor, struct token_stream* tokens);
+struct token* preprocessor_next_token(struct preprocessor* preprocessor);
+struct token* preprocessor_read_token(struct preprocessor* preprocessor);
+void preprocessor_run(struct preprocessor* preprocessor, struct token_stream* out);
+bool preprocessor_has_directives(struct token_stream* tokens);
+const char* preprocessor_find_guard(struct preprocessor* preprocessor, struct token_stream* tokens);
+void preprocessor_finish_main(struct preprocessor* preprocessor);
+struct preprocessor_macro* preprocessor_macro_lookup(struct preprocessor* preprocessor, const char* name);
+void preprocessor_reset(struct preprocessor* preprocessor);
+void preprocessor_free(struct preprocessor* preprocessor);
+
+struct token_stream* token_stream_create();
+void token_stream_free(struct token_stream* stream);
+void token_stream_reserve(struct token_stream* stream, int total);
+void token_stream_push(struct token_stream* stream, struct token* token);
+void token_stream_push_vector(struct token_stream* stream, struct vector* token_vec);
+void token_stream_append(struct token_stream* stream, struct token_stream* src, int start, int total);
+struct token_stream* token_stream_from_vector(struct vector* token_vec);
+void token_stream_clear(struct token_stream* stream);
+struct token_stream* token_stream_create_for_lexer(struct lex_process* lexer);
+int token_stream_count(struct token_stream* stream);
+bool token_stream_has(struct token_stream* stream, int index);
+int token_stream_type(struct token_stream* stream, int index);
+unsigned long long token_stream_value(struct token_stream* stream, int index);
+char token_stream_cval(struct token_stream* stream, int index);
+uint32_t token_stream_offset(struct token_stream* stream, int index);
+struct token* token_stream_get(struct token_stream* stream, int index, struct token* out);
+bool token_stream_line_start(struct token_stream* stream, int index);
+struct token_trivia* token_stream_trivia_before(struct token_stream* stream, int index, int* total);
+size_t token_stream_bytes_per_token(struct token_stream* stream);
+void token_stream_save(struct token_stream* stream);
+void token_stream_restore(struct token_stream* stream);
+void token_stream_save_purge(struct token_stream* stream);
+void token_stream_discard_consumed(struct token_stream* stream);
+
+void node_storage_reset(struct compile_process* process);
+node_ref node_create(struct compile_process* process, struct node* _node);
+struct node* node_get(struct compile_process* process, node_ref ref);
+node_ref node_pop(struct compile_process* process);
+node_ref node_peek(struct compile_process* process);
+node_ref node_peek_or_null(struct compile_process* process);
+void node_push(struct compile_process* process, node_ref ref);
+struct node_list node_list_create(struct compile_process* process, node_ref* refs, int total);
+node_ref node_list_at(struct compile_process* process, struct node_list list, uint32_t index);
+void node_release_tail(struct compile_process* process, node_ref* refs, int total);
+void node_stats_report(struct compile_process* process, FILE* out);
+const char* node_type_name(int type);
+
+bool fold_node(struct compile_process* process, struct node* node, node_ref* children, int total);
 #endif // LINYCOMPILOR_H
\ No newline at end of file
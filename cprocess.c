@@ -1,7 +1,207 @@
 #include <stdio.h>
 #include "compiler.h"
 #include <stdlib.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "helpers/vector.h"
+#include "helpers/arena.h"
+#include "helpers/intern.h"
+
+struct lex_process_functions compiler_lex_functions={
+    .next_char=compile_process_next_char,
+    .peek_char=compile_process_peek_char,
+    .push_char=compile_process_push_char
+};
+
+struct lex_process_functions compiler_mmap_lex_functions={
+    .next_char=compile_process_mmap_next_char,
+    .peek_char=compile_process_mmap_peek_char,
+    .push_char=compile_process_mmap_push_char,
+    .span=compile_process_mmap_span,
+    .skip=compile_process_mmap_skip
+};
+
+//普通文件整个映射进内存，之后读字符只需要移动游标；映射失败时退回getc的方式
+static void compile_process_map_input(struct compile_process* process){
+    struct stat st;
+    if(fstat(fileno(process->cfile.fp), &st)!=0||!S_ISREG(st.st_mode)||st.st_size==0){
+        return;
+    }
+
+    void* data=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(process->cfile.fp), 0);
+    if(data==MAP_FAILED){
+        return;
+    }
+    process->cfile.data=data;
+    process->cfile.size=st.st_size;
+    process->cfile.offset=0;
+    process->lex_functions=&compiler_mmap_lex_functions;
+}
+
+static void source_file_add_line(struct source_file* source, uint32_t line_start){
+    vector_push(source->line_starts, &line_start);
+}
+
+//偏移只有32位而且最高位另有用处，放不下的源码只能拒绝，否则偏移会回绕到别的源码上或者被当成text_pool的下标
+static void source_file_check_size(struct compile_process* process, uint32_t base, size_t size){
+    if(size>=SOURCE_OFFSET_LIMIT-base){
+        compiler_error(process, "源码太大，所有源码加起来不能超过%u字节\n", SOURCE_OFFSET_LIMIT);
+    }
+}
+
+struct source_file* compile_process_add_source(struct compile_process* process, const char* filename, const char* data, size_t size){
+    struct source_file* source=arena_alloc(process->arena, sizeof(struct source_file));
+    memset(source, 0, sizeof(struct source_file));
+    source->filename=filename?arena_strndup(process->arena, filename, strlen(filename)):NULL;
+    //新的源码接在上一份源码的后面，中间空出一个字节留给EOF
+    struct source_file* last=vector_back_ptr_or_null(process->source_files);
+    source->base=last?last->base+last->size+1:0;
+    source_file_check_size(process, source->base, size);
+    source->data=data;
+    source->size=size;
+    if(!data){
+        //内容没有保留下来，只能在读取的同时记录每一行的起始偏移
+        source->line_starts=vector_create(sizeof(uint32_t));
+        source_file_add_line(source, 0);
+    }
+    vector_push(process->source_files, &source);
+    return source;
+}
+
+static struct vector* source_file_line_starts(struct source_file* source){
+    if(source->line_starts){
+        return source->line_starts;
+    }
+
+    source->line_starts=vector_create(sizeof(uint32_t));
+    vector_reserve(source->line_starts, source->size/LEX_AVERAGE_BYTES_PER_LINE);
+    source_file_add_line(source, 0);
+    const char* ptr=source->data;
+    const char* end=source->data+source->size;
+    while((ptr=memchr(ptr, '\n', end-ptr))){
+        ptr++;
+        source_file_add_line(source, ptr-source->data);
+    }
+    return source->line_starts;
+}
+
+//data在编译过程重置或释放时用munmap解除映射
+void compile_process_add_mapping(struct compile_process* process, void* data, size_t size){
+    struct compile_process_mapping mapping={.data=data, .size=size};
+    vector_push(process->mappings, &mapping);
+}
+
+static void compile_process_unmap_all(struct compile_process* process){
+    for(int i=0;i<vector_count(process->mappings);i++){
+        struct compile_process_mapping* mapping=vector_at(process->mappings, i);
+        munmap(mapping->data, mapping->size);
+    }
+    vector_clear(process->mappings);
+}
+
+static void compile_process_free_line_tables(struct compile_process* process){
+    for(int i=0;i<vector_count(process->source_files);i++){
+        struct source_file* source=vector_peek_ptr_at(process->source_files, i);
+        if(source->line_starts){
+            vector_free(source->line_starts);
+        }
+    }
+}
+
+struct source_file* compile_process_source_for_offset(struct compile_process* process, uint32_t offset){
+    //二分查找base不超过offset的最后一份源码
+    int low=0;
+    int high=vector_count(process->source_files)-1;
+    struct source_file* res=NULL;
+    while(low<=high){
+        int mid=(low+high)/2;
+        struct source_file* source=vector_peek_ptr_at(process->source_files, mid);
+        if(source->base<=offset){
+            res=source;
+            low=mid+1;
+        } else {
+            high=mid-1;
+        }
+    }
+    return res;
+}
+
+struct pos compile_process_resolve_offset(struct compile_process* process, uint32_t offset){
+    struct pos pos={.line=0, .col=0, .filename=NULL};
+    struct source_file* source=compile_process_source_for_offset(process, offset);
+    if(!source){
+        return pos;
+    }
+
+    uint32_t local=offset-source->base;
+    struct vector* line_starts=source_file_line_starts(source);
+    uint32_t* starts=vector_data_ptr(line_starts);
+    int low=0;
+    int high=vector_count(line_starts)-1;
+    while(low<high){
+        int mid=(low+high+1)/2;
+        if(starts[mid]<=local){
+            low=mid;
+        } else {
+            high=mid-1;
+        }
+    }
+    pos.line=low+1;
+    pos.col=local-starts[low]+1;
+    pos.filename=source->filename;
+    return pos;
+}
+
+//span的文本，不以'\0'结尾，长度是span.len
+//text_pool还会增长，返回的指针只在下一次往里追加之前有效
+const char* compile_process_text(struct compile_process* process, struct token_span span){
+    if(span.offset&TOKEN_SPAN_POOL){
+        return (const char*)vector_data_ptr(process->text_pool)+(span.offset&~TOKEN_SPAN_POOL);
+    }
+    struct source_file* source=compile_process_source_for_offset(process, span.offset);
+    return source->data+(span.offset-source->base);
+}
+
+//不在源码里的文本拷贝到text_pool，返回指向它的span
+struct token_span compile_process_pool_text(struct compile_process* process, const char* text, size_t len){
+    if(len>=TOKEN_SPAN_POOL-vector_count(process->text_pool)){
+        compiler_error(process, "字符串和注释的文本太多，不能超过%u字节\n", TOKEN_SPAN_POOL);
+    }
+    struct token_span span={.offset=vector_count(process->text_pool)|TOKEN_SPAN_POOL, .len=len};
+    memcpy(vector_extend(process->text_pool, len), text, len);
+    return span;
+}
+
+static struct compile_process* compile_process_alloc(int flags){
+    struct compile_process* process = calloc(1, sizeof(struct compile_process));
+    process->nodes=vector_create(sizeof(struct node));
+    process->node_children=vector_create(sizeof(node_ref));
+    process->node_vec=vector_create(sizeof(node_ref));
+    process->node_tree_vec=vector_create(sizeof(node_ref));
+    process->parser_operators=vector_create(sizeof(struct parser_operator));
+    node_storage_reset(process);
+    process->arena=arena_create(0);
+    process->interns=intern_table_create(process->arena);
+    process->source_files=vector_create(sizeof(struct source_file*));
+    process->mappings=vector_create(sizeof(struct compile_process_mapping));
+    process->text_pool=vector_create(sizeof(char));
+    process->flags=flags;
+    process->lex_functions=&compiler_lex_functions;
+    process->stats.counters_start=helper_counters_snapshot();
+    return process;
+}
+
+//输出文件就是输入文件时（同一路径或者同一个inode），用"w"打开会在读取之前把源码清空
+static bool compile_process_same_file(FILE* file, const char* filename_out){
+    struct stat in;
+    struct stat out;
+    if(fstat(fileno(file), &in)!=0||stat(filename_out, &out)!=0){
+        return false;
+    }
+    return in.st_dev==out.st_dev&&in.st_ino==out.st_ino;
+}
+
 struct compile_process* compile_process_create(const char* filename, const char* filename_out, int flags)
 {
     FILE* file = fopen(filename, "r");
@@ -10,29 +210,219 @@ struct compile_process* compile_process_create(const char* filename, const char*
     }
     FILE* out_file=NULL;
     if(filename_out){
+        if(compile_process_same_file(file, filename_out)){
+            fprintf(stderr, "输出文件%s就是输入文件，不能覆盖\n", filename_out);
+            fclose(file);
+            return NULL;
+        }
         out_file = fopen(filename_out, "w");
         if(!out_file){
+            fclose(file);
             return NULL;
         }
     }
 
-    struct compile_process* process = calloc(1, sizeof(struct compile_process));
-    process->node_vec=vector_create(sizeof(struct node*));
-    process->node_tree_vec=vector_create(sizeof(struct node*));
-    
-    process->flags=flags;
+    struct compile_process* process = compile_process_alloc(flags);
     process->cfile.fp=file;
     process->ofile=out_file;
+    compile_process_map_input(process);
+    //源码太大时compiler_error跳回这里，只让这一个文件失败
+    jmp_buf error_jmp;
+    if(setjmp(error_jmp)){
+        compile_process_free(process);
+        return NULL;
+    }
+    process->error_jmp=&error_jmp;
+    process->cfile.source=compile_process_add_source(process, filename, process->cfile.data, process->cfile.size);
+    process->error_jmp=NULL;
+    return process;
+}
+
+//不读写任何文件的编译过程，用compile_memory编译内存中的源码，可以反复使用
+struct compile_process* compile_process_create_for_memory(int flags){
+    struct compile_process* process = compile_process_alloc(flags);
+    process->in_memory=true;
+    process->ofile=open_memstream(&process->output, &process->output_size);
+    if(!process->ofile){
+        compile_process_free(process);
+        return NULL;
+    }
     return process;
 }
 
+//输出的内容在下一次编译或者释放编译过程之前有效
+const char* compile_process_output(struct compile_process* process, size_t* size){
+    if(!process->in_memory){
+        *size=0;
+        return NULL;
+    }
+    fflush(process->ofile);
+    *size=ftello(process->ofile);
+    return process->output;
+}
+
+//清掉上一次编译的全部结果，arena、驻留表和各个数组申请的内存都留给下一次编译
+void compile_process_reset(struct compile_process* process){
+    if(process->cfile.data){
+        munmap((void*)process->cfile.data, process->cfile.size);
+    }
+    if(process->cfile.fp){
+        fclose(process->cfile.fp);
+    }
+    memset(&process->cfile, 0, sizeof(process->cfile));
+    compile_process_free_line_tables(process);
+    vector_clear(process->source_files);
+    node_storage_reset(process);
+    if(process->token_stream){
+        token_stream_clear(process->token_stream);
+    }
+    if(process->lexed_tokens){
+        token_stream_clear(process->lexed_tokens);
+    }
+    if(process->preprocessor){
+        preprocessor_reset(process->preprocessor);
+    }
+    //头文件的token还指向映射进来的内容，要等上面都清掉之后再解除映射
+    compile_process_unmap_all(process);
+    vector_clear(process->text_pool);
+    intern_table_clear(process->interns);
+    arena_reset(process->arena);
+
+    process->offset=0;
+    process->token_vec=NULL;
+    process->error_jmp=NULL;
+    memset(&process->parser, 0, sizeof(process->parser));
+    memset(&process->stats, 0, sizeof(process->stats));
+    process->stats.counters_start=helper_counters_snapshot();
+    if(process->in_memory){
+        rewind(process->ofile);
+    }
+}
+
+void compile_process_free(struct compile_process* process){
+    if(process->flags&COMPILE_PROCESS_FLAG_ARENA_REPORT){
+        compile_process_arena_report(process, stderr);
+    }
+    if(process->cfile.data){
+        munmap((void*)process->cfile.data, process->cfile.size);
+    }
+    if(process->cfile.fp){
+        fclose(process->cfile.fp);
+    }
+    if(process->ofile){
+        fclose(process->ofile);
+    }
+    free(process->output);
+    if(process->token_stream){
+        token_stream_free(process->token_stream);
+    }
+    if(process->lexed_tokens){
+        token_stream_free(process->lexed_tokens);
+    }
+    if(process->preprocessor){
+        preprocessor_free(process->preprocessor);
+    }
+    compile_process_unmap_all(process);
+    vector_free(process->mappings);
+    vector_free(process->text_pool);
+    if(process->lexer){
+        lex_process_free(process->lexer);
+    }
+    compile_process_free_line_tables(process);
+    vector_free(process->source_files);
+    vector_free(process->nodes);
+    vector_free(process->node_children);
+    vector_free(process->node_vec);
+    vector_free(process->node_tree_vec);
+    vector_free(process->parser_operators);
+    intern_table_free(process->interns);
+    arena_free(process->arena);
+    free(process);
+}
+
+void compile_process_arena_report(struct compile_process* process, FILE* out){
+    struct arena* arena=process->arena;
+    fprintf(out, "arena：使用%zu字节，浪费%zu字节，共申请%zu字节（%i块）\n",
+        arena_bytes_used(arena), arena_bytes_wasted(arena), arena_bytes_reserved(arena), arena->chunks);
+    fprintf(out, "驻留表：%zu个不同的字符串，重复出现%zu次\n", process->interns->count, process->interns->hits);
+    node_stats_report(process, out);
+}
+
+void compile_process_time_report(struct compile_process* process, FILE* out){
+    static const char* phase_names[COMPILE_PHASE_TOTAL]={
+        [COMPILE_PHASE_LEX]="词法分析",
+        [COMPILE_PHASE_PREPROCESS]="预处理",
+        [COMPILE_PHASE_PARSE]="语法分析",
+        [COMPILE_PHASE_CODEGEN]="代码生成"
+    };
+    struct compile_process_stats* stats=&process->stats;
+    //多个文件同时编译时报告整段拼好再输出，不会和别的文件的报告交错
+    char* report=NULL;
+    size_t report_size=0;
+    FILE* fp=open_memstream(&report, &report_size);
+    if(!fp){
+        return;
+    }
+
+    struct source_file* source=compile_process_source_for_offset(process, 0);
+    fprintf(fp, "时间报告：%s\n", source&&source->filename?source->filename:"<unknown>");
+    struct compile_phase_time total={0};
+    for(int i=0;i<COMPILE_PHASE_TOTAL;i++){
+        fprintf(fp, "  %s：墙上时间%.3fms，CPU时间%.3fms\n", phase_names[i], stats->phases[i].wall*1000, stats->phases[i].cpu*1000);
+        total.wall+=stats->phases[i].wall;
+        total.cpu+=stats->phases[i].cpu;
+    }
+    fprintf(fp, "  合计：墙上时间%.3fms，CPU时间%.3fms\n", total.wall*1000, total.cpu*1000);
+    if(process->stats.token_cache_hit){
+        fprintf(fp, "  token从缓存读取，词法分析的时间是读取缓存的时间\n");
+    } else if(process->flags&COMPILE_PROCESS_FLAG_STREAMING){
+        fprintf(fp, "  流式读取时词法分析和预处理的时间算在语法分析里\n");
+    }
+
+    if(stats->pch_tokens){
+        fprintf(fp, "  预编译头文件：%s，读入%zu个token\n", process->options.include_pch, stats->pch_tokens);
+    }
+    if(stats->includes){
+        fprintf(fp, "  头文件：读取%zu个，#include %zu次，其中%zu次因为#pragma once或include guard跳过\n",
+            stats->headers, stats->includes, stats->includes_skipped);
+    }
+    fprintf(fp, "  token：");
+    for(int i=0;i<TOKEN_TYPE_TOTAL;i++){
+        fprintf(fp, "%s%zu ", token_type_name(i), stats->tokens[i]);
+    }
+    fprintf(fp, "\n  语法树节点：");
+    size_t nodes[NODE_TYPE_TOTAL]={0};
+    struct node* node=vector_data_ptr(process->nodes);
+    for(int i=1;i<vector_count(process->nodes);i++){
+        nodes[node[i].type]++;
+    }
+    for(int i=0;i<NODE_TYPE_TOTAL;i++){
+        if(nodes[i]){
+            fprintf(fp, "%s %zu ", node_type_name(i), nodes[i]);
+        }
+    }
+
+    struct helper_counters counters=helper_counters_since(stats->counters_start);
+    fprintf(fp, "\n  buffer_create调用%zu次，vector扩容%zu次，申请%zu字节\n",
+        counters.buffer_creates, counters.vector_resizes, counters.bytes_allocated);
+    fclose(fp);
+    fwrite(report, 1, report_size, out);
+    free(report);
+}
+
 char compile_process_next_char(struct lex_process* lex_process){
     struct compile_process* compiler=lex_process->compiler;
-    compiler->pos.col+=1;
     char c=getc(compiler->cfile.fp);
+    if(c==EOF){
+        return c;
+    }
+    //读过的内容不会保留，行的起始偏移只能现在记下来
+    struct source_file* source=compiler->cfile.source;
+    compiler->cfile.offset++;
+    source_file_check_size(compiler, source->base, compiler->cfile.offset);
+    source->size=compiler->cfile.offset;
     if(c=='\n'){
-        compiler->pos.line+=1;
-        compiler->pos.col=1;
+        source_file_add_line(source, compiler->cfile.offset);
     }
 
     return c;
@@ -50,6 +440,51 @@ char compile_process_peek_char(struct lex_process* lex_process){
 
 void compile_process_push_char(struct lex_process* lex_process, char c){
     struct compile_process* compiler=lex_process->compiler;
+    if(c==EOF){
+        return;
+    }
     ungetc(c, compiler->cfile.fp);
-    
-}
\ No newline at end of file
+    if(c=='\n'){
+        vector_pop(compiler->cfile.source->line_starts);
+    }
+    compiler->cfile.offset--;
+
+}
+
+char compile_process_mmap_next_char(struct lex_process* lex_process){
+    struct compile_process* compiler=lex_process->compiler;
+    if(compiler->cfile.offset>=compiler->cfile.size){
+        return EOF;
+    }
+    return compiler->cfile.data[compiler->cfile.offset++];
+}
+
+char compile_process_mmap_peek_char(struct lex_process* lex_process){
+    struct compile_process* compiler=lex_process->compiler;
+    if(compiler->cfile.offset>=compiler->cfile.size){
+        return EOF;
+    }
+    return compiler->cfile.data[compiler->cfile.offset];
+}
+
+//映射是只读的，推回的只能是刚刚读出的字符，游标后退一格即可
+void compile_process_mmap_push_char(struct lex_process* lex_process, char c){
+    struct compile_process* compiler=lex_process->compiler;
+    if(c==EOF){
+        return;
+    }
+    assert(compiler->cfile.offset>0&&compiler->cfile.data[compiler->cfile.offset-1]==c);
+    compiler->cfile.offset--;
+}
+
+const char* compile_process_mmap_span(struct lex_process* lex_process, size_t* len){
+    struct compile_process* compiler=lex_process->compiler;
+    *len=compiler->cfile.size-compiler->cfile.offset;
+    return compiler->cfile.data+compiler->cfile.offset;
+}
+
+void compile_process_mmap_skip(struct lex_process* lex_process, size_t n){
+    struct compile_process* compiler=lex_process->compiler;
+    assert(compiler->cfile.offset+n<=compiler->cfile.size);
+    compiler->cfile.offset+=n;
+}
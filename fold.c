@@ -0,0 +1,414 @@
+#include "compiler.h"
+
+//常量折叠：语法分析每归约出一个节点就看一次，子节点都是常量时直接算出结果，把节点改写成NODE_TYPE_NUMBER
+//节点是自下而上生成的，一整串常量运算会一层层地折叠成一个节点
+//int是32位，long和long long是64位，char有符号；整数提升、寻常算术转换和溢出都按C的规则
+//除以0、移位位数超出范围、浮点数转整数超出范围是未定义行为，给出警告或者保留原来的节点，留到运行时
+
+static bool fold_is_float(int type){
+    return type==DATA_TYPE_FLOAT||type==DATA_TYPE_DOUBLE;
+}
+
+//算术类型的字节数，void、struct、union返回0
+static int fold_type_size(int type){
+    switch(type){
+        case DATA_TYPE_CHAR: return 1;
+        case DATA_TYPE_SHORT: return 2;
+        case DATA_TYPE_INT: return 4;
+        case DATA_TYPE_FLOAT: return 4;
+        case DATA_TYPE_LONG: return 8;
+        case DATA_TYPE_LONG_LONG: return 8;
+        case DATA_TYPE_DOUBLE: return 8;
+    }
+    return 0;
+}
+
+//整数截断到类型的宽度，有符号数再做符号扩展，这样按long long或unsigned long long读出来都是原来的值
+static unsigned long long fold_wrap(unsigned long long value, int type, bool is_unsigned){
+    int bits=fold_type_size(type)*8;
+    if(bits==64){
+        return value;
+    }
+    value&=(1ull<<bits)-1;
+    if(!is_unsigned&&(value>>(bits-1))){
+        value|=~0ull<<bits;
+    }
+    return value;
+}
+
+//有符号类型的最小值，-它和它/-1会溢出
+static unsigned long long fold_signed_min(int type){
+    return fold_wrap(1ull<<(fold_type_size(type)*8-1), type, false);
+}
+
+static bool fold_is_true(struct node* number){
+    return fold_is_float(number->num.type)?number->dnum!=0:number->llnum!=0;
+}
+
+//把常量转换成type类型，浮点数转整数时整数部分放不下是未定义行为，返回false
+static bool fold_convert(struct node* number, int type, bool is_unsigned){
+    bool from_float=fold_is_float(number->num.type);
+    if(type==DATA_TYPE_FLOAT){
+        //整数直接舍入成float，先变成double再变成float可能会舍入两次
+        if(from_float){
+            number->dnum=(float)number->dnum;
+        } else {
+            number->dnum=number->num.is_unsigned?(float)number->llnum:(float)(long long)number->llnum;
+        }
+        is_unsigned=false;
+    } else if(type==DATA_TYPE_DOUBLE){
+        if(!from_float){
+            number->dnum=number->num.is_unsigned?(double)number->llnum:(double)(long long)number->llnum;
+        }
+        is_unsigned=false;
+    } else if(from_float){
+        double value=number->dnum;
+        int bits=fold_type_size(type)*8;
+        double limit=(double)(1ull<<(bits-1))*(is_unsigned?2:1);
+        //NaN和任何数比较都是false，也会在这里返回
+        if(!(value>(is_unsigned?-1.0:-limit-1.0)&&value<limit)){
+            return false;
+        }
+        number->llnum=is_unsigned?(unsigned long long)value:(unsigned long long)(long long)value;
+    } else {
+        number->llnum=fold_wrap(number->llnum, type, is_unsigned);
+    }
+    number->num.type=type;
+    number->num.is_unsigned=is_unsigned;
+    return true;
+}
+
+//整数提升：char、short变成int，int放得下它们所有的值，值不用变
+static void fold_promote(struct node* number){
+    if(number->num.type<DATA_TYPE_INT){
+        number->num.type=DATA_TYPE_INT;
+        number->num.is_unsigned=false;
+    }
+}
+
+//寻常算术转换得到的公共类型，两个操作数都转换成这个类型
+static void fold_common_type(struct node* left, struct node* right, int* type, bool* is_unsigned){
+    if(fold_is_float(left->num.type)||fold_is_float(right->num.type)){
+        //DATA_TYPE_DOUBLE排在DATA_TYPE_FLOAT和所有整数类型后面
+        *type=left->num.type>right->num.type?left->num.type:right->num.type;
+        *is_unsigned=false;
+        return;
+    }
+    fold_promote(left);
+    fold_promote(right);
+    int left_type=left->num.type;
+    int right_type=right->num.type;
+    if(left->num.is_unsigned==right->num.is_unsigned){
+        *type=left_type>right_type?left_type:right_type;
+        *is_unsigned=left->num.is_unsigned;
+        return;
+    }
+    int signed_type=left->num.is_unsigned?right_type:left_type;
+    int unsigned_type=left->num.is_unsigned?left_type:right_type;
+    if(unsigned_type>=signed_type){
+        //无符号类型的等级不低于有符号类型
+        *type=unsigned_type;
+        *is_unsigned=true;
+    } else if(fold_type_size(signed_type)>fold_type_size(unsigned_type)){
+        //有符号类型放得下无符号类型所有的值，比如long和unsigned int
+        *type=signed_type;
+        *is_unsigned=false;
+    } else {
+        //long long和unsigned long一样宽，用unsigned long long
+        *type=signed_type;
+        *is_unsigned=true;
+    }
+}
+
+//警告指向运算符，而不是语法分析已经读到的位置
+static void fold_warning(struct compile_process* process, struct node* node, const char* message){
+    uint32_t offset=process->offset;
+    process->offset=node->offset;
+    compiler_warning(process, "%s", message);
+    process->offset=offset;
+}
+
+static void fold_result_int(struct node* node, bool value){
+    *node=(struct node){.type=NODE_TYPE_NUMBER, .offset=node->offset, .num={.type=DATA_TYPE_INT}, .llnum=value};
+}
+
+//结果放回node，node的位置不变
+static void fold_result(struct node* node, struct node* number){
+    uint32_t offset=node->offset;
+    *node=*number;
+    node->offset=offset;
+    node->flags=0;
+    node->children=(struct node_list){0};
+}
+
+//子节点都是常量时拷贝到numbers里，node_get返回的指针在这之后不会再用
+static bool fold_operands(struct compile_process* process, node_ref* children, int total, struct node* numbers){
+    for(int i=0;i<total;i++){
+        struct node* child=node_get(process, children[i]);
+        if(child->type!=NODE_TYPE_NUMBER){
+            return false;
+        }
+        numbers[i]=*child;
+    }
+    return true;
+}
+
+static bool fold_unary(struct compile_process* process, struct node* node, struct node* operand){
+    if(node->flags&NODE_FLAG_POSTFIX){
+        return false;
+    }
+    bool is_float=fold_is_float(operand->num.type);
+    switch(node->op){
+        case OPERATOR_NOT:
+            fold_result_int(node, !fold_is_true(operand));
+            return true;
+        case OPERATOR_PLUS:
+            fold_promote(operand);
+            break;
+        case OPERATOR_MINUS:
+            if(is_float){
+                operand->dnum=-operand->dnum;
+                break;
+            }
+            fold_promote(operand);
+            if(!operand->num.is_unsigned&&operand->llnum==fold_signed_min(operand->num.type)){
+                fold_warning(process, node, "整数常量表达式溢出\n");
+            }
+            operand->llnum=fold_wrap(0-operand->llnum, operand->num.type, operand->num.is_unsigned);
+            break;
+        case OPERATOR_BITWISE_NOT:
+            if(is_float){
+                return false;
+            }
+            fold_promote(operand);
+            operand->llnum=fold_wrap(~operand->llnum, operand->num.type, operand->num.is_unsigned);
+            break;
+        default:
+            //*、&、++、--需要左值或者指针，不是常量
+            return false;
+    }
+    fold_result(node, operand);
+    return true;
+}
+
+//比较和逻辑运算的结果是int的0或1，其余的结果是公共类型
+static bool fold_float_binary(struct node* node, struct node* left, struct node* right, int type){
+    double x=left->dnum;
+    double y=right->dnum;
+    double value;
+    switch(node->op){
+        case OPERATOR_PLUS: value=x+y; break;
+        case OPERATOR_MINUS: value=x-y; break;
+        case OPERATOR_STAR: value=x*y; break;
+        //浮点数除以0按IEEE 754得到无穷大或者NaN
+        case OPERATOR_SLASH: value=x/y; break;
+        case OPERATOR_EQUAL: fold_result_int(node, x==y); return true;
+        case OPERATOR_NOT_EQUAL: fold_result_int(node, x!=y); return true;
+        case OPERATOR_LESS: fold_result_int(node, x<y); return true;
+        case OPERATOR_GREATER: fold_result_int(node, x>y); return true;
+        case OPERATOR_LESS_EQUAL: fold_result_int(node, x<=y); return true;
+        case OPERATOR_GREATER_EQUAL: fold_result_int(node, x>=y); return true;
+        default:
+            //%、移位和位运算不能用在浮点数上，留给语义分析报错
+            return false;
+    }
+    //float的运算在double里做完再舍入一次，+-*/的结果和直接用float算的一样
+    left->dnum=type==DATA_TYPE_FLOAT?(float)value:value;
+    fold_result(node, left);
+    return true;
+}
+
+static bool fold_shift(struct compile_process* process, struct node* node, struct node* left, struct node* right){
+    if(fold_is_float(left->num.type)||fold_is_float(right->num.type)){
+        return false;
+    }
+    //移位的结果是左操作数提升后的类型，和右操作数无关
+    fold_promote(left);
+    fold_promote(right);
+    int bits=fold_type_size(left->num.type)*8;
+    if((!right->num.is_unsigned&&(long long)right->llnum<0)||right->llnum>=(unsigned long long)bits){
+        fold_warning(process, node, "移位的位数超出范围\n");
+        return false;
+    }
+    int count=right->llnum;
+    unsigned long long x=left->llnum;
+    if(node->op==OPERATOR_SHIFT_RIGHT){
+        //有符号数已经符号扩展过，算术右移之后还是这个类型的值
+        left->llnum=left->num.is_unsigned?x>>count:(unsigned long long)((long long)x>>count);
+    } else {
+        //有符号数左移的结果放不下或者左操作数是负数时是未定义行为，和gcc一样警告之后按补码截断
+        if(!left->num.is_unsigned&&((long long)x<0||(x>>(bits-1-count))!=0)){
+            fold_warning(process, node, "整数常量表达式溢出\n");
+        }
+        left->llnum=fold_wrap(x<<count, left->num.type, left->num.is_unsigned);
+    }
+    fold_result(node, left);
+    return true;
+}
+
+static bool fold_integer_binary(struct compile_process* process, struct node* node, struct node* left, struct node* right, int type, bool is_unsigned){
+    unsigned long long x=left->llnum;
+    unsigned long long y=right->llnum;
+    long long sx=x;
+    long long sy=y;
+    unsigned long long value;
+    bool overflow=false;
+    switch(node->op){
+        case OPERATOR_EQUAL: fold_result_int(node, x==y); return true;
+        case OPERATOR_NOT_EQUAL: fold_result_int(node, x!=y); return true;
+        case OPERATOR_LESS: fold_result_int(node, is_unsigned?x<y:sx<sy); return true;
+        case OPERATOR_GREATER: fold_result_int(node, is_unsigned?x>y:sx>sy); return true;
+        case OPERATOR_LESS_EQUAL: fold_result_int(node, is_unsigned?x<=y:sx<=sy); return true;
+        case OPERATOR_GREATER_EQUAL: fold_result_int(node, is_unsigned?x>=y:sx>=sy); return true;
+        case OPERATOR_BITWISE_AND: value=x&y; break;
+        case OPERATOR_BITWISE_OR: value=x|y; break;
+        case OPERATOR_XOR: value=x^y; break;
+        //无符号数按模2^n回绕；有符号数溢出是未定义行为，和gcc一样警告之后按补码截断
+        case OPERATOR_PLUS:
+            overflow=!is_unsigned&&__builtin_add_overflow(sx, sy, &sx);
+            value=is_unsigned?x+y:(unsigned long long)sx;
+            break;
+        case OPERATOR_MINUS:
+            overflow=!is_unsigned&&__builtin_sub_overflow(sx, sy, &sx);
+            value=is_unsigned?x-y:(unsigned long long)sx;
+            break;
+        case OPERATOR_STAR:
+            overflow=!is_unsigned&&__builtin_mul_overflow(sx, sy, &sx);
+            value=is_unsigned?x*y:(unsigned long long)sx;
+            break;
+        case OPERATOR_SLASH:
+        case OPERATOR_PERCENT:
+            if(y==0){
+                fold_warning(process, node, "整数常量表达式除以0\n");
+                return false;
+            }
+            if(is_unsigned){
+                value=node->op==OPERATOR_SLASH?x/y:x%y;
+            } else if(sy==-1){
+                //最小值/-1的商放不下，long long的最小值/-1在编译器自己这里也会出错，单独处理
+                overflow=node->op==OPERATOR_SLASH&&x==fold_signed_min(type);
+                value=node->op==OPERATOR_SLASH?0-x:0;
+            } else {
+                value=node->op==OPERATOR_SLASH?(unsigned long long)(sx/sy):(unsigned long long)(sx%sy);
+            }
+            break;
+        default:
+            return false;
+    }
+    unsigned long long wrapped=fold_wrap(value, type, is_unsigned);
+    if(overflow||(!is_unsigned&&wrapped!=value)){
+        fold_warning(process, node, "整数常量表达式溢出\n");
+    }
+    left->llnum=wrapped;
+    left->num.type=type;
+    left->num.is_unsigned=is_unsigned;
+    fold_result(node, left);
+    return true;
+}
+
+static bool fold_binary(struct compile_process* process, struct node* node, struct node* left, struct node* right){
+    switch(node->op){
+        case OPERATOR_LOGICAL_AND:
+            fold_result_int(node, fold_is_true(left)&&fold_is_true(right));
+            return true;
+        case OPERATOR_LOGICAL_OR:
+            fold_result_int(node, fold_is_true(left)||fold_is_true(right));
+            return true;
+        case OPERATOR_SHIFT_LEFT:
+        case OPERATOR_SHIFT_RIGHT:
+            return fold_shift(process, node, left, right);
+    }
+
+    int type;
+    bool is_unsigned;
+    fold_common_type(left, right, &type, &is_unsigned);
+    fold_convert(left, type, is_unsigned);
+    fold_convert(right, type, is_unsigned);
+    if(fold_is_float(type)){
+        return fold_float_binary(node, left, right, type);
+    }
+    return fold_integer_binary(process, node, left, right, type, is_unsigned);
+}
+
+static bool fold_sizeof(struct compile_process* process, struct node* node, node_ref* children){
+    unsigned long long size;
+    if(node->flags&NODE_FLAG_SIZEOF_TYPE){
+        //struct、union的大小要等到语义分析才知道，指向它们的指针的大小是确定的
+        size=node->datatype.pointer_depth?8:fold_type_size(node->datatype.type);
+        if(!size){
+            return false;
+        }
+    } else {
+        struct node* operand=node_get(process, children[0]);
+        if(operand->type==NODE_TYPE_NUMBER){
+            size=fold_type_size(operand->num.type);
+        } else if(operand->type==NODE_TYPE_STRING){
+            //字符串字面量是char数组，span.len是去掉转义之后的长度，再加上结尾的'\0'
+            size=operand->span.len+1;
+        } else {
+            return false;
+        }
+    }
+    //结果的类型是size_t，也就是unsigned long
+    *node=(struct node){.type=NODE_TYPE_NUMBER, .offset=node->offset, .num={.type=DATA_TYPE_LONG, .is_unsigned=true}, .llnum=size};
+    return true;
+}
+
+//node是parser_make_node正要创建的节点，children是它的total个子节点
+//能折叠时把node改写成NODE_TYPE_NUMBER（括号里只有字符串字面量时是NODE_TYPE_STRING）并返回true，子节点都不再需要
+bool fold_node(struct compile_process* process, struct node* node, node_ref* children, int total){
+    struct node numbers[3];
+    switch(node->type){
+        case NODE_TYPE_SIZEOF:
+            return fold_sizeof(process, node, children);
+        case NODE_TYPE_EXPRESSION_PARENTHESES:
+        {
+            //括号里的字符串字面量也去掉括号，sizeof("...")才能折叠
+            struct node* child=node_get(process, children[0]);
+            if(child->type!=NODE_TYPE_NUMBER&&child->type!=NODE_TYPE_STRING){
+                return false;
+            }
+            numbers[0]=*child;
+            fold_result(node, &numbers[0]);
+            return true;
+        }
+        case NODE_TYPE_NUARY:
+            return fold_operands(process, children, 1, numbers)&&fold_unary(process, node, &numbers[0]);
+        case NODE_TYPE_EXPRESSION:
+            //函数调用的子节点个数不定，运算符是OPERATOR_LEFT_PAREN，不会匹配下面的二元运算符
+            if(total!=2||!fold_operands(process, children, 2, numbers)){
+                return false;
+            }
+            return fold_binary(process, node, &numbers[0], &numbers[1]);
+        case NODE_TYPE_CAST:
+        {
+            //转换成指针、void、struct、union的不是算术常量
+            struct node_datatype datatype=node->datatype;
+            if(total!=1||datatype.pointer_depth||!fold_type_size(datatype.type)||!fold_operands(process, children, 1, numbers)){
+                return false;
+            }
+            if(!fold_convert(&numbers[0], datatype.type, datatype.flags&DATA_TYPE_FLAG_UNSIGNED)){
+                return false;
+            }
+            fold_result(node, &numbers[0]);
+            return true;
+        }
+        case NODE_TYPE_TENARY:
+        {
+            if(!fold_operands(process, children, 3, numbers)){
+                return false;
+            }
+            //结果是两个分支的公共类型，没有选中的分支也参与决定类型
+            int type;
+            bool is_unsigned;
+            fold_common_type(&numbers[1], &numbers[2], &type, &is_unsigned);
+            struct node* chosen=fold_is_true(&numbers[0])?&numbers[1]:&numbers[2];
+            if(!fold_convert(chosen, type, is_unsigned)){
+                return false;
+            }
+            fold_result(node, chosen);
+            return true;
+        }
+    }
+    return false;
+}
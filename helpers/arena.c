@@ -0,0 +1,148 @@
+#include "arena.h"
+#include "counters.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define ARENA_ALIGNMENT (sizeof(void*) > sizeof(long double) ? sizeof(void*) : sizeof(long double))
+
+static struct arena_chunk* arena_chunk_create(struct arena* arena, size_t size)
+{
+    if (size == arena->chunk_size && arena->free_chunks)
+    {
+        struct arena_chunk* chunk = arena->free_chunks;
+        arena->free_chunks = chunk->next;
+        chunk->next = NULL;
+        chunk->used = 0;
+        return chunk;
+    }
+
+    struct arena_chunk* chunk = malloc(sizeof(struct arena_chunk) + size);
+    assert(chunk);
+    helper_counters.bytes_allocated += sizeof(struct arena_chunk) + size;
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    arena->reserved += size;
+    arena->chunks++;
+    return chunk;
+}
+
+struct arena* arena_create(size_t chunk_size)
+{
+    struct arena* arena = calloc(sizeof(struct arena), 1);
+    arena->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK_SIZE;
+    arena->head = arena_chunk_create(arena, arena->chunk_size);
+    return arena;
+}
+
+static void* arena_alloc_with_padding(struct arena* arena, size_t size, size_t align)
+{
+    struct arena_chunk* chunk = arena->head;
+    size_t padding = (align - (chunk->used % align)) % align;
+    if (chunk->used + padding + size <= chunk->size)
+    {
+        void* ptr = chunk->data + chunk->used + padding;
+        chunk->used += padding + size;
+        arena->used += size;
+        arena->wasted += padding;
+        return ptr;
+    }
+
+    // Big allocations get a chunk of their own placed behind the head
+    // so we don't throw away the room left in the current chunk
+    if (size > arena->chunk_size / 4)
+    {
+        struct arena_chunk* big = arena_chunk_create(arena, size);
+        big->used = size;
+        big->next = chunk->next;
+        chunk->next = big;
+        arena->used += size;
+        return big->data;
+    }
+
+    // The tail of the current chunk is too small, it is lost from now on
+    arena->wasted += chunk->size - chunk->used;
+    struct arena_chunk* new_chunk = arena_chunk_create(arena, arena->chunk_size);
+    new_chunk->next = chunk;
+    arena->head = new_chunk;
+    new_chunk->used = size;
+    arena->used += size;
+    return new_chunk->data;
+}
+
+void* arena_alloc(struct arena* arena, size_t size)
+{
+    return arena_alloc_with_padding(arena, size, ARENA_ALIGNMENT);
+}
+
+void* arena_alloc_unaligned(struct arena* arena, size_t size)
+{
+    return arena_alloc_with_padding(arena, size, 1);
+}
+
+char* arena_strndup(struct arena* arena, const char* str, size_t len)
+{
+    char* ptr = arena_alloc_unaligned(arena, len + 1);
+    memcpy(ptr, str, len);
+    ptr[len] = 0x00;
+    return ptr;
+}
+
+size_t arena_bytes_used(struct arena* arena)
+{
+    return arena->used;
+}
+
+size_t arena_bytes_wasted(struct arena* arena)
+{
+    return arena->wasted;
+}
+
+size_t arena_bytes_reserved(struct arena* arena)
+{
+    return arena->reserved;
+}
+
+void arena_reset(struct arena* arena)
+{
+    struct arena_chunk* chunk = arena->head->next;
+    arena->head->next = NULL;
+    arena->head->used = 0;
+    while (chunk)
+    {
+        struct arena_chunk* next = chunk->next;
+        // Chunks made for big allocations are sized for that one allocation, don't keep them
+        if (chunk->size != arena->chunk_size)
+        {
+            arena->reserved -= chunk->size;
+            arena->chunks--;
+            free(chunk);
+        }
+        else
+        {
+            chunk->next = arena->free_chunks;
+            arena->free_chunks = chunk;
+        }
+        chunk = next;
+    }
+    arena->used = 0;
+    arena->wasted = 0;
+}
+
+static void arena_chunks_free(struct arena_chunk* chunk)
+{
+    while (chunk)
+    {
+        struct arena_chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+}
+
+void arena_free(struct arena* arena)
+{
+    arena_chunks_free(arena->head);
+    arena_chunks_free(arena->free_chunks);
+    free(arena);
+}
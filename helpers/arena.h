@@ -0,0 +1,71 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Default size of each chunk the arena grabs from malloc
+#define ARENA_CHUNK_SIZE 65536
+
+struct arena_chunk
+{
+    struct arena_chunk* next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+struct arena
+{
+    // The chunk we are currently bumping into, older chunks follow via next
+    struct arena_chunk* head;
+    size_t chunk_size;
+
+    // Chunks kept by arena_reset, reused before asking malloc for more
+    struct arena_chunk* free_chunks;
+
+    // Bytes handed out to callers
+    size_t used;
+    // Bytes lost to alignment padding and to chunk tails we gave up on
+    size_t wasted;
+    // Bytes requested from malloc for all chunks
+    size_t reserved;
+    int chunks;
+};
+
+/**
+ * Creates an arena that allocates chunk_size bytes at a time, pass zero for ARENA_CHUNK_SIZE
+ */
+struct arena* arena_create(size_t chunk_size);
+
+/**
+ * Allocates size bytes aligned for any scalar type. The memory lives until arena_free
+ */
+void* arena_alloc(struct arena* arena, size_t size);
+
+/**
+ * Allocates size bytes with no alignment, useful for packing strings tightly
+ */
+void* arena_alloc_unaligned(struct arena* arena, size_t size);
+
+/**
+ * Copies len bytes of str into the arena and null terminates the copy
+ */
+char* arena_strndup(struct arena* arena, const char* str, size_t len);
+
+size_t arena_bytes_used(struct arena* arena);
+size_t arena_bytes_wasted(struct arena* arena);
+size_t arena_bytes_reserved(struct arena* arena);
+
+/**
+ * Forgets every allocation made from the arena but keeps its chunks for reuse,
+ * so an arena that is reset between jobs stops calling malloc once it has warmed up
+ */
+void arena_reset(struct arena* arena);
+
+/**
+ * Frees every allocation made from the arena at once, including the arena its self
+ */
+void arena_free(struct arena* arena);
+
+#endif // ARENA_H
@@ -1,4 +1,5 @@
 #include "buffer.h"
+#include "counters.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
@@ -7,6 +8,8 @@ struct buffer* buffer_create()
 {
     struct buffer* buf = calloc(sizeof(struct buffer), 1);
     buf->data = calloc(BUFFER_REALLOC_AMOUNT, 1);
+    helper_counters.buffer_creates++;
+    helper_counters.bytes_allocated += sizeof(struct buffer) + BUFFER_REALLOC_AMOUNT;
     buf->len = 0;
     buf->msize = BUFFER_REALLOC_AMOUNT;
     return buf;
@@ -15,12 +18,13 @@ struct buffer* buffer_create()
 void buffer_extend(struct buffer* buffer, size_t size)
 {
     buffer->data = realloc(buffer->data, buffer->msize+size);
+    helper_counters.bytes_allocated += buffer->msize+size;
     buffer->msize+=size;
 }
 
 void buffer_need(struct buffer* buffer, size_t size)
 {
-    if (buffer->msize <= (buffer->len+size))
+    if ((size_t)buffer->msize <= buffer->len+size)
     {
         size += BUFFER_REALLOC_AMOUNT;
         buffer_extend(buffer, size);
@@ -0,0 +1,17 @@
+#include "counters.h"
+
+_Thread_local struct helper_counters helper_counters;
+
+struct helper_counters helper_counters_snapshot()
+{
+    return helper_counters;
+}
+
+struct helper_counters helper_counters_since(struct helper_counters start)
+{
+    struct helper_counters now = helper_counters;
+    now.buffer_creates -= start.buffer_creates;
+    now.vector_resizes -= start.vector_resizes;
+    now.bytes_allocated -= start.bytes_allocated;
+    return now;
+}
@@ -0,0 +1,31 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stddef.h>
+
+// Counts of the allocations made by the helpers. Every thread has its own copy,
+// so a compile running on one thread can take the difference between two snapshots
+// without seeing the work of other threads
+struct helper_counters
+{
+    // Calls to buffer_create
+    size_t buffer_creates;
+    // Times a vector had to realloc its storage to grow or shrink
+    size_t vector_resizes;
+    // Bytes asked from malloc, calloc and realloc by the helpers
+    size_t bytes_allocated;
+};
+
+extern _Thread_local struct helper_counters helper_counters;
+
+/**
+ * Returns the counters of the calling thread
+ */
+struct helper_counters helper_counters_snapshot();
+
+/**
+ * Returns what was counted between the two snapshots
+ */
+struct helper_counters helper_counters_since(struct helper_counters start);
+
+#endif // COUNTERS_H
@@ -0,0 +1,112 @@
+#include "intern.h"
+#include "arena.h"
+#include "counters.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static uint32_t intern_hash(const char* str, size_t len)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+struct intern_table* intern_table_create(struct arena* arena)
+{
+    struct intern_table* table = calloc(sizeof(struct intern_table), 1);
+    table->capacity = INTERN_TABLE_INITIAL_CAPACITY;
+    table->entries = calloc(sizeof(struct intern_entry), table->capacity);
+    helper_counters.bytes_allocated += sizeof(struct intern_table) + sizeof(struct intern_entry) * table->capacity;
+    table->arena = arena;
+    return table;
+}
+
+static struct intern_entry* intern_find_slot(struct intern_entry* entries, size_t capacity, const char* str, size_t len, uint32_t hash)
+{
+    size_t mask = capacity - 1;
+    size_t index = hash & mask;
+    while (entries[index].str)
+    {
+        struct intern_entry* entry = &entries[index];
+        if (entry->hash == hash && entry->len == len && memcmp(entry->str, str, len) == 0)
+        {
+            return entry;
+        }
+        index = (index + 1) & mask;
+    }
+    return &entries[index];
+}
+
+static void intern_grow(struct intern_table* table)
+{
+    size_t new_capacity = table->capacity * 2;
+    struct intern_entry* new_entries = calloc(sizeof(struct intern_entry), new_capacity);
+    assert(new_entries);
+    helper_counters.bytes_allocated += sizeof(struct intern_entry) * new_capacity;
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        struct intern_entry* entry = &table->entries[i];
+        if (!entry->str)
+        {
+            continue;
+        }
+        *intern_find_slot(new_entries, new_capacity, entry->str, entry->len, entry->hash) = *entry;
+    }
+    free(table->entries);
+    table->entries = new_entries;
+    table->capacity = new_capacity;
+}
+
+const char* intern(struct intern_table* table, const char* str, size_t len)
+{
+    uint32_t hash = intern_hash(str, len);
+    struct intern_entry* entry = intern_find_slot(table->entries, table->capacity, str, len, hash);
+    if (entry->str)
+    {
+        table->hits++;
+        return entry->str;
+    }
+
+    entry->str = arena_strndup(table->arena, str, len);
+    entry->len = len;
+    entry->hash = hash;
+    table->count++;
+
+    // Keep the load factor under 3/4 so probe sequences stay short
+    const char* res = entry->str;
+    if (table->count * 4 >= table->capacity * 3)
+    {
+        intern_grow(table);
+    }
+    return res;
+}
+
+const char* intern_cstr(struct intern_table* table, const char* str)
+{
+    return intern(table, str, strlen(str));
+}
+
+const char* intern_lookup(struct intern_table* table, const char* str, size_t len)
+{
+    struct intern_entry* entry = intern_find_slot(table->entries, table->capacity, str, len, intern_hash(str, len));
+    return entry->str;
+}
+
+void intern_table_clear(struct intern_table* table)
+{
+    memset(table->entries, 0, sizeof(struct intern_entry) * table->capacity);
+    table->count = 0;
+    table->hits = 0;
+}
+
+void intern_table_free(struct intern_table* table)
+{
+    free(table->entries);
+    free(table);
+}
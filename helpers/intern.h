@@ -0,0 +1,56 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct arena;
+
+// Initial number of slots in the table, must be a power of two
+#define INTERN_TABLE_INITIAL_CAPACITY 1024
+
+struct intern_entry
+{
+    const char* str;
+    size_t len;
+    uint32_t hash;
+};
+
+struct intern_table
+{
+    // Open addressing with linear probing, str is NULL for an empty slot
+    struct intern_entry* entries;
+    size_t capacity;
+    size_t count;
+
+    // Interned strings are copied into this arena, the table does not own it
+    struct arena* arena;
+
+    // Number of intern calls that found an existing string
+    size_t hits;
+};
+
+struct intern_table* intern_table_create(struct arena* arena);
+
+/**
+ * Returns the canonical copy of the len bytes at str, copying them into the arena
+ * the first time they are seen. Two calls with equal bytes return the same pointer
+ * so interned strings can be compared with ==
+ */
+const char* intern(struct intern_table* table, const char* str, size_t len);
+const char* intern_cstr(struct intern_table* table, const char* str);
+
+/**
+ * Returns the canonical copy of str or NULL if it was never interned
+ */
+const char* intern_lookup(struct intern_table* table, const char* str, size_t len);
+
+/**
+ * Empties the table but keeps its slots. The interned text lives in the arena,
+ * so call this whenever that arena is reset
+ */
+void intern_table_clear(struct intern_table* table);
+
+void intern_table_free(struct intern_table* table);
+
+#endif // INTERN_H
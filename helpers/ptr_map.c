@@ -0,0 +1,88 @@
+#include "ptr_map.h"
+#include "counters.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static size_t ptr_map_hash(const void* key)
+{
+    // The low bits of an address are mostly alignment, multiply to spread the rest
+    return ((uintptr_t)key >> 3) * 0x9e3779b97f4a7c15ULL;
+}
+
+struct ptr_map* ptr_map_create()
+{
+    struct ptr_map* map = calloc(sizeof(struct ptr_map), 1);
+    map->capacity = PTR_MAP_INITIAL_CAPACITY;
+    map->entries = calloc(sizeof(struct ptr_map_entry), map->capacity);
+    helper_counters.bytes_allocated += sizeof(struct ptr_map) + sizeof(struct ptr_map_entry) * map->capacity;
+    return map;
+}
+
+static struct ptr_map_entry* ptr_map_find_slot(struct ptr_map_entry* entries, size_t capacity, const void* key)
+{
+    size_t mask = capacity - 1;
+    size_t index = ptr_map_hash(key) & mask;
+    while (entries[index].key && entries[index].key != key)
+    {
+        index = (index + 1) & mask;
+    }
+    return &entries[index];
+}
+
+static void ptr_map_grow(struct ptr_map* map)
+{
+    size_t new_capacity = map->capacity * 2;
+    struct ptr_map_entry* new_entries = calloc(sizeof(struct ptr_map_entry), new_capacity);
+    assert(new_entries);
+    helper_counters.bytes_allocated += sizeof(struct ptr_map_entry) * new_capacity;
+    for (size_t i = 0; i < map->capacity; i++)
+    {
+        struct ptr_map_entry* entry = &map->entries[i];
+        if (!entry->key)
+        {
+            continue;
+        }
+        *ptr_map_find_slot(new_entries, new_capacity, entry->key) = *entry;
+    }
+    free(map->entries);
+    map->entries = new_entries;
+    map->capacity = new_capacity;
+}
+
+void* ptr_map_get(struct ptr_map* map, const void* key)
+{
+    return ptr_map_find_slot(map->entries, map->capacity, key)->value;
+}
+
+void ptr_map_set(struct ptr_map* map, const void* key, void* value)
+{
+    assert(key);
+    struct ptr_map_entry* entry = ptr_map_find_slot(map->entries, map->capacity, key);
+    if (entry->key)
+    {
+        entry->value = value;
+        return;
+    }
+
+    entry->key = key;
+    entry->value = value;
+    map->count++;
+    // Same 3/4 load factor as the intern table
+    if (map->count * 4 >= map->capacity * 3)
+    {
+        ptr_map_grow(map);
+    }
+}
+
+void ptr_map_clear(struct ptr_map* map)
+{
+    memset(map->entries, 0, sizeof(struct ptr_map_entry) * map->capacity);
+    map->count = 0;
+}
+
+void ptr_map_free(struct ptr_map* map)
+{
+    free(map->entries);
+    free(map);
+}
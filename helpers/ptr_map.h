@@ -0,0 +1,46 @@
+#ifndef PTR_MAP_H
+#define PTR_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Initial number of slots in the map, must be a power of two
+#define PTR_MAP_INITIAL_CAPACITY 64
+
+struct ptr_map_entry
+{
+    const void* key;
+    void* value;
+};
+
+// Maps pointers to pointers, keys are compared by address only.
+// Interned strings make good keys since equal text has the same address
+struct ptr_map
+{
+    // Open addressing with linear probing, key is NULL for an empty slot
+    struct ptr_map_entry* entries;
+    size_t capacity;
+    size_t count;
+};
+
+struct ptr_map* ptr_map_create();
+
+/**
+ * Returns the value stored for key or NULL if there is none
+ */
+void* ptr_map_get(struct ptr_map* map, const void* key);
+
+/**
+ * Stores value for key, replacing the previous value. Setting a value to NULL
+ * is how a key is removed, the slot stays taken until the map is cleared
+ */
+void ptr_map_set(struct ptr_map* map, const void* key, void* value);
+
+/**
+ * Empties the map but keeps its slots
+ */
+void ptr_map_clear(struct ptr_map* map);
+
+void ptr_map_free(struct ptr_map* map);
+
+#endif // PTR_MAP_H
@@ -0,0 +1,315 @@
+#include "scan.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_HAVE_X86
+#include <immintrin.h>
+#endif
+
+struct scan_kernels
+{
+    const char* name;
+    size_t (*whitespace)(const char* str, size_t len);
+    size_t (*identifier)(const char* str, size_t len);
+    size_t (*line_end)(const char* str, size_t len);
+    size_t (*comment_end)(const char* str, size_t len);
+};
+
+static bool scan_is_whitespace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static bool scan_is_identifier(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// The scalar versions also finish the tails the vector versions leave behind
+
+static size_t scan_whitespace_scalar(const char* str, size_t len)
+{
+    size_t i = 0;
+    while (i < len && scan_is_whitespace(str[i]))
+    {
+        i++;
+    }
+    return i;
+}
+
+static size_t scan_identifier_scalar(const char* str, size_t len)
+{
+    size_t i = 0;
+    while (i < len && scan_is_identifier(str[i]))
+    {
+        i++;
+    }
+    return i;
+}
+
+static size_t scan_line_end_scalar(const char* str, size_t len)
+{
+    size_t i = 0;
+    while (i < len && str[i] != '\n' && str[i] != '\r')
+    {
+        i++;
+    }
+    return i;
+}
+
+static size_t scan_comment_end_scalar(const char* str, size_t len)
+{
+    // memchr is already vectorized by libc, it just can't look for two bytes at once
+    const char* ptr = str;
+    const char* end = str + len;
+    while ((ptr = memchr(ptr, '*', end - ptr)))
+    {
+        if (ptr + 1 < end && ptr[1] == '/')
+        {
+            return ptr - str;
+        }
+        ptr++;
+    }
+    return len;
+}
+
+static const struct scan_kernels scan_kernels_scalar = {
+    .name = "scalar",
+    .whitespace = scan_whitespace_scalar,
+    .identifier = scan_identifier_scalar,
+    .line_end = scan_line_end_scalar,
+    .comment_end = scan_comment_end_scalar
+};
+
+#ifdef SCAN_HAVE_X86
+
+// Every kernel builds a bit mask of the bytes that stop the scan, the first set bit
+// is the answer. Bytes >= 0x80 compare as negative so they never fall in an ASCII range
+
+__attribute__((target("sse2")))
+static inline __m128i scan_identifier_mask_sse2(__m128i v)
+{
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(letter, digit), underscore);
+}
+
+__attribute__((target("sse2")))
+static size_t scan_whitespace_sse2(const char* str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+        __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+        unsigned int stop = ~_mm_movemask_epi8(blank) & 0xFFFF;
+        if (stop)
+        {
+            return i + __builtin_ctz(stop);
+        }
+    }
+    return i + scan_whitespace_scalar(str + i, len - i);
+}
+
+__attribute__((target("sse2")))
+static size_t scan_identifier_sse2(const char* str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+        unsigned int stop = ~_mm_movemask_epi8(scan_identifier_mask_sse2(v)) & 0xFFFF;
+        if (stop)
+        {
+            return i + __builtin_ctz(stop);
+        }
+    }
+    return i + scan_identifier_scalar(str + i, len - i);
+}
+
+__attribute__((target("sse2")))
+static size_t scan_line_end_sse2(const char* str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+        __m128i end = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+        unsigned int stop = _mm_movemask_epi8(end);
+        if (stop)
+        {
+            return i + __builtin_ctz(stop);
+        }
+    }
+    return i + scan_line_end_scalar(str + i, len - i);
+}
+
+__attribute__((target("sse2")))
+static size_t scan_comment_end_sse2(const char* str, size_t len)
+{
+    size_t i = 0;
+    // The second load reads one byte ahead, so stop one byte early
+    for (; i + 17 <= len; i += 16)
+    {
+        __m128i star = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(str + i)), _mm_set1_epi8('*'));
+        __m128i slash = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(str + i + 1)), _mm_set1_epi8('/'));
+        unsigned int stop = _mm_movemask_epi8(_mm_and_si128(star, slash));
+        if (stop)
+        {
+            return i + __builtin_ctz(stop);
+        }
+    }
+    return i + scan_comment_end_scalar(str + i, len - i);
+}
+
+static const struct scan_kernels scan_kernels_sse2 = {
+    .name = "sse2",
+    .whitespace = scan_whitespace_sse2,
+    .identifier = scan_identifier_sse2,
+    .line_end = scan_line_end_sse2,
+    .comment_end = scan_comment_end_sse2
+};
+
+__attribute__((target("avx2")))
+static size_t scan_whitespace_avx2(const char* str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(str + i));
+        __m256i blank = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+        unsigned int stop = ~(unsigned int)_mm256_movemask_epi8(blank);
+        if (stop)
+        {
+            return i + __builtin_ctz(stop);
+        }
+    }
+    return i + scan_whitespace_sse2(str + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_identifier_avx2(const char* str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(str + i));
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+        __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+        __m256i ident = _mm256_or_si256(_mm256_or_si256(letter, digit), underscore);
+        unsigned int stop = ~(unsigned int)_mm256_movemask_epi8(ident);
+        if (stop)
+        {
+            return i + __builtin_ctz(stop);
+        }
+    }
+    return i + scan_identifier_sse2(str + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_line_end_avx2(const char* str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(str + i));
+        __m256i end = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+        unsigned int stop = _mm256_movemask_epi8(end);
+        if (stop)
+        {
+            return i + __builtin_ctz(stop);
+        }
+    }
+    return i + scan_line_end_sse2(str + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_comment_end_avx2(const char* str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 33 <= len; i += 32)
+    {
+        __m256i star = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(str + i)), _mm256_set1_epi8('*'));
+        __m256i slash = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(str + i + 1)), _mm256_set1_epi8('/'));
+        unsigned int stop = _mm256_movemask_epi8(_mm256_and_si256(star, slash));
+        if (stop)
+        {
+            return i + __builtin_ctz(stop);
+        }
+    }
+    return i + scan_comment_end_sse2(str + i, len - i);
+}
+
+static const struct scan_kernels scan_kernels_avx2 = {
+    .name = "avx2",
+    .whitespace = scan_whitespace_avx2,
+    .identifier = scan_identifier_avx2,
+    .line_end = scan_line_end_avx2,
+    .comment_end = scan_comment_end_avx2
+};
+
+#endif // SCAN_HAVE_X86
+
+static const struct scan_kernels* scan_kernels = &scan_kernels_scalar;
+
+bool scan_select(const char* name)
+{
+    if (strcmp(name, "scalar") == 0)
+    {
+        scan_kernels = &scan_kernels_scalar;
+        return true;
+    }
+#ifdef SCAN_HAVE_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2"))
+    {
+        scan_kernels = &scan_kernels_sse2;
+        return true;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+    {
+        scan_kernels = &scan_kernels_avx2;
+        return true;
+    }
+#endif
+    return false;
+}
+
+// Runs before main so the kernels are chosen before any compile thread starts
+__attribute__((constructor))
+static void scan_select_best()
+{
+    if (!scan_select("avx2") && !scan_select("sse2"))
+    {
+        scan_select("scalar");
+    }
+}
+
+const char* scan_kernel_name()
+{
+    return scan_kernels->name;
+}
+
+size_t scan_whitespace(const char* str, size_t len)
+{
+    return scan_kernels->whitespace(str, len);
+}
+
+size_t scan_identifier(const char* str, size_t len)
+{
+    return scan_kernels->identifier(str, len);
+}
+
+size_t scan_line_end(const char* str, size_t len)
+{
+    return scan_kernels->line_end(str, len);
+}
+
+size_t scan_comment_end(const char* str, size_t len)
+{
+    return scan_kernels->comment_end(str, len);
+}
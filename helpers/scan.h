@@ -0,0 +1,42 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Bulk scanners over bytes that are already in memory. Each one looks at up to len
+// bytes starting at str. The best kernel the CPU supports (AVX2, SSE2 or plain C)
+// is picked once when the program starts
+
+/**
+ * Returns how many of the leading bytes are spaces or tabs
+ */
+size_t scan_whitespace(const char* str, size_t len);
+
+/**
+ * Returns how many of the leading bytes are letters, digits or underscores
+ */
+size_t scan_identifier(const char* str, size_t len);
+
+/**
+ * Returns the index of the first '\n' or '\r', or len when there is none
+ */
+size_t scan_line_end(const char* str, size_t len);
+
+/**
+ * Returns the index of the '*' of the first "*" "/" pair, or len when there is none
+ */
+size_t scan_comment_end(const char* str, size_t len);
+
+/**
+ * Name of the kernel set in use: "avx2", "sse2" or "scalar"
+ */
+const char* scan_kernel_name();
+
+/**
+ * Switches to the named kernel set, returns false if the CPU does not support it.
+ * Meant for benchmarks and for checking the kernels against each other
+ */
+bool scan_select(const char* name);
+
+#endif // SCAN_H
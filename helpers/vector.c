@@ -1,4 +1,5 @@
 #include "vector.h"
+#include "counters.h"
 #include <memory.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -24,6 +25,7 @@ struct vector *vector_create_no_saves(size_t esize)
 {
     struct vector *vector = calloc(sizeof(struct vector), 1);
     vector->data = malloc(esize * VECTOR_ELEMENT_INCREMENT);
+    helper_counters.bytes_allocated += sizeof(struct vector) + esize * VECTOR_ELEMENT_INCREMENT;
     vector->mindex = VECTOR_ELEMENT_INCREMENT;
     vector->rindex = 0;
     vector->pindex = 0;
@@ -44,14 +46,15 @@ size_t vector_element_size(struct vector *vector)
 
 struct vector *vector_clone(struct vector *vector)
 {
-    void *new_data_address = calloc(vector->esize, vector->count + VECTOR_ELEMENT_INCREMENT);
+    void *new_data_address = calloc(vector->esize, vector->mindex + VECTOR_ELEMENT_INCREMENT);
     memcpy(new_data_address, vector->data, vector_total_size(vector));
     struct vector *new_vec = calloc(sizeof(struct vector), 1);
     memcpy(new_vec, vector, sizeof(struct vector));
     new_vec->data = new_data_address;
 
-    // Saves are not cloned with vector_clone yet.
-    // assert(vector->saves == NULL);
+    // Saves are not cloned with vector_clone yet, the clone starts with none
+    // so freeing both vectors does not free the same saves twice
+    new_vec->saves = vector->saves ? vector_create_no_saves(sizeof(struct vector)) : NULL;
     return new_vec;
 }
 
@@ -64,6 +67,10 @@ struct vector *vector_create(size_t esize)
 
 void vector_free(struct vector *vector)
 {
+    if (vector->saves)
+    {
+        vector_free(vector->saves);
+    }
     free(vector->data);
     free(vector);
 }
@@ -81,9 +88,49 @@ void vector_resize_for_index(struct vector *vector, int start_index, int total_e
         return;
     }
 
-    vector->data = realloc(vector->data, ((start_index + total_elements + VECTOR_ELEMENT_INCREMENT) * vector->esize));
+    // Grow geometrically so pushing n elements only copies O(n) elements in total
+    int new_mindex = vector->mindex * VECTOR_GROWTH_FACTOR;
+    if (new_mindex < start_index + total_elements)
+    {
+        new_mindex = start_index + total_elements;
+    }
+
+    vector->data = realloc(vector->data, ((new_mindex + VECTOR_ELEMENT_INCREMENT) * vector->esize));
+    helper_counters.vector_resizes++;
+    helper_counters.bytes_allocated += ((new_mindex + VECTOR_ELEMENT_INCREMENT) * vector->esize);
+    assert(vector->data);
+    vector->mindex = new_mindex;
+}
+
+void vector_reserve(struct vector *vector, int total_elements)
+{
+    // mindex must stay above the last index we will push too, otherwise the
+    // final push would trigger a resize
+    if (total_elements < vector->mindex)
+    {
+        return;
+    }
+
+    vector->data = realloc(vector->data, ((total_elements + 1 + VECTOR_ELEMENT_INCREMENT) * vector->esize));
+    helper_counters.vector_resizes++;
+    helper_counters.bytes_allocated += ((total_elements + 1 + VECTOR_ELEMENT_INCREMENT) * vector->esize);
+    assert(vector->data);
+    vector->mindex = total_elements + 1;
+}
+
+void vector_shrink_to_fit(struct vector *vector)
+{
+    int new_mindex = vector->rindex + 1;
+    if (new_mindex >= vector->mindex)
+    {
+        return;
+    }
+
+    vector->data = realloc(vector->data, ((new_mindex + VECTOR_ELEMENT_INCREMENT) * vector->esize));
+    helper_counters.vector_resizes++;
+    helper_counters.bytes_allocated += ((new_mindex + VECTOR_ELEMENT_INCREMENT) * vector->esize);
     assert(vector->data);
-    vector->mindex = start_index + total_elements;
+    vector->mindex = new_mindex;
 }
 
 void vector_resize_for(struct vector *vector, int total_elements)
@@ -248,14 +295,18 @@ void vector_push(struct vector *vector, void *elem)
 
 int vector_fread(struct vector *vector, int amount, FILE *fp)
 {
-    size_t read_amount = fread(vector->data, 1, 1, fp);
-    while (read_amount)
+    assert(amount >= 0);
+    // Make room for all amount elements up front and read straight into the tail
+    vector_resize_for(vector, amount);
+    int read_amount = (int)fread(vector_at(vector, vector->rindex), vector->esize, amount, fp);
+    vector->rindex += read_amount;
+    vector->count += read_amount;
+
+    if (vector->rindex >= vector->mindex)
     {
-        vector_push(vector, &read_amount);
-        read_amount = fread(vector->data, 1, 1, fp);
+        vector_resize(vector);
     }
-
-    return 0;
+    return read_amount;
 }
 
 const char *vector_string(struct vector *vec)
@@ -283,7 +334,8 @@ void vector_shift_right_in_bounds_no_increment(struct vector *vector, int index,
     vector_resize_for_index(vector, index, amount);
     int eindex = (index + amount);
     size_t bytes_to_move = vector_elements_until_end(vector, index) * vector->esize;
-    memcpy(vector_at(vector, eindex), vector_at(vector, index), bytes_to_move);
+    // The source and destination overlap whenever amount is smaller than the tail
+    memmove(vector_at(vector, eindex), vector_at(vector, index), bytes_to_move);
     memset(vector_at(vector, index), 0x00, amount * vector->esize);
 }
 
@@ -356,6 +408,43 @@ void vector_pop_at(struct vector *vector, int index)
     vector->rindex -= 1;
 }
 
+void vector_pop_multiple_at(struct vector *vector, int index, int total)
+{
+    assert(index >= 0 && total >= 0 && index + total <= vector->rindex);
+    void *dst_pos = vector_at(vector, index);
+    void *next_element_pos = vector_at(vector, index + total);
+    size_t bytes = (size_t)vector_data_end(vector) - (size_t)next_element_pos;
+    memmove(dst_pos, next_element_pos, bytes);
+    vector->count -= total;
+    vector->rindex -= total;
+}
+
+void vector_splice(struct vector *vector, int index, int removed, void *elements, int total)
+{
+    assert(index >= 0 && removed >= 0 && total >= 0 && index + removed <= vector->rindex);
+    int new_count = vector->rindex - removed + total;
+    if (total > removed)
+    {
+        // Grows geometrically like a push would
+        vector_resize_for_index(vector, vector->rindex, total - removed);
+    }
+    size_t tail_bytes = (size_t)(vector->rindex - index - removed) * vector->esize;
+    memmove(vector_at(vector, index + total), vector_at(vector, index + removed), tail_bytes);
+    memcpy(vector_at(vector, index), elements, (size_t)total * vector->esize);
+    vector->count = new_count;
+    vector->rindex = new_count;
+}
+
+void* vector_extend(struct vector *vector, int total)
+{
+    assert(total >= 0);
+    int index = vector->rindex;
+    vector_resize_for_index(vector, index, total);
+    vector->count += total;
+    vector->rindex += total;
+    return vector_at(vector, index);
+}
+
 void vector_peek_pop(struct vector *vector)
 {
     // Popping at a peek is an akward one
@@ -415,10 +504,9 @@ bool vector_empty(struct vector *vector)
 
 void vector_clear(struct vector *vector)
 {
-    while (vector_count(vector))
-    {
-        vector_pop(vector);
-    }
+    // Same as popping every element, the memory is kept for the next pushes
+    vector->rindex = 0;
+    vector->count = 0;
 }
 
 void *vector_back_or_null(struct vector *vector)
@@ -11,6 +11,9 @@
 // to reallocate memory again
 #define VECTOR_ELEMENT_INCREMENT 20
 
+// When we run out of room the capacity is multiplied by this amount
+#define VECTOR_GROWTH_FACTOR 2
+
 enum
 {
     VECTOR_FLAG_PEEK_DECREMENT = 0b00000001
@@ -85,7 +88,8 @@ void vector_clear(struct vector* vector);
 
 int vector_count(struct vector* vector);
 /**
- * freads from the file directly into the vector
+ * freads up to amount elements from the file directly onto the end of the vector,
+ * returns how many elements were read
  */
 int vector_fread(struct vector* vector, int amount, FILE* fp);
 /**
@@ -110,6 +114,23 @@ int vector_pop_value(struct vector* vector, void* val);
 
 void vector_pop_at(struct vector *vector, int index);
 
+/**
+ * Pops total elements starting at index, shifting the elements after them to the left
+ */
+void vector_pop_multiple_at(struct vector *vector, int index, int total);
+
+/**
+ * Replaces the removed elements starting at index with the total elements at elements.
+ * The elements after the replaced ones are moved once, whichever way the vector changes size
+ */
+void vector_splice(struct vector *vector, int index, int removed, void *elements, int total);
+
+/**
+ * Appends total elements without initialising them and returns the address of the first one.
+ * The address is only valid until the vector grows again
+ */
+void* vector_extend(struct vector *vector, int total);
+
 /**
  * Decrements the peek pointer so that the next peek
  * will point at the last peeked token
@@ -137,6 +158,17 @@ void vector_save_purge(struct vector* vector);
 
 
 
+/**
+ * Makes room for at least total_elements elements so that pushing up to that
+ * many elements will not reallocate
+ */
+void vector_reserve(struct vector* vector, int total_elements);
+
+/**
+ * Gives back the memory reserved beyond the elements currently in the vector
+ */
+void vector_shrink_to_fit(struct vector* vector);
+
 /**
  * Returns the element size per element in this vector
  */
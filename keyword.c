@@ -0,0 +1,76 @@
+#include "compiler.h"
+
+//关键字的完美哈希：用首字符、尾字符和长度算出槽位，每个关键字独占一个槽位
+//KEYWORD_HASH和keyword_slots是离线搜索出来的，新增关键字时需要重新生成，保证没有冲突
+#define KEYWORD_HASH(str, len) \
+    (((unsigned char)(str)[0]*14+(unsigned char)(str)[(len)-1]*5+(len)*5)&(KEYWORD_HASH_SLOTS-1))
+#define KEYWORD_HASH_SLOTS 64
+#define KEYWORD_MIN_LENGTH 2
+#define KEYWORD_MAX_LENGTH 18
+
+static const struct keyword_entry{
+    const char* name;
+    size_t len;
+} keyword_table[KEYWORD_TOTAL]={
+    [KEYWORD_UNSIGNED]={"unsigned", 8},
+    [KEYWORD_SIGNED]={"signed", 6},
+    [KEYWORD_CHAR]={"char", 4},
+    [KEYWORD_INT]={"int", 3},
+    [KEYWORD_SHORT]={"short", 5},
+    [KEYWORD_LONG]={"long", 4},
+    [KEYWORD_FLOAT]={"float", 5},
+    [KEYWORD_DOUBLE]={"double", 6},
+    [KEYWORD_VOID]={"void", 4},
+    [KEYWORD_STRUCT]={"struct", 6},
+    [KEYWORD_UNION]={"union", 5},
+    [KEYWORD_STATIC]={"static", 6},
+    [KEYWORD_IGNORE_TYPECHECK]={"__ignore_typecheck", 18},
+    [KEYWORD_RETURN]={"return", 6},
+    [KEYWORD_INCLUDE]={"include", 7},
+    [KEYWORD_SIZEOF]={"sizeof", 6},
+    [KEYWORD_IF]={"if", 2},
+    [KEYWORD_ELSE]={"else", 4},
+    [KEYWORD_WHILE]={"while", 5},
+    [KEYWORD_FOR]={"for", 3},
+    [KEYWORD_DO]={"do", 2},
+    [KEYWORD_BREAK]={"break", 5},
+    [KEYWORD_CONTINUE]={"continue", 8},
+    [KEYWORD_SWITCH]={"switch", 6},
+    [KEYWORD_CASE]={"case", 4},
+    [KEYWORD_DEFAULT]={"default", 7},
+    [KEYWORD_GOTO]={"goto", 4},
+    [KEYWORD_TYPEDEF]={"typedef", 7},
+    [KEYWORD_CONST]={"const", 5},
+    [KEYWORD_EXTERN]={"extern", 6},
+    [KEYWORD_RESTRICT]={"restrict", 8},
+};
+
+static const signed char keyword_slots[KEYWORD_HASH_SLOTS]={
+    KEYWORD_RETURN, KEYWORD_NONE, KEYWORD_UNSIGNED, KEYWORD_NONE, KEYWORD_NONE, KEYWORD_NONE, KEYWORD_IF, KEYWORD_CONST,
+    KEYWORD_NONE, KEYWORD_NONE, KEYWORD_EXTERN, KEYWORD_CONTINUE, KEYWORD_BREAK, KEYWORD_NONE, KEYWORD_NONE, KEYWORD_DOUBLE,
+    KEYWORD_NONE, KEYWORD_INT, KEYWORD_NONE, KEYWORD_ELSE, KEYWORD_WHILE, KEYWORD_NONE, KEYWORD_NONE, KEYWORD_STATIC,
+    KEYWORD_NONE, KEYWORD_NONE, KEYWORD_INCLUDE, KEYWORD_NONE, KEYWORD_SIGNED, KEYWORD_FOR, KEYWORD_NONE, KEYWORD_DEFAULT,
+    KEYWORD_NONE, KEYWORD_GOTO, KEYWORD_NONE, KEYWORD_IGNORE_TYPECHECK, KEYWORD_NONE, KEYWORD_UNION, KEYWORD_SIZEOF, KEYWORD_SHORT,
+    KEYWORD_RESTRICT, KEYWORD_NONE, KEYWORD_NONE, KEYWORD_NONE, KEYWORD_STRUCT, KEYWORD_DO, KEYWORD_NONE, KEYWORD_NONE,
+    KEYWORD_SWITCH, KEYWORD_FLOAT, KEYWORD_NONE, KEYWORD_NONE, KEYWORD_NONE, KEYWORD_NONE, KEYWORD_NONE, KEYWORD_CASE,
+    KEYWORD_CHAR, KEYWORD_TYPEDEF, KEYWORD_NONE, KEYWORD_NONE, KEYWORD_VOID, KEYWORD_NONE, KEYWORD_NONE, KEYWORD_LONG,
+};
+
+//先比长度再比哈希槽位，最后只需要一次memcmp确认
+int keyword_lookup(const char* str, size_t len){
+    if(len<KEYWORD_MIN_LENGTH||len>KEYWORD_MAX_LENGTH){
+        return KEYWORD_NONE;
+    }
+    int kw=keyword_slots[KEYWORD_HASH(str, len)];
+    if(kw==KEYWORD_NONE||keyword_table[kw].len!=len||memcmp(keyword_table[kw].name, str, len)!=0){
+        return KEYWORD_NONE;
+    }
+    return kw;
+}
+
+const char* keyword_name(int kw){
+    if(kw<0||kw>=KEYWORD_TOTAL){
+        return NULL;
+    }
+    return keyword_table[kw].name;
+}
@@ -1,20 +1,39 @@
 #include "compiler.h"
 #include "helpers/vector.h"
+#include "helpers/buffer.h"
 #include <stdlib.h>
 
 struct lex_process* lex_process_create(struct compile_process* compiler, struct lex_process_functions* functions, void* private){
     struct lex_process* process = calloc(1,sizeof(struct lex_process));
     process->functions=functions;
     process->token_vec=vector_create(sizeof(struct token));
+    process->scratch_buffer=buffer_create();
+    //读取的是编译文件本身时，按文件大小预估token数量，一次分配到位
+    if(functions==compiler->lex_functions&&compiler->cfile.size){
+        vector_reserve(process->token_vec, compiler->cfile.size/LEX_AVERAGE_BYTES_PER_TOKEN);
+    }
     process->compiler=compiler;
     process->private=private;
-    process->pos.line=1;
-    process->pos.col=1;
     return process;
 }
 
+//复用同一个词法分析器读取新的输入，token_vec和缓冲区的内存都保留下来
+void lex_process_reset(struct lex_process* process, struct lex_process_functions* functions, void* private){
+    vector_clear(process->token_vec);
+    process->scratch_buffer->len=0;
+    process->scratch_buffer->rindex=0;
+    process->offset=0;
+    process->token_offset=0;
+    process->current_expression_count=0;
+    process->brackets_start=0;
+    memset(&process->tmp_token, 0, sizeof(process->tmp_token));
+    process->functions=functions;
+    process->private=private;
+}
+
 void lex_process_free(struct lex_process* process){
     vector_free(process->token_vec);
+    buffer_free(process->scratch_buffer);
     free(process);
 }
 
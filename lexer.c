@@ -1,323 +1,677 @@
 #include "compiler.h"
 #include "helpers/vector.h"
 #include "helpers/buffer.h"
+#include "helpers/arena.h"
+#include "helpers/intern.h"
+#include "helpers/scan.h"
 #include <string.h>
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
 
 //通过exp条件判断是否继续读取字符到buffer的宏
-#define LEX_GETC_IF(buffer, c, exp)     \
-    for (c = peekc(); exp; c = peekc()) \
-    {                                   \
-        buffer_write(buffer, c);        \
-        nextc();                        \
+#define LEX_GETC_IF(lex_process, buffer, c, exp)            \
+    for (c = peekc(lex_process); exp; c = peekc(lex_process)) \
+    {                                                       \
+        buffer_write(buffer, c);                            \
+        nextc(lex_process);                                 \
     }
 
-struct token *read_next_token();
-bool lex_is_in_expression();
+//lex_digit_value遇到不是数字或字母的字符时返回的值
+#define LEX_NUMBER_NOT_DIGIT 99
+//十进制浮点数最多累加的有效数字位数，10^19以内放得下unsigned long long
+#define LEX_NUMBER_MAX_DIGITS 19
+//指数超过这个值时结果已经是0或者溢出
+#define LEX_NUMBER_MAX_EXPONENT 100000
+//交给strtod的浮点数文本不超过这个长度时拷贝在栈上
+#define LEX_NUMBER_LOCAL_TEXT 64
+#define LEX_DOUBLE_MAX_EXACT_MANTISSA (1ULL << 53)
+#define LEX_DOUBLE_MAX_EXACT_POWER 22
+#define LEX_FLOAT_MAX_EXACT_MANTISSA (1ULL << 24)
+#define LEX_FLOAT_MAX_EXACT_POWER 10
+
+//能用double精确表示的10的幂
+static const double lex_exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
 
-static struct lex_process *lex_process;
-static struct token tmp_token;
+struct token *read_next_token(struct lex_process* lex_process);
+bool lex_is_in_expression(struct lex_process* lex_process);
+char lex_get_escape_char(char c);
 
-static char peekc()
+static char peekc(struct lex_process* lex_process)
 {
     return lex_process->functions->peek_char(lex_process);
 }
 
-static char nextc()
+static char nextc(struct lex_process* lex_process)
 {
     char c = lex_process->functions->next_char(lex_process);
-    
-    if(lex_is_in_expression()){
-        buffer_write(lex_process->parentheses_buffer, c);
-    }
-    lex_process->pos.col += 1;
-    if (c == '\n')
+    //行列号不在这里维护，报错时再由偏移换算
+    if (c != EOF)
     {
-        lex_process->pos.line += 1;
-        lex_process->pos.col = 1;
+        lex_process->offset++;
     }
     return c;
 }
 
-static char pushc(char c)
+//源码已经在内存中时返回还没有读取的部分，可以整段扫描；否则返回NULL，只能一个个字符读取
+static const char* lex_span(struct lex_process* lex_process, size_t* len)
+{
+    if (!lex_process->functions->span)
+    {
+        return NULL;
+    }
+    return lex_process->functions->span(lex_process, len);
+}
+
+//跳过span中已经扫描过的n个字节，效果和调用n次nextc相同
+static void lex_skip(struct lex_process* lex_process, size_t n)
 {
-    lex_process->functions->push_char(lex_process, c);
+    if (lex_process->functions->skip)
+    {
+        lex_process->functions->skip(lex_process, n);
+    }
+    lex_process->offset += n;
 }
 
 //如果没有匹配到对应的下一个字符，发生assert
-static char assert_next_char(char c){
-    char next = nextc();
+static char assert_next_char(struct lex_process* lex_process, char c){
+    char next = nextc(lex_process);
     assert(next == c);
     return next;
 }
-static struct pos lex_file_position()
+static uint32_t lex_file_position(struct lex_process* lex_process)
+{
+    return lex_process->token_offset;
+}
+
+//取得词法分析器共用的临时缓冲区，每次使用前清空
+static struct buffer* lex_scratch_buffer(struct lex_process* lex_process)
+{
+    struct buffer* buffer=lex_process->scratch_buffer;
+    buffer->len=0;
+    buffer->rindex=0;
+    return buffer;
+}
+
+//临时缓冲区里的token文本不在源码中，拷贝到编译过程的text_pool
+static struct token_span lex_scratch_span(struct lex_process* lex_process, struct buffer* buffer)
 {
-    return lex_process->pos;
+    return compile_process_pool_text(lex_process->compiler, buffer_ptr(buffer), buffer->len);
 }
 
-struct token *token_create(struct token *_token)
+struct token *token_create(struct lex_process* lex_process, struct token *_token)
 {
-    memcpy(&tmp_token, _token, sizeof(struct token));
-    tmp_token.pos = lex_file_position();
-    if(lex_is_in_expression()){
-        tmp_token.between_brackets=buffer_ptr(lex_process->parentheses_buffer);
+    struct token* token=&lex_process->tmp_token;
+    memcpy(token, _token, sizeof(struct token));
+    token->offset = lex_file_position(lex_process);
+    if(lex_is_in_expression(lex_process)){
+        token->between_brackets=lex_process->brackets_start;
     }
-    return &tmp_token;
+    return token;
 }
 
-static struct token *lexer_last_token()
+static struct token *lexer_last_token(struct lex_process* lex_process)
 {
     return vector_back_or_null(lex_process->token_vec);
 }
 
-static struct token *handle_whitespace()
+//整段读掉空格和制表符，返回读掉的字符数
+static size_t lex_skip_blanks(struct lex_process* lex_process)
+{
+    size_t len;
+    const char* str = lex_span(lex_process, &len);
+    if (str)
+    {
+        size_t total = scan_whitespace(str, len);
+        lex_skip(lex_process, total);
+        return total;
+    }
+
+    size_t total = 0;
+    for (char c = peekc(lex_process); c == ' ' || c == '\t'; c = peekc(lex_process))
+    {
+        nextc(lex_process);
+        total++;
+    }
+    return total;
+}
+
+//token前面的空白记在上一个token的whitespace上
+static void handle_whitespace(struct lex_process* lex_process)
 {
-    struct token *last_token = lexer_last_token();
+    if (!lex_skip_blanks(lex_process))
+    {
+        return;
+    }
+    struct token *last_token = lexer_last_token(lex_process);
     if (last_token)
     {
         last_token->whitespace = true;
     }
-    nextc();
-    return read_next_token();
 }
 
-const char *read_number_str()
+//数字字面量按预处理数字的规则整段读出：数字、字母、下划线、小数点，以及e、E、p、P后面紧跟的正负号
+//后缀和数字是否合法在读出之后统一检查，比如0x1g整个报错，而不是拆成0x1和g两个token
+static bool lex_is_number_char(char prev, char c)
 {
-    const char *num = NULL;
-    struct buffer *buffer = buffer_create();
-    char c = peekc();
-    LEX_GETC_IF(buffer, c, (c >= '0' && c <= '9'));
+    if (isalnum((unsigned char)c) || c == '_' || c == '.')
+    {
+        return true;
+    }
+    return (c == '+' || c == '-') && (prev == 'e' || prev == 'E' || prev == 'p' || prev == 'P');
+}
 
-    buffer_write(buffer, 0x00);
-    return buffer_ptr(buffer);
+static size_t lex_scan_number(const char* str, size_t len)
+{
+    char prev = 0;
+    size_t total = 0;
+    while (total < len && lex_is_number_char(prev, str[total]))
+    {
+        prev = str[total];
+        total++;
+    }
+    return total;
 }
 
-unsigned long long read_number()
+//字符作为数字时的值，不是数字或字母时返回一个比所有进制都大的数
+static int lex_digit_value(char c)
 {
-    const char *s = read_number_str();
-    return atoll(s);
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'z')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'Z')
+    {
+        return c - 'A' + 10;
+    }
+    return LEX_NUMBER_NOT_DIGIT;
 }
 
-int lexer_number_type(char c){
-    int res=NUMBER_TYPE_NORMAL;
-    if(c=='L'||c=='l'){
-        res = NUMBER_TYPE_LONG;
-    } else if(c=='F'||c=='f'){
-        res = NUMBER_TYPE_FLOAT;
+//整数后缀：u和l、ll可以以任意顺序各出现一次，ll的两个字母大小写必须相同
+static bool lex_integer_suffix(const char* str, size_t len, bool* is_unsigned, int* type)
+{
+    *is_unsigned = false;
+    *type = NUMBER_TYPE_NORMAL;
+    for (size_t i = 0; i < len; i++)
+    {
+        if ((str[i] == 'u' || str[i] == 'U') && !*is_unsigned)
+        {
+            *is_unsigned = true;
+        }
+        else if ((str[i] == 'l' || str[i] == 'L') && *type == NUMBER_TYPE_NORMAL)
+        {
+            *type = NUMBER_TYPE_LONG;
+            if (i + 1 < len && str[i + 1] == str[i])
+            {
+                *type = NUMBER_TYPE_LONG_LONG;
+                i++;
+            }
+        }
+        else
+        {
+            return false;
+        }
     }
-    return res;
+    return true;
 }
-struct token *token_make_number_for_value(unsigned long number)
+
+//十进制、十六进制、八进制和二进制整数，值在读取数字的同时算出来
+static struct token *token_make_integer(struct lex_process* lex_process, const char* str, size_t len)
 {
-    int number_type=lexer_number_type(peekc());
-    return token_create(&(struct token){.type = TOKEN_TYPE_NUMBER, .llnum = number});
+    int base = 10;
+    size_t i = 0;
+    if (len >= 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
+    {
+        base = 16;
+        i = 2;
+    }
+    else if (len >= 2 && str[0] == '0' && (str[1] == 'b' || str[1] == 'B'))
+    {
+        base = 2;
+        i = 2;
+    }
+    else if (str[0] == '0')
+    {
+        base = 8;
+    }
+
+    size_t digits = i;
+    unsigned long long value = 0;
+    bool overflow = false;
+    for (; i < len; i++)
+    {
+        int digit = lex_digit_value(str[i]);
+        if (digit >= base)
+        {
+            break;
+        }
+        if (value > (ULLONG_MAX - digit) / base)
+        {
+            overflow = true;
+        }
+        value = value * base + digit;
+    }
+    if (i == digits)
+    {
+        compiler_error(lex_process->compiler, "数字常量%.*s中没有数字\n", (int)len, str);
+    }
+    if (i < len && str[i] >= '0' && str[i] <= '9')
+    {
+        compiler_error(lex_process->compiler, "数字常量%.*s中有非法的数字'%c'\n", (int)len, str, str[i]);
+    }
+
+    bool is_unsigned;
+    int type;
+    if (!lex_integer_suffix(str + i, len - i, &is_unsigned, &type))
+    {
+        compiler_error(lex_process->compiler, "数字常量%.*s的后缀%.*s无效\n", (int)len, str, (int)(len - i), str + i);
+    }
+    if (overflow)
+    {
+        compiler_error(lex_process->compiler, "整数常量%.*s超出了unsigned long long的范围\n", (int)len, str);
+    }
+
+    //按int、long都是32、64位，取能放下这个值的第一个类型
+    //十进制数只会变成更长的有符号类型，其他进制放不下时先换成同样长度的无符号类型
+    if (type == NUMBER_TYPE_NORMAL && value > (is_unsigned ? UINT_MAX : INT_MAX))
+    {
+        if (!is_unsigned && base != 10 && value <= UINT_MAX)
+        {
+            is_unsigned = true;
+        }
+        else
+        {
+            type = NUMBER_TYPE_LONG;
+        }
+    }
+    //有符号的64位类型都放不下时和gcc一样当作无符号数
+    if (!is_unsigned && value > LLONG_MAX)
+    {
+        is_unsigned = true;
+    }
+    return token_create(lex_process, &(struct token){.type = TOKEN_TYPE_NUMBER, .llnum = value, .num = {.type = type, .is_unsigned = is_unsigned}});
 }
-struct token *token_make_number()
+
+//十进制浮点数的快速路径（Clinger）：有效数字不超过2^53、10的幂次不超过22时，
+//有效数字和10的幂都能精确表示成double，一次乘法或除法的结果就是正确舍入的
+//float同理，条件是有效数字不超过2^24、幂次不超过10
+static bool lex_fast_float(unsigned long long mantissa, int exponent, int type, double* out)
 {
-    return token_make_number_for_value(read_number());
+    if (mantissa == 0)
+    {
+        *out = 0;
+        return true;
+    }
+    if (type == NUMBER_TYPE_FLOAT)
+    {
+        if (mantissa > LEX_FLOAT_MAX_EXACT_MANTISSA || exponent < -LEX_FLOAT_MAX_EXACT_POWER || exponent > LEX_FLOAT_MAX_EXACT_POWER)
+        {
+            return false;
+        }
+        float value = (float)mantissa;
+        float power = (float)lex_exact_powers_of_ten[exponent < 0 ? -exponent : exponent];
+        *out = exponent < 0 ? value / power : value * power;
+        return true;
+    }
+
+    if (mantissa > LEX_DOUBLE_MAX_EXACT_MANTISSA || exponent < -LEX_DOUBLE_MAX_EXACT_POWER)
+    {
+        return false;
+    }
+    //幂次稍大时先把多出的部分乘进有效数字，只要结果还能精确表示，比如1e30写成1000000e24
+    while (exponent > LEX_DOUBLE_MAX_EXACT_POWER)
+    {
+        if (mantissa > LEX_DOUBLE_MAX_EXACT_MANTISSA / 10)
+        {
+            return false;
+        }
+        mantissa *= 10;
+        exponent--;
+    }
+    double value = (double)mantissa;
+    *out = exponent < 0 ? value / lex_exact_powers_of_ten[-exponent] : value * lex_exact_powers_of_ten[exponent];
+    return true;
 }
 
-static struct token *token_make_string(char start_delim, char end_delim)
+//快速路径处理不了的情况交给C库，str是去掉后缀的部分，需要先拷贝出一份带终止符的
+static double lex_slow_float(struct lex_process* lex_process, const char* str, size_t len, int type)
 {
-    struct buffer *buffer = buffer_create();
-    assert(nextc() == start_delim);
-    char c = nextc(); // 读取双引号后第一个字符
-    for (; c != end_delim && c != EOF; c = nextc())
+    char local[LEX_NUMBER_LOCAL_TEXT];
+    char* text = len < sizeof(local) ? local : malloc(len + 1);
+    memcpy(text, str, len);
+    text[len] = 0;
+    errno = 0;
+    double value = type == NUMBER_TYPE_FLOAT ? strtof(text, NULL) : strtod(text, NULL);
+    bool overflow = errno == ERANGE && isinf(value);
+    if (text != local)
     {
-        if (c == '\\')
+        free(text);
+    }
+    if (overflow)
+    {
+        compiler_error(lex_process->compiler, "浮点数常量%.*s超出了范围\n", (int)len, str);
+    }
+    return value;
+}
+
+//浮点数：十进制的在读取的同时累加有效数字和10的幂次，十六进制的直接交给strtod
+//long double按double处理
+static struct token *token_make_float(struct lex_process* lex_process, const char* str, size_t len, bool hex)
+{
+    unsigned long long mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    bool truncated = false;
+    bool any_digit = false;
+    size_t i = hex ? 2 : 0;
+    bool after_point = false;
+    for (; i < len; i++)
+    {
+        if (str[i] == '.' && !after_point)
         {
-            // 转义字符处理
+            after_point = true;
             continue;
         }
+        int digit = lex_digit_value(str[i]);
+        if (digit >= (hex ? 16 : 10))
+        {
+            break;
+        }
+        any_digit = true;
+        if (hex)
+        {
+            continue;
+        }
+        //只保留前19位有效数字，放得下unsigned long long，更多的位只影响幂次
+        if (significant < LEX_NUMBER_MAX_DIGITS)
+        {
+            if (mantissa || digit)
+            {
+                significant++;
+            }
+            mantissa = mantissa * 10 + digit;
+            exponent -= after_point;
+        }
+        else
+        {
+            truncated |= digit != 0;
+            exponent += !after_point;
+        }
+    }
+    if (!any_digit)
+    {
+        compiler_error(lex_process->compiler, "数字常量%.*s中没有数字\n", (int)len, str);
+    }
 
-        buffer_write(buffer, c);
+    char exponent_char = hex ? 'p' : 'e';
+    if (i < len && (str[i] == exponent_char || str[i] == exponent_char - 'a' + 'A'))
+    {
+        i++;
+        int sign = 1;
+        if (i < len && (str[i] == '+' || str[i] == '-'))
+        {
+            sign = str[i] == '-' ? -1 : 1;
+            i++;
+        }
+        if (i == len || str[i] < '0' || str[i] > '9')
+        {
+            compiler_error(lex_process->compiler, "浮点数常量%.*s的指数部分没有数字\n", (int)len, str);
+        }
+        int value = 0;
+        for (; i < len && str[i] >= '0' && str[i] <= '9'; i++)
+        {
+            //幂次大到这个程度时结果已经确定是0或者溢出，不用继续累加
+            if (value < LEX_NUMBER_MAX_EXPONENT)
+            {
+                value = value * 10 + str[i] - '0';
+            }
+        }
+        exponent += sign * value;
+    }
+    else if (hex)
+    {
+        compiler_error(lex_process->compiler, "十六进制浮点数常量%.*s必须有p指数\n", (int)len, str);
+    }
+
+    int type = NUMBER_TYPE_DOUBLE;
+    if (i + 1 == len && (str[i] == 'f' || str[i] == 'F'))
+    {
+        type = NUMBER_TYPE_FLOAT;
+    }
+    else if (i < len && !(i + 1 == len && (str[i] == 'l' || str[i] == 'L')))
+    {
+        compiler_error(lex_process->compiler, "数字常量%.*s的后缀%.*s无效\n", (int)len, str, (int)(len - i), str + i);
     }
 
-    buffer_write(buffer, 0x00);
-    return token_create(&(struct token){.type = TOKEN_TYPE_STRING, .sval = buffer_ptr(buffer)});
+    double value;
+    if (hex || truncated || !lex_fast_float(mantissa, exponent, type, &value))
+    {
+        value = lex_slow_float(lex_process, str, i, type);
+    }
+    return token_create(lex_process, &(struct token){.type = TOKEN_TYPE_NUMBER, .dnum = value, .num = {.type = type}});
+}
+
+static struct token *token_make_number_for_text(struct lex_process* lex_process, const char* str, size_t len)
+{
+    //十进制数里有小数点或e，十六进制数里有小数点或p就是浮点数
+    bool hex = len >= 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X');
+    for (size_t i = hex ? 2 : 0; i < len; i++)
+    {
+        char c = str[i];
+        if (c == '.' || (hex ? (c == 'p' || c == 'P') : (c == 'e' || c == 'E')))
+        {
+            return token_make_float(lex_process, str, len, hex);
+        }
+    }
+    return token_make_integer(lex_process, str, len);
 }
 
-static bool op_treated_as_one(char c)
+//一个个字符读取时先把数字的文本读进buffer，以小数点开头的数字buffer里已经有读出的小数点
+static struct token *token_make_number_for_buffer(struct lex_process* lex_process, struct buffer* buffer)
 {
-    return c == '(' || c == '[' || c == '.' || c == '*' || c == '?' || c == ',';
+    char prev = buffer->len ? buffer->data[buffer->len - 1] : 0;
+    for (char c = peekc(lex_process); lex_is_number_char(prev, c); c = peekc(lex_process))
+    {
+        buffer_write(buffer, c);
+        nextc(lex_process);
+        prev = c;
+    }
+    return token_make_number_for_text(lex_process, buffer_ptr(buffer), buffer->len);
 }
-static bool is_single_operator(char c)
+
+struct token *token_make_number(struct lex_process* lex_process)
 {
-    return c == '+' || c == '-' || c == '/' || c == '*' ||
-           c == '=' || c == '<' || c == '>' || c == '|' ||
-           c == '&' || c == '^' || c == '%' || c == '!' ||
-           c == '(' || c == '[' || c == ',' || c == '.' ||
-           c == '~' || c == '?';
-}
-//判断是否是合法的运算符
-bool op_valid(const char *op){
-    return  S_EQ(op, "+")||
-            S_EQ(op, "-")||
-            S_EQ(op, "*")||
-            S_EQ(op, "/")||
-            S_EQ(op, "!")||
-            S_EQ(op, "^")||
-            S_EQ(op, "+=")||
-            S_EQ(op, "-=")||
-            S_EQ(op, "*=")||
-            S_EQ(op, "/=")||
-            S_EQ(op, ">>")||
-            S_EQ(op, "<<")||
-            S_EQ(op, ">=")||
-            S_EQ(op, "<=")||
-            S_EQ(op, ">")||
-            S_EQ(op, "<")||
-            S_EQ(op, "||")||
-            S_EQ(op, "&&")||
-            S_EQ(op, "|")||
-            S_EQ(op, "&")||
-            S_EQ(op, "++")||
-            S_EQ(op, "--")||
-            S_EQ(op, "=")||
-            S_EQ(op, "!=")||
-            S_EQ(op, "==")||
-            S_EQ(op, "->")||
-            S_EQ(op, "(")||
-            S_EQ(op, "[")||
-            S_EQ(op, ",")||
-            S_EQ(op, ".")||
-            S_EQ(op, "...")||
-            S_EQ(op, "~")||
-            S_EQ(op, "?")||
-            S_EQ(op, "%");
-}
-void read_op_flush_back_keep_first(struct buffer* buffer){
-    const char* data=buffer_ptr(buffer);
-    int len=buffer->len;
-    for(int i=len-1;i>=1;i--){
-        if(data[i]==0x00){
-            continue;
-        }
-        pushc(data[i]);
+    //源码在内存中时直接在原文上解析，不需要先拷贝到缓冲区
+    size_t len;
+    const char* str = lex_span(lex_process, &len);
+    if (str)
+    {
+        size_t total = lex_scan_number(str, len);
+        lex_skip(lex_process, total);
+        return token_make_number_for_text(lex_process, str, total);
     }
+    return token_make_number_for_buffer(lex_process, lex_scratch_buffer(lex_process));
 }
-const char *read_op()
+
+//字符串的内容不含两边的定界符，源码在内存中又没有转义时直接引用源码
+//有转义时去掉转义之后的文本和源码不同，才在临时缓冲区里拼出来
+static struct token *token_make_string(struct lex_process* lex_process, char start_delim, char end_delim)
 {
-    bool single_operator = true;
-    char op = nextc();
-    struct buffer *buffer = buffer_create();
-    buffer_write(buffer, op);
-    //如果不是单目运算符，则通过peekc()读取下一个字符
-    if (!op_treated_as_one(op))
-    {
-        op = peekc();
-        if(is_single_operator(op)){
-            buffer_write(buffer, op);
-            nextc();
-            single_operator = false;
+    assert(nextc(lex_process) == start_delim);
+    struct buffer *buffer = lex_scratch_buffer(lex_process);
+    size_t len;
+    const char* str = lex_span(lex_process, &len);
+    if (str)
+    {
+        size_t total = 0;
+        while (total < len && str[total] != end_delim && str[total] != '\\')
+        {
+            total++;
+        }
+        if (total == len || str[total] == end_delim)
+        {
+            struct token_span span = {.offset = lex_process->offset, .len = total};
+            lex_skip(lex_process, total < len ? total + 1 : total);
+            return token_create(lex_process, &(struct token){.type = TOKEN_TYPE_STRING, .span = span});
         }
+        //转义之前的部分已经扫描过，整段放进缓冲区
+        for (size_t i = 0; i < total; i++)
+        {
+            buffer_write(buffer, str[i]);
+        }
+        lex_skip(lex_process, total);
     }
 
-    buffer_write(buffer, 0x00);
-    char* ptr=buffer_ptr(buffer);
-    if(!single_operator){
-        if(!op_valid(ptr)){
-            read_op_flush_back_keep_first(buffer);
-            ptr[1]=0x00;
+    for (char c = nextc(lex_process); c != end_delim && c != EOF; c = nextc(lex_process))
+    {
+        if (c == '\\')
+        {
+            // 转义字符处理，不认识的转义保留反斜杠后面的字符
+            c = nextc(lex_process);
+            if (c == EOF)
+            {
+                break;
+            }
+            char escaped = lex_get_escape_char(c);
+            c = escaped ? escaped : c;
         }
-    } else if(!op_valid(ptr)){
-        compiler_error(lex_process->compiler, "未知的运算符：%s\n",ptr);
+        buffer_write(buffer, c);
     }
-    return ptr;
+
+    return token_create(lex_process, &(struct token){.type = TOKEN_TYPE_STRING, .span = lex_scratch_span(lex_process, buffer)});
 }
 
-static void lex_new_expression(){
+//按最长匹配读取运算符，first是已经读出的第一个字符
+//状态机只在确认下一个字符能接上时才读取它，所以不需要把字符推回输入
+static int read_op(struct lex_process* lex_process, char first)
+{
+    int state = operator_next_state(OPERATOR_NONE, first);
+    for (int next = operator_next_state(state, peekc(lex_process)); next != OPERATOR_NONE; next = operator_next_state(state, peekc(lex_process)))
+    {
+        nextc(lex_process);
+        state = next;
+    }
+
+    if (!operator_state_is_accepting(state))
+    {
+        compiler_error(lex_process->compiler, "未知的运算符：%c\n", first);
+    }
+    return state;
+}
+
+//'('已经读过，最外层括号里的文本从当前偏移开始
+static void lex_new_expression(struct lex_process* lex_process){
     lex_process->current_expression_count++;
     if(lex_process->current_expression_count==1){
-        lex_process->parentheses_buffer=buffer_create();
+        lex_process->brackets_start=lex_process->offset;
     }
 }
 
-static void lex_finish_expression(){
+static void lex_finish_expression(struct lex_process* lex_process){
     lex_process->current_expression_count--;
     if(lex_process->current_expression_count<0){
         compiler_error(lex_process->compiler, "没有找到匹配的开始括号\n");
     }
 }
 
-bool lex_is_in_expression(){
+bool lex_is_in_expression(struct lex_process* lex_process){
     return lex_process->current_expression_count>0;
 }
-bool is_keyword(char* str){
-    return S_EQ(str, "unsigned")||
-           S_EQ(str, "signed")||
-           S_EQ(str, "char")||
-           S_EQ(str, "int")||
-           S_EQ(str, "short")||
-           S_EQ(str, "long")||
-           S_EQ(str, "float")||
-           S_EQ(str, "double")||
-           S_EQ(str, "void")||
-           S_EQ(str, "struct")||
-           S_EQ(str, "union")||
-           S_EQ(str, "static")||
-           S_EQ(str, "__ignore_typecheck")||
-           S_EQ(str, "return")||
-           S_EQ(str, "include")||
-           S_EQ(str, "sizeof")||
-           S_EQ(str, "if")||
-           S_EQ(str, "else")||
-           S_EQ(str, "while")||
-           S_EQ(str, "for")||
-           S_EQ(str, "do")||
-           S_EQ(str, "break")||
-           S_EQ(str, "continue")||
-           S_EQ(str, "switch")||
-           S_EQ(str, "case")||
-           S_EQ(str, "default")||
-           S_EQ(str, "goto")||
-           S_EQ(str, "typedef")||
-           S_EQ(str, "const")||
-           S_EQ(str, "extern")||
-           S_EQ(str, "restrict");
-}
-
-static struct token *token_make_operator_or_string()
+static struct token *token_make_operator(struct lex_process* lex_process, char first)
+{
+    struct token *token = token_create(lex_process, &(struct token){.type=TOKEN_TYPE_OPERATOR,.op=read_op(lex_process, first)});
+    if(token->op==OPERATOR_LEFT_PAREN){
+        lex_new_expression(lex_process);
+    }
+
+    return token;
+}
+
+static struct token *token_make_operator_or_string(struct lex_process* lex_process)
 {
-    char op=peekc();
+    char op=peekc(lex_process);
     if(op=='<'){
-        struct token* last_token=lexer_last_token();
+        struct token* last_token=lexer_last_token(lex_process);
         //处理形如 #include<lyf.h> 的情况
-        if(token_is_keyword(last_token,"include")){
-            return token_make_string('<','>');
+        if(last_token&&token_is_keyword(last_token,KEYWORD_INCLUDE)){
+            return token_make_string(lex_process, '<','>');
         }
     }
-    struct token *token = token_create(&(struct token){.type=TOKEN_TYPE_OPERATOR,.sval=read_op()});
-    if(op=='('){
-        lex_new_expression();
+    if(op=='.'){
+        //.5这样以小数点开头的浮点数
+        size_t len;
+        const char* str=lex_span(lex_process, &len);
+        if(str){
+            if(len>1&&str[1]>='0'&&str[1]<='9'){
+                return token_make_number(lex_process);
+            }
+        } else {
+            nextc(lex_process);
+            char c=peekc(lex_process);
+            if(c>='0'&&c<='9'){
+                struct buffer* buffer=lex_scratch_buffer(lex_process);
+                buffer_write(buffer, '.');
+                return token_make_number_for_buffer(lex_process, buffer);
+            }
+            return token_make_operator(lex_process, '.');
+        }
     }
-
-    return token;
+    return token_make_operator(lex_process, nextc(lex_process));
 }
-static struct token *token_make_symbol(){
-    char c=nextc();
+static struct token *token_make_symbol(struct lex_process* lex_process){
+    char c=nextc(lex_process);
     if(c==')'){
-        lex_finish_expression();
+        lex_finish_expression(lex_process);
     }
-    struct token *token = token_create(&(struct token){.type=TOKEN_TYPE_SYMBOL,.cval=c});
+    struct token *token = token_create(lex_process, &(struct token){.type=TOKEN_TYPE_SYMBOL,.cval=c});
     return token;
 }
 
 //读取单行注释完成词法token
-struct token* token_make_one_line_comment()
+struct token* token_make_one_line_comment(struct lex_process* lex_process)
 {
-    struct buffer* buffer=buffer_create();
+    size_t len;
+    const char* str=lex_span(lex_process, &len);
+    if(str){
+        struct token_span span={.offset=lex_process->offset, .len=scan_line_end(str, len)};
+        lex_skip(lex_process, span.len);
+        return token_create(lex_process, &(struct token){.type=TOKEN_TYPE_COMMENT,.span=span});
+    }
+
+    struct buffer* buffer=lex_scratch_buffer(lex_process);
     char c=0;
-    LEX_GETC_IF(buffer,c,c!='\n'&&c!='\r'&&c!=EOF);
-    return token_create(&(struct token){.type=TOKEN_TYPE_COMMENT,.sval=buffer_ptr(buffer)});
+    LEX_GETC_IF(lex_process, buffer, c, c!='\n'&&c!='\r'&&c!=EOF);
+    return token_create(lex_process, &(struct token){.type=TOKEN_TYPE_COMMENT,.span=lex_scratch_span(lex_process, buffer)});
 };
 //读取多行注释完成词法token
-struct token* token_make_multiline_comment(){
-    struct buffer* buffer=buffer_create();
+struct token* token_make_multiline_comment(struct lex_process* lex_process){
+    size_t len;
+    const char* str=lex_span(lex_process, &len);
+    if(str){
+        size_t total=scan_comment_end(str, len);
+        if(total==len){
+            compiler_error(lex_process->compiler,"注释没有匹配的结束符\n");
+        }
+        struct token_span span={.offset=lex_process->offset, .len=total};
+        //连同结尾的"*/"一起跳过
+        lex_skip(lex_process, total+2);
+        return token_create(lex_process, &(struct token){.type=TOKEN_TYPE_COMMENT,.span=span});
+    }
+
+    struct buffer* buffer=lex_scratch_buffer(lex_process);
     char c=0;
     while(1){
-        LEX_GETC_IF(buffer,c,c!='*'&&c!=EOF);
+        LEX_GETC_IF(lex_process, buffer, c, c!='*'&&c!=EOF);
         //读到代码文件结尾还没有结束注释则报错
         if(c==EOF){
             compiler_error(lex_process->compiler,"注释没有匹配的结束符\n");
@@ -326,61 +680,75 @@ struct token* token_make_multiline_comment(){
         else if (c=='*')
         {
             //跳过*号
-            nextc();
+            nextc(lex_process);
             //如果下一个字符是"/"则结束注释
-            if(peekc()=='/'){
-                nextc();
+            if(peekc(lex_process)=='/'){
+                nextc(lex_process);
                 break;
             }
+            //不是结束符的*号也是注释内容
+            buffer_write(buffer, '*');
         }
     }
-    return token_create(&(struct token){.type=TOKEN_TYPE_COMMENT,.sval=buffer_ptr(buffer)});
+    return token_create(lex_process, &(struct token){.type=TOKEN_TYPE_COMMENT,.span=lex_scratch_span(lex_process, buffer)});
 }
-struct token* handle_comment(){
-    char c=peekc();
+struct token* handle_comment(struct lex_process* lex_process){
+    char c=peekc(lex_process);
     if(c=='/'){
-        nextc();
-        if(peekc()=='/'){
-            nextc();
-            return token_make_one_line_comment();
+        nextc(lex_process);
+        if(peekc(lex_process)=='/'){
+            nextc(lex_process);
+            return token_make_one_line_comment(lex_process);
         }
-        else if(peekc()=='*'){
-            nextc();
-            return token_make_multiline_comment();
+        else if(peekc(lex_process)=='*'){
+            nextc(lex_process);
+            return token_make_multiline_comment(lex_process);
         }
 
-        pushc('/');
-        return token_make_operator_or_string();
+        //不是注释，已经读出的'/'就是运算符的第一个字符
+        return token_make_operator(lex_process, '/');
     }
     return NULL;
 }
 
-static struct token* token_make_identifier_or_keyword(){
-    struct buffer* buffer=buffer_create();
-    char c=0;
-    //读取变量名或关键字内容
-    LEX_GETC_IF(buffer, c, (c>='a'&&c<='z')||(c>='A'&&c<='Z')||(c>='0'&&c<='9')||c=='_');
-    
-    buffer_write(buffer,0x00);
+static struct token* token_make_identifier_for_text(struct lex_process* lex_process, const char* str, size_t len){
+    //检查是否是关键字，关键字token只携带枚举值
+    int kw=keyword_lookup(str, len);
+    if(kw!=KEYWORD_NONE){
+        return token_create(lex_process, &(struct token){.type=TOKEN_TYPE_KEYWORD,.kw=kw});
+    }
+    return token_create(lex_process, &(struct token){.type=TOKEN_TYPE_IDENTIFIER,.sval=intern(lex_process->compiler->interns, str, len)});
+}
 
-    //检查是否是关键字
-    if(is_keyword(buffer_ptr(buffer))){
-        return token_create(&(struct token){.type=TOKEN_TYPE_KEYWORD,.sval=buffer_ptr(buffer)});
+static struct token* token_make_identifier_or_keyword(struct lex_process* lex_process){
+    //源码在内存中时直接在原文上查找关键字和驻留，不需要先拷贝到缓冲区
+    size_t len;
+    const char* str=lex_span(lex_process, &len);
+    if(str){
+        size_t total=scan_identifier(str, len);
+        lex_skip(lex_process, total);
+        return token_make_identifier_for_text(lex_process, str, total);
     }
-    return token_create(&(struct token){.type=TOKEN_TYPE_IDENTIFIER,.sval=buffer_ptr(buffer)});
+
+    struct buffer* buffer=lex_scratch_buffer(lex_process);
+    char c=0;
+    //读取变量名或关键字内容
+    LEX_GETC_IF(lex_process, buffer, c, (c>='a'&&c<='z')||(c>='A'&&c<='Z')||(c>='0'&&c<='9')||c=='_');
+    return token_make_identifier_for_text(lex_process, buffer_ptr(buffer), buffer->len);
 }
 
-struct token* read_special_token(){
+struct token* read_special_token(struct lex_process* lex_process){
     
-    char c=peekc();
+    char c=peekc(lex_process);
     //遇到字母或者下划线打头的不是标识符（变量名）就是关键字
     if(isalpha(c)||c=='_'){
-        return token_make_identifier_or_keyword();
+        return token_make_identifier_or_keyword(lex_process);
     }
+    return NULL;
 }
-struct token* token_make_newline(){
-    nextc();
-    return token_create(&(struct token){.type=TOKEN_TYPE_NEWLINE});
+struct token* token_make_newline(struct lex_process* lex_process){
+    nextc(lex_process);
+    return token_create(lex_process, &(struct token){.type=TOKEN_TYPE_NEWLINE});
 }
 char lex_get_escape_char(char c){
     char co=0;
@@ -393,91 +761,33 @@ char lex_get_escape_char(char c){
     }
     return co;
 }
-void lexer_pop_token(){
-    vector_pop(lex_process->token_vec);
-}
-//判断哪些字符是16进制数中合法的字符
-bool is_hex_char(char c){
-    return (c>='0'&&c<='9')||(c>='a'&&c<='f')||(c>='A'&&c<='F');
-}
-//读取十六进制数的整条字符串
-const char* read_hex_number_str(){
-    struct buffer* buffer=buffer_create();
-    char c=peekc();
-    LEX_GETC_IF(buffer,c,is_hex_char(c));
-    //写入终止符
-    buffer_write(buffer,0x00);
-    return buffer_ptr(buffer);
-}
-//处理十六进制类型的token
-struct token* token_make_special_number_hexadecimal(){
-    //跳过'x'||'X'
-    nextc();
-    unsigned long number=0;
-    const char* number_str=read_hex_number_str();
-    number=strtoul(number_str,0,16);
-    return token_make_number_for_value(number);
-}
-
-void lexer_validate_binary_string(const char* str){
-    size_t len=strlen(str);
-    for(int i=0;i<len;i++){
-        if(str[i]!='0'&&str[i]!='1'){
-            compiler_error(lex_process->compiler,"非法的字符'%c',二进制数只能由0和1组成");
-        }
-    }
-}
-struct token* token_make_number_binary(){
-    //跳过'b'
-    nextc();
-    unsigned long number=0;
-    const char* number_str=read_number_str();
-    lexer_validate_binary_string(number_str);
-    number=strtoul(number_str,0,2);
-    return token_make_number_for_value(number);
-}
-//处理十六进制、八进制等特殊进制的数字
-struct token* token_make_special_number(){
-    struct token* token=NULL;
-    struct token* last_token=lexer_last_token();
-    //如果没有前导零，说明是以'x'、'b'、'h'开头的变量名
-    if(!last_token||!(last_token->type==TOKEN_TYPE_NUMBER&&last_token->llnum==0)){
-        return token_make_identifier_or_keyword();
-    }
-    //把识别符0x、0b、0h最前面的0去掉
-    lexer_pop_token();
-    
-    char c=peekc();
-    if(c=='x'||c=='X'){
-        token=token_make_special_number_hexadecimal();
-    } else if(c=='b'||c=='B'){
-        token=token_make_number_binary();
-    }
-    
-    return token;
-}
 //处理单引号内包括的字符
-struct token* token_make_quote(){
-    assert_next_char('\'');//确保下一个字符是单引号
-    char c=nextc();
+struct token* token_make_quote(struct lex_process* lex_process){
+    assert_next_char(lex_process, '\'');//确保下一个字符是单引号
+    char c=nextc(lex_process);
     //转义字符
     if(c=='\\'){
-        c=nextc();
+        c=nextc(lex_process);
         c=lex_get_escape_char(c);
     }
     //如果单引号内超过了一个字符还没结束单引号
-    if(nextc()!='\''){
+    if(nextc(lex_process)!='\''){
         compiler_error(lex_process->compiler,"没有匹配结束的单引号或者单引号内超过了一个字符或者单引号内没有字符\n");
     }
     //返回的是0~255的字符
-    return token_create(&(struct token){.type=TOKEN_TYPE_NUMBER,.cval=c});
+    return token_create(lex_process, &(struct token){.type=TOKEN_TYPE_NUMBER,.cval=c});
 }
-struct token *read_next_token()
+struct token *read_next_token(struct lex_process* lex_process)
 {
     struct token *token = NULL;
-    char c = peekc();
+    //token之前的空白整段跳过
+    handle_whitespace(lex_process);
+    //记下token的起始位置，词法分析中报错时也指向这里
+    lex_process->token_offset = lex_process->offset;
+    lex_process->compiler->offset = lex_process->offset;
+    char c = peekc(lex_process);
     //先尝试一下看看是不是无效的代码（注释）
-    token = handle_comment();
+    token = handle_comment(lex_process);
     if (token != NULL){
         return token;
     }
@@ -485,29 +795,19 @@ struct token *read_next_token()
     switch (c)
     {
     NUMERIC_CASE:
-        token = token_make_number();
+        token = token_make_number(lex_process);
         break;
     OPERATOR_CASE_EXCLUDING_DIVISION:
-        token = token_make_operator_or_string();
+        token = token_make_operator_or_string(lex_process);
         break;
     SYMBOL_CASE:
-        token= token_make_symbol();
-        break;
-    case 'b':
-    case 'B':
-    case 'x':
-    case 'X':
-        token = token_make_special_number();
+        token= token_make_symbol(lex_process);
         break;
     case '"':
-        token = token_make_string('"', '"');
+        token = token_make_string(lex_process, '"', '"');
         break;
     case '\'':
-        token = token_make_quote();
-        break;
-    case ' ':
-    case '\t':
-        token = handle_whitespace();
+        token = token_make_quote(lex_process);
         break;
     case '\n':
     //由于我是Windows系统，所以在编译遇到\r换行符时也要进行处理
@@ -516,14 +816,14 @@ struct token *read_next_token()
     //case '\r':
     //    这一行
     case '\r':
-        token=token_make_newline();
+        token=token_make_newline(lex_process);
         break;
     case EOF:
         // 结束代码文本的全部词法分析
         break;
 
     default:
-        token=read_special_token();
+        token=read_special_token(lex_process);
         if(!token){
             compiler_error(lex_process->compiler, "未知的字符\n");
         }
@@ -531,48 +831,86 @@ struct token *read_next_token()
     return token;
 };
 
+//读取下一个token并追加到token_vec中，读到文件结尾时返回NULL
+//语法分析按需拉取token时直接调用这里，不需要先把整个文件分析完
+struct token *lex_next_token(struct lex_process *lex_process)
+{
+    struct token *token = read_next_token(lex_process);
+    if (!token)
+    {
+        return NULL;
+    }
+
+    //紧跟在token后面的空白现在就读掉，token交出去之前whitespace标志就已经确定
+    if (lex_skip_blanks(lex_process))
+    {
+        token->whitespace = true;
+    }
+
+    lex_process->compiler->stats.tokens[token->type]++;
+    vector_push(lex_process->token_vec, token);
+    return vector_back(lex_process->token_vec);
+}
+
 int lex(struct lex_process *process)
 {
     process->current_expression_count = 0;
-    process->parentheses_buffer = NULL;
-    lex_process = process;
-    process->pos.filename = process->compiler->cfile.abs_path;
+    process->brackets_start = 0;
 
-    struct token *token = read_next_token();
-    while (token)
+    while (lex_next_token(process))
     {
-        vector_push(process->token_vec, token);
-        token = read_next_token();
     }
     return LEXICAL_ANALYSIS_ALL_OK;
 }
 
-char lexer_string_buffer_next_char(struct lex_process* process){
-    struct buffer* buffer=lex_process_private(process);
-    return buffer_read(buffer);
-}
-char lexer_string_buffer_peek_char(struct lex_process* process){
-    struct buffer* buffer=lex_process_private(process);
-    return buffer_peek(buffer);
+//直接从登记过的源码里读取字符，private是对应的struct source_file*
+//源码内容已经在内存里，游标就是词法分析器自己的偏移，不需要另外拷贝一份
+char lexer_source_next_char(struct lex_process* process){
+    struct source_file* source=lex_process_private(process);
+    uint32_t local=process->offset-source->base;
+    if(local>=source->size){
+        return EOF;
+    }
+    return source->data[local];
 }
-void lexer_string_buffer_push_char(struct lex_process* process, char c){
-    struct buffer* buffer=lex_process_private(process);
-    buffer_write(buffer, c);
+char lexer_source_peek_char(struct lex_process* process){
+    return lexer_source_next_char(process);
 }
-struct lex_process_functions lexer_string_buffer_functions={
-    .next_char=lexer_string_buffer_next_char,
-    .peek_char=lexer_string_buffer_peek_char,
-    .push_char=lexer_string_buffer_push_char
+//nextc读到字符后才移动偏移，推回时把偏移退回去即可
+void lexer_source_push_char(struct lex_process* process, char c){
+    if(c==EOF){
+        return;
+    }
+    struct source_file* source=lex_process_private(process);
+    assert(process->offset>source->base&&source->data[process->offset-source->base-1]==c);
+    process->offset--;
+}
+const char* lexer_source_span(struct lex_process* process, size_t* len){
+    struct source_file* source=lex_process_private(process);
+    uint32_t local=process->offset-source->base;
+    *len=source->size-local;
+    return source->data+local;
+}
+struct lex_process_functions lexer_source_functions={
+    .next_char=lexer_source_next_char,
+    .peek_char=lexer_source_peek_char,
+    .push_char=lexer_source_push_char,
+    //游标就是词法分析器的偏移，跳过时不需要做别的事情
+    .span=lexer_source_span,
+    .skip=NULL
 };
 struct lex_process* tokens_build_for_string(struct compile_process* compiler, const char* str){
-    struct buffer* buffer=buffer_create();
-    buffer_printf(buffer, str);
-    struct lex_process* lex_process=lex_process_create(compiler, &lexer_string_buffer_functions, buffer);
+    //字符串原样拷贝进arena并登记为一份源码，token的偏移才能换算出位置
+    size_t len=strlen(str);
+    struct source_file* source=compile_process_add_source(compiler, "<string>", arena_strndup(compiler->arena, str, len), len);
+    struct lex_process* lex_process=lex_process_create(compiler, &lexer_source_functions, source);
     if(!lex_process){
         return NULL;
     }
+    lex_process->offset=source->base;
     if(lex(lex_process)!=LEXICAL_ANALYSIS_ALL_OK){
+        lex_process_free(lex_process);
         return NULL;
     }
     return lex_process;
-}
\ No newline at end of file
+}
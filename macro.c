@@ -0,0 +1,503 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/buffer.h"
+#include "helpers/arena.h"
+#include "helpers/ptr_map.h"
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+//宏展开：在预处理器读出的token上展开#define定义的宏
+//展开的结果压进preprocessor->pending，读取时先读它，读完才继续读文件，不需要在token数组中间插入
+//每个token带着hide set，里面的宏在这个token上不再展开，避免无限递归
+//实参、替换之后的内容都放在几个复用的栈里，用下标表示范围，嵌套的宏调用接着往后放，用完退回去
+//所以展开的时间和产生的token数成正比
+
+//数字token写成文本时用的缓冲区大小，放得下最长的%llu和%.17g
+#define MACRO_NUMBER_SPELLING 40
+
+static void macro_truncate(struct vector* vector, int count){
+    vector_pop_multiple_at(vector, count, vector_count(vector)-count);
+}
+
+static struct preprocessor_pending* macro_at(struct vector* vector, int index){
+    return vector_at(vector, index);
+}
+
+static bool macro_hideset_contains(struct preprocessor_hideset* hideset, const char* name){
+    for(;hideset;hideset=hideset->next){
+        if(hideset->name==name){
+            return true;
+        }
+    }
+    return false;
+}
+
+static struct preprocessor_hideset* macro_hideset_add(struct preprocessor* preprocessor, struct preprocessor_hideset* hideset, const char* name){
+    struct preprocessor_hideset* added=arena_alloc(preprocessor->compiler->arena, sizeof(struct preprocessor_hideset));
+    added->name=name;
+    added->next=hideset;
+    return added;
+}
+
+static struct preprocessor_hideset* macro_hideset_union(struct preprocessor* preprocessor, struct preprocessor_hideset* a, struct preprocessor_hideset* b){
+    if(!a||a==b){
+        return b;
+    }
+    for(;a;a=a->next){
+        if(!macro_hideset_contains(b, a->name)){
+            b=macro_hideset_add(preprocessor, b, a->name);
+        }
+    }
+    return b;
+}
+
+static struct preprocessor_hideset* macro_hideset_intersect(struct preprocessor* preprocessor, struct preprocessor_hideset* a, struct preprocessor_hideset* b){
+    if(a==b){
+        return a;
+    }
+    struct preprocessor_hideset* result=NULL;
+    for(;a;a=a->next){
+        if(macro_hideset_contains(b, a->name)){
+            result=macro_hideset_add(preprocessor, result, a->name);
+        }
+    }
+    return result;
+}
+
+//下一个还没有展开的token，先读pending，单独展开时读到pending_floor就结束
+static bool macro_read(struct preprocessor* preprocessor, struct preprocessor_pending* out){
+    struct vector* pending=preprocessor->pending;
+    if(vector_count(pending)>preprocessor->pending_floor&&vector_count(pending)>0){
+        *out=*(struct preprocessor_pending*)vector_back(pending);
+        vector_pop(pending);
+        return true;
+    }
+    if(preprocessor->pending_floor>=0){
+        return false;
+    }
+    struct token* token=preprocessor_read_token(preprocessor);
+    if(!token){
+        return false;
+    }
+    out->token=*token;
+    out->hideset=NULL;
+    return true;
+}
+
+//把vector中[start, end)的token倒着压进pending，读出来的顺序不变
+static void macro_push_pending(struct preprocessor* preprocessor, struct vector* vector, int start, int end){
+    for(int i=end-1;i>=start;i--){
+        vector_push(preprocessor->pending, macro_at(vector, i));
+    }
+}
+
+static bool macro_is_paste(struct token* body, int index, int count){
+    return index+1<count&&token_is_symbol(&body[index], '#')&&!body[index].whitespace&&token_is_symbol(&body[index+1], '#');
+}
+
+//token是宏的参数时返回它是第几个参数，__VA_ARGS__排在最后，不是参数时返回-1
+int macro_param_index(struct preprocessor* preprocessor, struct preprocessor_macro* macro, struct token* token){
+    if(token->type!=TOKEN_TYPE_IDENTIFIER){
+        return -1;
+    }
+    for(int i=0;i<macro->param_count;i++){
+        if(macro->params[i]==token->sval){
+            return i;
+        }
+    }
+    if(macro->variadic&&token->sval==preprocessor->names.va_args){
+        return macro->param_count;
+    }
+    return -1;
+}
+
+static void macro_write(struct buffer* buffer, const char* str){
+    for(;*str;str++){
+        buffer_write(buffer, *str);
+    }
+}
+
+//数字按值写出，重新词法分析能得到同样的类型和值
+//浮点数写出能还原同一个值的最少位数，没有小数点和指数时补上".0"
+static void macro_spell_number(struct buffer* buffer, struct token* token){
+    char number[MACRO_NUMBER_SPELLING];
+    if(token->num.type==NUMBER_TYPE_FLOAT||token->num.type==NUMBER_TYPE_DOUBLE){
+        bool is_float=token->num.type==NUMBER_TYPE_FLOAT;
+        int digits=is_float?FLT_DECIMAL_DIG:DBL_DECIMAL_DIG;
+        for(int precision=1;precision<=digits;precision++){
+            snprintf(number, sizeof(number), "%.*g", precision, token->dnum);
+            double value=is_float?strtof(number, NULL):strtod(number, NULL);
+            if(value==token->dnum){
+                break;
+            }
+        }
+        macro_write(buffer, number);
+        if(!strpbrk(number, ".e")){
+            macro_write(buffer, ".0");
+        }
+        if(is_float){
+            buffer_write(buffer, 'f');
+        }
+        return;
+    }
+    snprintf(number, sizeof(number), "%llu", token->llnum);
+    macro_write(buffer, number);
+    if(token->num.is_unsigned){
+        buffer_write(buffer, 'u');
+    }
+    if(token->num.type==NUMBER_TYPE_LONG){
+        buffer_write(buffer, 'l');
+    } else if(token->num.type==NUMBER_TYPE_LONG_LONG){
+        macro_write(buffer, "ll");
+    }
+}
+
+//token的文本写进buffer，quote为true时字符串里的引号和反斜杠加上转义，得到的文本可以重新词法分析
+static void macro_spell(struct preprocessor* preprocessor, struct buffer* buffer, struct token* token, bool quote){
+    switch(token->type){
+        case TOKEN_TYPE_IDENTIFIER:
+            macro_write(buffer, token->sval);
+            break;
+        case TOKEN_TYPE_KEYWORD:
+            macro_write(buffer, keyword_name(token->kw));
+            break;
+        case TOKEN_TYPE_OPERATOR:
+            macro_write(buffer, operator_name(token->op));
+            break;
+        case TOKEN_TYPE_SYMBOL:
+            buffer_write(buffer, token->cval);
+            break;
+        case TOKEN_TYPE_NUMBER:
+            macro_spell_number(buffer, token);
+            break;
+        case TOKEN_TYPE_STRING:{
+            const char* text=compile_process_text(preprocessor->compiler, token->span);
+            buffer_write(buffer, '"');
+            for(uint32_t i=0;i<token->span.len;i++){
+                if(quote&&(text[i]=='"'||text[i]=='\\')){
+                    buffer_write(buffer, '\\');
+                }
+                buffer_write(buffer, text[i]);
+            }
+            buffer_write(buffer, '"');
+            break;
+        }
+    }
+}
+
+//#参数：实参原样拼成一个字符串，token之间有空白的地方放一个空格
+//字符串token保存的是去掉转义之后的内容，拼出来的文本就是新字符串的内容
+static struct token macro_stringify(struct preprocessor* preprocessor, struct preprocessor_macro_arg* arg, uint32_t offset){
+    struct buffer* buffer=preprocessor->spelling;
+    buffer->len=0;
+    for(int i=arg->start;i<arg->end;i++){
+        struct token* token=&macro_at(preprocessor->macro_args, i)->token;
+        macro_spell(preprocessor, buffer, token, false);
+        if(token->whitespace&&i+1<arg->end){
+            buffer_write(buffer, ' ');
+        }
+    }
+    struct token token={.type=TOKEN_TYPE_STRING, .offset=offset};
+    token.span=compile_process_pool_text(preprocessor->compiler, buffer->data, buffer->len);
+    return token;
+}
+
+//##：两个token的文本接起来，用读取源码的词法分析器重新分析，结果必须正好是一个token
+static struct token macro_paste(struct preprocessor* preprocessor, struct token* left, struct token* right){
+    struct compile_process* compiler=preprocessor->compiler;
+    struct buffer* buffer=preprocessor->spelling;
+    buffer->len=0;
+    macro_spell(preprocessor, buffer, left, true);
+    macro_spell(preprocessor, buffer, right, true);
+
+    //拼出的文本不登记为源码，得到的token指回左边的token
+    struct source_file source={.data=buffer->data, .size=buffer->len, .base=0};
+    if(!preprocessor->lexer){
+        preprocessor->lexer=lex_process_create(compiler, &lexer_source_functions, &source);
+    } else {
+        lex_process_reset(preprocessor->lexer, &lexer_source_functions, &source);
+    }
+    uint32_t offset=compiler->offset;
+    lex(preprocessor->lexer);
+    compiler->offset=offset;
+    struct vector* tokens=preprocessor->lexer->token_vec;
+    if(vector_count(tokens)!=1){
+        compiler_error(compiler, "##拼接出的%.*s不是一个token\n", buffer->len, buffer->data);
+    }
+    struct token token=*(struct token*)vector_at(tokens, 0);
+    //直接引用buffer的字符串要搬进text_pool，buffer下次拼接时就会被覆盖
+    if(token.type==TOKEN_TYPE_STRING&&!(token.span.offset&TOKEN_SPAN_POOL)){
+        token.span=compile_process_pool_text(compiler, buffer->data+token.span.offset, token.span.len);
+    }
+    token.offset=left->offset;
+    token.whitespace=right->whitespace;
+    token.between_brackets=0;
+    return token;
+}
+
+static bool macro_next(struct preprocessor* preprocessor, struct preprocessor_pending* out);
+
+//单独展开macro_args中[start, end)的token，结果追加到macro_args的末尾
+//实参里的宏调用必须在实参里结束，所以读到这段token的末尾就停下来
+static void macro_expand_range(struct preprocessor* preprocessor, int start, int end){
+    int floor=preprocessor->pending_floor;
+    preprocessor->pending_floor=vector_count(preprocessor->pending);
+    macro_push_pending(preprocessor, preprocessor->macro_args, start, end);
+    struct preprocessor_pending token;
+    while(macro_next(preprocessor, &token)){
+        vector_push(preprocessor->macro_args, &token);
+    }
+    preprocessor->pending_floor=floor;
+}
+
+//读出函数宏的实参直到对应的')'，实参中的换行和注释已经变成了前一个token的空白
+//返回的')'决定展开结果的hide set和最后一个token后面的空白
+static struct preprocessor_pending macro_collect_args(struct preprocessor* preprocessor, struct preprocessor_macro* macro, int ranges_base){
+    struct compile_process* compiler=preprocessor->compiler;
+    struct vector* args=preprocessor->macro_args;
+    struct preprocessor_macro_arg arg={.start=vector_count(args), .expanded_start=-1};
+    struct preprocessor_pending token;
+    int depth=0;
+    while(1){
+        if(!macro_read(preprocessor, &token)){
+            compiler_error(compiler, "宏%s的参数没有结束的')'\n", macro->name);
+        }
+        if(token_is_operator(&token.token, OPERATOR_LEFT_PAREN)){
+            depth++;
+        } else if(token_is_symbol(&token.token, ')')){
+            if(depth==0){
+                break;
+            }
+            depth--;
+        } else if(depth==0&&token_is_operator(&token.token, OPERATOR_COMMA)&&
+            !(macro->variadic&&vector_count(preprocessor->macro_arg_ranges)-ranges_base>=macro->param_count)){
+            //可变参数宏的...对应最后一个参数之后的全部实参，其中的逗号原样保留
+            arg.end=vector_count(args);
+            vector_push(preprocessor->macro_arg_ranges, &arg);
+            arg.start=vector_count(args);
+            continue;
+        }
+        vector_push(args, &token);
+    }
+    arg.end=vector_count(args);
+    vector_push(preprocessor->macro_arg_ranges, &arg);
+
+    int count=vector_count(preprocessor->macro_arg_ranges)-ranges_base;
+    //F()对没有参数的宏是零个实参，对一个参数的宏是一个空的实参
+    if(count==1&&arg.start==arg.end&&macro->param_count==0){
+        vector_pop(preprocessor->macro_arg_ranges);
+        count=0;
+    }
+    //可变参数一个都没有给出时__VA_ARGS__为空
+    if(macro->variadic&&count==macro->param_count){
+        arg.start=arg.end;
+        vector_push(preprocessor->macro_arg_ranges, &arg);
+        count++;
+    }
+    int expected=macro->param_count+(macro->variadic?1:0);
+    if(count!=expected){
+        compiler_error(compiler, "宏%s需要%i个参数，给出了%i个\n", macro->name, expected, count);
+    }
+    return token;
+}
+
+static struct preprocessor_macro_arg* macro_arg(struct preprocessor* preprocessor, int ranges_base, int index){
+    return vector_at(preprocessor->macro_arg_ranges, ranges_base+index);
+}
+
+//把macro_args中[start, end)的token追加到输出
+static void macro_output_range(struct preprocessor* preprocessor, int start, int end){
+    for(int i=start;i<end;i++){
+        vector_push(preprocessor->macro_output, macro_at(preprocessor->macro_args, i));
+    }
+}
+
+//用实参替换函数宏的内容，处理#和##，结果追加到macro_output
+static void macro_substitute(struct preprocessor* preprocessor, struct preprocessor_macro* macro, int ranges_base, uint32_t offset){
+    struct vector* output=preprocessor->macro_output;
+    int output_base=vector_count(output);
+    struct token* body=macro->body;
+    int count=macro->body_count;
+    //上一个##的左边是空的实参，右边直接接上去不用拼接
+    bool placemarker=false;
+    for(int i=0;i<count;i++){
+        struct token* token=&body[i];
+        if(macro_is_paste(body, i, count)){
+            i+=2;
+            struct preprocessor_pending right_tokens={.token=body[i]};
+            int param=macro_param_index(preprocessor, macro, &body[i]);
+            int start=0, end=0;
+            if(param>=0){
+                struct preprocessor_macro_arg* arg=macro_arg(preprocessor, ranges_base, param);
+                start=arg->start;
+                end=arg->end;
+                //GNU扩展：, ## __VA_ARGS__在没有可变参数时去掉前面的逗号，有的时候不拼接
+                if(param==macro->param_count&&macro->variadic&&!placemarker&&vector_count(output)>output_base&&
+                    token_is_operator(&macro_at(output, vector_count(output)-1)->token, OPERATOR_COMMA)){
+                    if(start==end){
+                        vector_pop(output);
+                    } else {
+                        macro_output_range(preprocessor, start, end);
+                    }
+                    continue;
+                }
+            }
+            bool right_empty=param>=0&&start==end;
+            if(right_empty){
+                continue;
+            }
+            struct token* right=param>=0?&macro_at(preprocessor->macro_args, start)->token:&right_tokens.token;
+            if(placemarker||vector_count(output)==output_base){
+                vector_push(output, param>=0?(void*)macro_at(preprocessor->macro_args, start):(void*)&right_tokens);
+            } else {
+                struct preprocessor_pending* left=macro_at(output, vector_count(output)-1);
+                left->token=macro_paste(preprocessor, &left->token, right);
+            }
+            if(param>=0){
+                macro_output_range(preprocessor, start+1, end);
+            }
+            placemarker=false;
+            continue;
+        }
+
+        placemarker=false;
+        if(token_is_symbol(token, '#')&&i+1<count){
+            int param=macro_param_index(preprocessor, macro, &body[i+1]);
+            if(param>=0){
+                struct preprocessor_pending string={.token=macro_stringify(preprocessor, macro_arg(preprocessor, ranges_base, param), offset)};
+                string.token.whitespace=body[i+1].whitespace;
+                vector_push(output, &string);
+                i++;
+                continue;
+            }
+        }
+
+        int param=macro_param_index(preprocessor, macro, token);
+        if(param<0){
+            struct preprocessor_pending copy={.token=*token};
+            copy.token.offset=offset;
+            vector_push(output, &copy);
+            continue;
+        }
+        struct preprocessor_macro_arg* arg=macro_arg(preprocessor, ranges_base, param);
+        if(macro_is_paste(body, i+1, count)){
+            //##的左边用没有展开的实参
+            macro_output_range(preprocessor, arg->start, arg->end);
+            placemarker=arg->start==arg->end;
+            continue;
+        }
+        //实参先单独完全展开，同一个参数出现多次时只展开一次
+        if(arg->expanded_start<0){
+            int start=arg->start, end=arg->end;
+            int expanded_start=vector_count(preprocessor->macro_args);
+            macro_expand_range(preprocessor, start, end);
+            arg=macro_arg(preprocessor, ranges_base, param);
+            arg->expanded_start=expanded_start;
+            arg->expanded_end=vector_count(preprocessor->macro_args);
+        }
+        macro_output_range(preprocessor, arg->expanded_start, arg->expanded_end);
+        if(arg->expanded_end>arg->expanded_start){
+            macro_at(output, vector_count(output)-1)->token.whitespace=token->whitespace;
+        }
+    }
+}
+
+//name是宏名，展开的结果压进pending，函数宏后面没有'('时不展开返回false
+static bool macro_expand(struct preprocessor* preprocessor, struct preprocessor_macro* macro, struct preprocessor_pending* name){
+    struct vector* output=preprocessor->macro_output;
+    int output_base=vector_count(output);
+    struct preprocessor_hideset* hideset;
+    bool whitespace=name->token.whitespace;
+    //展开过程中的错误都指向宏调用的位置
+    preprocessor->compiler->offset=name->token.offset;
+
+    if(!macro->function_like){
+        hideset=macro_hideset_add(preprocessor, name->hideset, macro->name);
+        for(int i=0;i<macro->body_count;i++){
+            struct preprocessor_pending token={.token=macro->body[i]};
+            token.token.offset=name->token.offset;
+            vector_push(output, &token);
+        }
+    } else {
+        //宏名后面的token不是'('时要原样退回去
+        int skipped_base=vector_count(output);
+        struct preprocessor_pending token;
+        bool found=false;
+        if(macro_read(preprocessor, &token)){
+            found=token_is_operator(&token.token, OPERATOR_LEFT_PAREN);
+            if(!found){
+                vector_push(output, &token);
+            }
+        }
+        if(!found){
+            macro_push_pending(preprocessor, output, skipped_base, vector_count(output));
+            macro_truncate(output, output_base);
+            return false;
+        }
+        macro_truncate(output, output_base);
+
+        int args_base=vector_count(preprocessor->macro_args);
+        int ranges_base=vector_count(preprocessor->macro_arg_ranges);
+        struct preprocessor_pending rparen=macro_collect_args(preprocessor, macro, ranges_base);
+        hideset=macro_hideset_add(preprocessor, macro_hideset_intersect(preprocessor, name->hideset, rparen.hideset), macro->name);
+        whitespace=rparen.token.whitespace;
+        macro_substitute(preprocessor, macro, ranges_base, name->token.offset);
+        macro_truncate(preprocessor->macro_args, args_base);
+        macro_truncate(preprocessor->macro_arg_ranges, ranges_base);
+    }
+
+    int total=vector_count(output);
+    for(int i=output_base;i<total;i++){
+        struct preprocessor_pending* token=macro_at(output, i);
+        token->hideset=macro_hideset_union(preprocessor, token->hideset, hideset);
+    }
+    if(total>output_base){
+        macro_at(output, total-1)->token.whitespace=whitespace;
+    }
+    macro_push_pending(preprocessor, output, output_base, total);
+    macro_truncate(output, output_base);
+    return true;
+}
+
+//下一个展开之后的token，没有了返回false
+static bool macro_next(struct preprocessor* preprocessor, struct preprocessor_pending* out){
+    while(macro_read(preprocessor, out)){
+        if(out->token.type==TOKEN_TYPE_IDENTIFIER&&preprocessor->macros->count){
+            struct preprocessor_macro* macro=ptr_map_get(preprocessor->macros, out->token.sval);
+            if(macro&&!macro_hideset_contains(out->hideset, macro->name)&&macro_expand(preprocessor, macro, out)){
+                continue;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+bool macro_next_token(struct preprocessor* preprocessor, struct token* out){
+    struct preprocessor_pending token;
+    if(!macro_next(preprocessor, &token)){
+        return false;
+    }
+    *out=token.token;
+    return true;
+}
+
+//展开line中从start开始的token，用于#if的条件，宏调用必须在这一行里结束
+void macro_expand_line(struct preprocessor* preprocessor, struct vector* line, int start){
+    if(!preprocessor->macros->count){
+        return;
+    }
+    int floor=preprocessor->pending_floor;
+    preprocessor->pending_floor=vector_count(preprocessor->pending);
+    for(int i=vector_count(line)-1;i>=start;i--){
+        struct preprocessor_pending token={.token=*(struct token*)vector_at(line, i)};
+        vector_push(preprocessor->pending, &token);
+    }
+    macro_truncate(line, start);
+    struct preprocessor_pending token;
+    while(macro_next(preprocessor, &token)){
+        vector_push(line, &token.token);
+    }
+    preprocessor->pending_floor=floor;
+}
@@ -1,17 +1,182 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
 #include "helpers/vector.h"
 #include "compiler.h"
-int main(){
-    //编译程序
-    int res=compile_file("./test.c", "./test",0);
-    //获取编译返回信息
-    if(res==COMPILOR_FILE_COMPLETE_OK){
-        printf("编译完成\n");
-    } else if(res==COMPILOR_FAILED_WITH_ERRORS){
-        printf("发生了已知错误\n");
+
+struct compile_job
+{
+    const char* filename;
+    // 输出文件名，由输入文件名去掉.c得到，不是.c结尾的加上.out，单个文件时可以用-o指定
+    char* out_filename;
+    int res;
+};
+
+struct compile_jobs
+{
+    struct compile_job* jobs;
+    int total;
+    int flags;
+    struct compile_options options;
+    // 下一个还没有被领走的任务
+    int next;
+    pthread_mutex_t lock;
+};
+
+//输出文件名一定和输入文件名不同，否则打开输出文件时会清空还没有读取的源码
+static char* compile_out_filename(const char* filename){
+    size_t len=strlen(filename);
+    if(len>2&&S_EQ(filename+len-2, ".c")){
+        char* out=malloc(len-1);
+        memcpy(out, filename, len-2);
+        out[len-2]='\0';
+        return out;
+    }
+    char* out=malloc(len+sizeof(".out"));
+    memcpy(out, filename, len);
+    memcpy(out+len, ".out", sizeof(".out"));
+    return out;
+}
+
+//每个工作线程不断领取下一个文件来编译，编译过程之间不共享任何状态
+static void* compile_worker(void* arg){
+    struct compile_jobs* jobs=arg;
+    while(1){
+        pthread_mutex_lock(&jobs->lock);
+        int index=jobs->next++;
+        pthread_mutex_unlock(&jobs->lock);
+        if(index>=jobs->total){
+            break;
+        }
+
+        struct compile_job* job=&jobs->jobs[index];
+        job->res=compile_file(job->filename, job->out_filename, jobs->flags, &jobs->options);
+    }
+    return NULL;
+}
+
+static void usage(const char* program){
+    fprintf(stderr, "用法：%s [-j 线程数] [-o 输出文件] [-fstream] [-farena-report] [-ftime-report] [-w] [-ftoken-cache=目录] [-I 头文件目录] [-emit-pch] [-include-pch 预编译头文件] 文件...\n", program);
+}
+
+int main(int argc, char** argv){
+    int threads=1;
+    int flags=0;
+    struct compile_options options={0};
+    const char* out_filename=NULL;
+    struct vector* filenames=vector_create(sizeof(const char*));
+    struct vector* include_dirs=vector_create(sizeof(const char*));
+    for(int i=1;i<argc;i++){
+        const char* arg=argv[i];
+        if(S_EQ(arg, "-j")&&i+1<argc){
+            threads=atoi(argv[++i]);
+        } else if(strncmp(arg, "-j", 2)==0&&arg[2]){
+            threads=atoi(arg+2);
+        } else if(S_EQ(arg, "-o")&&i+1<argc){
+            out_filename=argv[++i];
+        } else if(S_EQ(arg, "-fstream")){
+            flags|=COMPILE_PROCESS_FLAG_STREAMING;
+        } else if(S_EQ(arg, "-w")){
+            flags|=COMPILE_PROCESS_FLAG_NO_WARNINGS;
+        } else if(S_EQ(arg, "-farena-report")){
+            flags|=COMPILE_PROCESS_FLAG_ARENA_REPORT;
+        } else if(S_EQ(arg, "-ftime-report")){
+            flags|=COMPILE_PROCESS_FLAG_TIME_REPORT;
+        } else if(S_EQ(arg, "-I")&&i+1<argc){
+            vector_push(include_dirs, &argv[++i]);
+        } else if(strncmp(arg, "-I", 2)==0&&arg[2]){
+            const char* dir=arg+2;
+            vector_push(include_dirs, &dir);
+        } else if(S_EQ(arg, "-emit-pch")){
+            flags|=COMPILE_PROCESS_FLAG_EMIT_PCH;
+        } else if(S_EQ(arg, "-include-pch")&&i+1<argc){
+            options.include_pch=argv[++i];
+        } else if(strncmp(arg, "-ftoken-cache=", 14)==0&&arg[14]){
+            options.cache_dir=arg+14;
+        } else if(arg[0]=='-'){
+            usage(argv[0]);
+            return -1;
+        } else {
+            vector_push(filenames, &arg);
+        }
+    }
+
+    //没有给出文件时沿用原来的默认输入
+    if(vector_empty(filenames)){
+        const char* filename="./test.c";
+        vector_push(filenames, &filename);
+        if(!out_filename){
+            out_filename="./test";
+        }
+    }
+
+    options.include_dirs=vector_data_ptr(include_dirs);
+    options.include_dir_count=vector_count(include_dirs);
+
+    int total=vector_count(filenames);
+    if(out_filename&&total>1){
+        fprintf(stderr, "编译多个文件时不能使用-o\n");
+        return -1;
+    }
+    if(threads<1){
+        threads=1;
+    }
+    if(threads>total){
+        threads=total;
+    }
+
+    struct compile_jobs jobs={.total=total, .flags=flags, .options=options, .next=0};
+    jobs.jobs=calloc(total, sizeof(struct compile_job));
+    pthread_mutex_init(&jobs.lock, NULL);
+    for(int i=0;i<total;i++){
+        jobs.jobs[i].filename=vector_peek_ptr_at(filenames, i);
+        if(out_filename){
+            jobs.jobs[i].out_filename=strdup(out_filename);
+        } else if(flags&COMPILE_PROCESS_FLAG_EMIT_PCH){
+            //头文件名去掉.c不会变，不能覆盖头文件本身
+            jobs.jobs[i].out_filename=malloc(strlen(jobs.jobs[i].filename)+sizeof(".pch"));
+            sprintf(jobs.jobs[i].out_filename, "%s.pch", jobs.jobs[i].filename);
+        } else {
+            jobs.jobs[i].out_filename=compile_out_filename(jobs.jobs[i].filename);
+        }
+    }
+
+    //编译程序，只有一个线程时直接在主线程里完成
+    if(threads==1){
+        compile_worker(&jobs);
     } else {
-        printf("发生了未知的错误\n");
+        pthread_t* workers=calloc(threads, sizeof(pthread_t));
+        for(int i=0;i<threads;i++){
+            pthread_create(&workers[i], NULL, compile_worker, &jobs);
+        }
+        for(int i=0;i<threads;i++){
+            pthread_join(workers[i], NULL);
+        }
+        free(workers);
+    }
+
+    //获取编译返回信息
+    int failed=0;
+    for(int i=0;i<total;i++){
+        struct compile_job* job=&jobs.jobs[i];
+        if(total>1){
+            printf("%s：", job->filename);
+        }
+        if(job->res==COMPILOR_FILE_COMPLETE_OK){
+            printf("编译完成\n");
+        } else if(job->res==COMPILOR_FAILED_WITH_ERRORS){
+            printf("发生了已知错误\n");
+            failed++;
+        } else {
+            printf("发生了未知的错误\n");
+            failed++;
+        }
+        free(job->out_filename);
     }
-    
-    return 0;
-}
\ No newline at end of file
+
+    pthread_mutex_destroy(&jobs.lock);
+    free(jobs.jobs);
+    vector_free(filenames);
+    vector_free(include_dirs);
+    return failed?-1:0;
+}
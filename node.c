@@ -2,42 +2,124 @@
 #include "helpers/vector.h"
 #include <assert.h>
 
-struct vector* node_vector=NULL;
-struct vector* node_vector_root =NULL;
+static const char* node_type_names[NODE_TYPE_TOTAL]={
+    [NODE_TYPE_EXPRESSION]="expression",
+    [NODE_TYPE_EXPRESSION_PARENTHESES]="expression_parentheses",
+    [NODE_TYPE_NUMBER]="number",
+    [NODE_TYPE_IDENTIFIER]="identifier",
+    [NODE_TYPE_STRING]="string",
+    [NODE_TYPE_VARIABLE]="variable",
+    [NODE_TYPE_VARIABLE_LIST]="variable_list",
+    [NODE_TYPE_FUNCTION]="function",
+    [NODE_TYPE_BODY]="body",
+    [NODE_TYPE_STATMENT_RETURN]="statment_return",
+    [NODE_TYPE_STATMENT_IF]="statment_if",
+    [NODE_TYPE_STATMENT_ELSE]="statment_else",
+    [NODE_TYPE_STATMENT_WHILE]="statment_while",
+    [NODE_TYPE_STATMENT_DO_WHILE]="statment_do_while",
+    [NODE_TYPE_STATMENT_FOR]="statment_for",
+    [NODE_TYPE_STATMENT_BREAK]="statment_break",
+    [NODE_TYPE_STATMENT_CONTINUE]="statment_continue",
+    [NODE_TYPE_STATMENT_SWITCH]="statment_switch",
+    [NODE_TYPE_STATMENT_CASE]="statment_case",
+    [NODE_TYPE_STATMENT_DEFAULT]="statment_default",
+    [NODE_TYPE_STATMENT_GOTO]="statment_goto",
+    [NODE_TYPE_NUARY]="nuary",
+    [NODE_TYPE_TENARY]="tenary",
+    [NODE_TYPE_LABEL]="label",
+    [NODE_TYPE_STRUCT]="struct",
+    [NODE_TYPE_UNION]="union",
+    [NODE_TYPE_BRACKET]="bracket",
+    [NODE_TYPE_CAST]="cast",
+    [NODE_TYPE_SIZEOF]="sizeof",
+    [NODE_TYPE_BLANK]="blank"
+};
 
-void node_set_vector(struct vector* vec, struct vector* root_vec){
-    node_vector=vec;
-    node_vector_root=root_vec;
+//清空节点数组并放回0号空节点，NODE_REF_NULL不会指向真正的节点
+void node_storage_reset(struct compile_process* process){
+    vector_clear(process->nodes);
+    vector_clear(process->node_children);
+    vector_clear(process->node_vec);
+    vector_clear(process->node_tree_vec);
+    vector_push(process->nodes, &(struct node){.type=NODE_TYPE_BLANK});
 }
 
-void node_push(struct node* node){
-    vector_push(node_vector,&node);
+void node_push(struct compile_process* process, node_ref ref){
+    vector_push(process->node_vec,&ref);
 }
 
-struct node* node_peek_or_null(){
-    return vector_back_or_null(node_vector);
+node_ref node_peek_or_null(struct compile_process* process){
+    node_ref* ref=vector_back_or_null(process->node_vec);
+    return ref?*ref:NODE_REF_NULL;
 }
 
-struct node* node_peek(){
-    return *(struct node**)(vector_back(node_vector));
+node_ref node_peek(struct compile_process* process){
+    return *(node_ref*)(vector_back(process->node_vec));
 }
 
-struct node* node_pop(){
-    struct node* last_node=vector_back_ptr(node_vector);
-    struct node* last_node_root=vector_empty(node_vector_root)?NULL:vector_back_ptr(node_vector_root);
+node_ref node_pop(struct compile_process* process){
+    node_ref last_node=node_peek(process);
+    node_ref last_node_root=vector_empty(process->node_tree_vec)?NODE_REF_NULL:*(node_ref*)vector_back(process->node_tree_vec);
 
-    vector_pop(node_vector);
+    vector_pop(process->node_vec);
     if(last_node==last_node_root){
-        vector_pop(node_vector_root);
+        vector_pop(process->node_tree_vec);
     }
 
     return last_node;
 }
 
-struct node* node_create(struct node* _node){
-    struct node* node=malloc(sizeof(struct node));
-    memcpy(node,_node,sizeof(struct node));
+//返回的指针在下一次node_create之前有效，需要长期保存的地方应当保存node_ref
+struct node* node_get(struct compile_process* process, node_ref ref){
+    if(ref==NODE_REF_NULL){
+        return NULL;
+    }
+    return (struct node*)vector_data_ptr(process->nodes)+ref;
+}
+
+node_ref node_create(struct compile_process* process, struct node* _node){
+    node_ref ref=vector_count(process->nodes);
+    vector_push(process->nodes, _node);
     #warning "此处应设置绑定的函数和绑定的对象"
-    node_push(node);
-    return node;
-}
\ No newline at end of file
+    node_push(process, ref);
+    return ref;
+}
+
+//把total个子节点拷贝到node_children的末尾，同一个节点的子节点总是相邻的
+struct node_list node_list_create(struct compile_process* process, node_ref* refs, int total){
+    struct node_list list={.start=vector_count(process->node_children), .count=total};
+    for(int i=0;i<total;i++){
+        vector_push(process->node_children, &refs[i]);
+    }
+    return list;
+}
+
+node_ref node_list_at(struct compile_process* process, struct node_list list, uint32_t index){
+    assert(index<list.count);
+    return ((node_ref*)vector_data_ptr(process->node_children))[list.start+index];
+}
+
+//refs正好是最后创建的total个节点并且不再被引用时，从节点数组末尾去掉它们，否则什么也不做
+//只用于没有子节点的节点，node_children里没有需要一起去掉的内容
+void node_release_tail(struct compile_process* process, node_ref* refs, int total){
+    //refs指向的节点都还在数组里，节点数不少于total
+    node_ref first=vector_count(process->nodes)-total;
+    for(int i=0;i<total;i++){
+        if(refs[i]!=first+(node_ref)i){
+            return;
+        }
+    }
+    vector_pop_multiple_at(process->nodes, first, total);
+}
+
+const char* node_type_name(int type){
+    return type>=0&&type<NODE_TYPE_TOTAL?node_type_names[type]:NULL;
+}
+
+//binded.function要等语法分析能读出函数之后才会设置，到那时再按函数分别统计
+void node_stats_report(struct compile_process* process, FILE* out){
+    int total=vector_count(process->nodes)-1;
+    int children=vector_count(process->node_children);
+    fprintf(out, "语法树：%i个节点%zu字节，子节点列表%zu字节\n",
+        total, total*sizeof(struct node), children*sizeof(node_ref));
+}
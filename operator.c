@@ -0,0 +1,91 @@
+#include "compiler.h"
+
+//运算符的最长匹配状态机：状态就是目前读到的运算符，读到下一个字符时查表转移，
+//查不到就停下来。".."不是合法的运算符，只作为读"..."的中间状态存在
+#define OPERATOR_STATE_DOT_DOT OPERATOR_TOTAL
+#define OPERATOR_STATE_TOTAL (OPERATOR_TOTAL+1)
+
+static const unsigned char operator_transitions[OPERATOR_STATE_TOTAL][128]={
+    [OPERATOR_NONE]={
+        ['+']=OPERATOR_PLUS, ['-']=OPERATOR_MINUS, ['*']=OPERATOR_STAR, ['/']=OPERATOR_SLASH, ['%']=OPERATOR_PERCENT, ['!']=OPERATOR_NOT,
+        ['^']=OPERATOR_XOR, ['~']=OPERATOR_BITWISE_NOT, ['?']=OPERATOR_QUESTION, [',']=OPERATOR_COMMA, ['.']=OPERATOR_DOT, ['(']=OPERATOR_LEFT_PAREN,
+        ['[']=OPERATOR_LEFT_BRACKET, ['=']=OPERATOR_ASSIGN, ['<']=OPERATOR_LESS, ['>']=OPERATOR_GREATER, ['|']=OPERATOR_BITWISE_OR, ['&']=OPERATOR_BITWISE_AND,
+    },
+    [OPERATOR_PLUS]={['=']=OPERATOR_PLUS_ASSIGN, ['+']=OPERATOR_INCREMENT},
+    [OPERATOR_MINUS]={['=']=OPERATOR_MINUS_ASSIGN, ['-']=OPERATOR_DECREMENT, ['>']=OPERATOR_ARROW},
+    [OPERATOR_STAR]={['=']=OPERATOR_STAR_ASSIGN},
+    [OPERATOR_SLASH]={['=']=OPERATOR_SLASH_ASSIGN},
+    [OPERATOR_PERCENT]={['=']=OPERATOR_PERCENT_ASSIGN},
+    [OPERATOR_NOT]={['=']=OPERATOR_NOT_EQUAL},
+    [OPERATOR_XOR]={['=']=OPERATOR_XOR_ASSIGN},
+    [OPERATOR_DOT]={['.']=OPERATOR_STATE_DOT_DOT},
+    [OPERATOR_ASSIGN]={['=']=OPERATOR_EQUAL},
+    [OPERATOR_LESS]={['<']=OPERATOR_SHIFT_LEFT, ['=']=OPERATOR_LESS_EQUAL},
+    [OPERATOR_GREATER]={['>']=OPERATOR_SHIFT_RIGHT, ['=']=OPERATOR_GREATER_EQUAL},
+    [OPERATOR_BITWISE_OR]={['=']=OPERATOR_OR_ASSIGN, ['|']=OPERATOR_LOGICAL_OR},
+    [OPERATOR_BITWISE_AND]={['=']=OPERATOR_AND_ASSIGN, ['&']=OPERATOR_LOGICAL_AND},
+    [OPERATOR_SHIFT_LEFT]={['=']=OPERATOR_SHIFT_LEFT_ASSIGN},
+    [OPERATOR_SHIFT_RIGHT]={['=']=OPERATOR_SHIFT_RIGHT_ASSIGN},
+    [OPERATOR_STATE_DOT_DOT]={['.']=OPERATOR_ELLIPSIS},
+};
+
+static const char* operator_names[OPERATOR_TOTAL]={
+    [OPERATOR_PLUS]="+",
+    [OPERATOR_MINUS]="-",
+    [OPERATOR_STAR]="*",
+    [OPERATOR_SLASH]="/",
+    [OPERATOR_PERCENT]="%",
+    [OPERATOR_NOT]="!",
+    [OPERATOR_XOR]="^",
+    [OPERATOR_BITWISE_NOT]="~",
+    [OPERATOR_QUESTION]="?",
+    [OPERATOR_COMMA]=",",
+    [OPERATOR_DOT]=".",
+    [OPERATOR_LEFT_PAREN]="(",
+    [OPERATOR_LEFT_BRACKET]="[",
+    [OPERATOR_ASSIGN]="=",
+    [OPERATOR_LESS]="<",
+    [OPERATOR_GREATER]=">",
+    [OPERATOR_BITWISE_OR]="|",
+    [OPERATOR_BITWISE_AND]="&",
+    [OPERATOR_PLUS_ASSIGN]="+=",
+    [OPERATOR_MINUS_ASSIGN]="-=",
+    [OPERATOR_STAR_ASSIGN]="*=",
+    [OPERATOR_SLASH_ASSIGN]="/=",
+    [OPERATOR_PERCENT_ASSIGN]="%=",
+    [OPERATOR_XOR_ASSIGN]="^=",
+    [OPERATOR_OR_ASSIGN]="|=",
+    [OPERATOR_AND_ASSIGN]="&=",
+    [OPERATOR_SHIFT_LEFT_ASSIGN]="<<=",
+    [OPERATOR_SHIFT_RIGHT_ASSIGN]=">>=",
+    [OPERATOR_INCREMENT]="++",
+    [OPERATOR_DECREMENT]="--",
+    [OPERATOR_SHIFT_LEFT]="<<",
+    [OPERATOR_SHIFT_RIGHT]=">>",
+    [OPERATOR_LESS_EQUAL]="<=",
+    [OPERATOR_GREATER_EQUAL]=">=",
+    [OPERATOR_EQUAL]="==",
+    [OPERATOR_NOT_EQUAL]="!=",
+    [OPERATOR_LOGICAL_AND]="&&",
+    [OPERATOR_LOGICAL_OR]="||",
+    [OPERATOR_ARROW]="->",
+    [OPERATOR_ELLIPSIS]="...",
+};
+
+int operator_next_state(int state, char c){
+    if((unsigned char)c>=128){
+        return OPERATOR_NONE;
+    }
+    return operator_transitions[state][(unsigned char)c];
+}
+
+bool operator_state_is_accepting(int state){
+    return state>OPERATOR_NONE&&state<OPERATOR_TOTAL;
+}
+
+const char* operator_name(int op){
+    if(!operator_state_is_accepting(op)){
+        return NULL;
+    }
+    return operator_names[op];
+}
@@ -1,78 +1,565 @@
 #include "compiler.h"
 #include "helpers/vector.h"
+#include <stdint.h>
 
-static struct compile_process* current_process;
-static struct token* parser_last_token;
 
 
-
-static void parser_ignore_nl_or_comment(struct token* token){
-    while(token&& token_is_nl_or_newline_seperator(token)){
-        //跳过当前的token
-        vector_peek(current_process->token_vec);
-        token=vector_peek_no_increment(current_process->token_vec);
+//换行和注释在token_stream的附属表里，流中的下一个就是有意义的token
+static struct token* token_next(struct compile_process* process){
+    struct token_stream* stream=process->token_stream;
+    struct token* next_token=token_stream_get(stream, stream->pindex, &process->parser.last_token);
+    if(!next_token){
+        return NULL;
     }
-}
-static struct token* token_next(){
-    struct token* next_token=vector_peek_no_increment(current_process->token_vec);
-    parser_ignore_nl_or_comment(next_token);
-    current_process->pos=next_token->pos;
-    parser_last_token=next_token;
-    return vector_peek(current_process->token_vec);
+    process->offset=next_token->offset;
+    stream->pindex++;
+    token_stream_discard_consumed(stream);
+    return next_token;
 }
 
-static struct token* token_peek_next(){
-    struct token* next_token=vector_peek_no_increment(current_process->token_vec);
-    parser_ignore_nl_or_comment(next_token);
-    return vector_peek_no_increment(current_process->token_vec);
+//流式读取时偷看会让词法分析器往后读，错误位置还要留在语法分析读到的token上
+static struct token* token_peek_next(struct compile_process* process){
+    struct token_stream* stream=process->token_stream;
+    uint32_t offset=process->offset;
+    struct token* token=token_stream_get(stream, stream->pindex, &process->parser.peek_token);
+    process->offset=offset;
+    return token;
 }
-void parse_single_to_node(){
-    struct token* token=token_next();
-    struct node* node=NULL;
+
+//数字常量token的NUMBER_TYPE_*对应的节点类型，int和long分别是32位和64位
+static const uint8_t parser_number_types[]={
+    [NUMBER_TYPE_NORMAL]=DATA_TYPE_INT,
+    [NUMBER_TYPE_LONG]=DATA_TYPE_LONG,
+    [NUMBER_TYPE_LONG_LONG]=DATA_TYPE_LONG_LONG,
+    [NUMBER_TYPE_FLOAT]=DATA_TYPE_FLOAT,
+    [NUMBER_TYPE_DOUBLE]=DATA_TYPE_DOUBLE
+};
+
+void parse_single_to_node(struct compile_process* process){
+    struct token* token=token_next(process);
     switch(token->type){
         case TOKEN_TYPE_NUMBER:
-        node=node_create(&(struct node){.type=NODE_TYPE_NUMBER, .llnum=token->llnum});
+        //浮点数的dnum和llnum共用同一块内存，一起拷贝过去
+        node_create(process, &(struct node){.type=NODE_TYPE_NUMBER, .offset=token->offset,
+            .num={.type=parser_number_types[token->num.type], .is_unsigned=token->num.is_unsigned}, .llnum=token->llnum});
         break;
         case TOKEN_TYPE_IDENTIFIER:
-        node=node_create(&(struct node){.type=NODE_TYPE_IDENTIFIER, .sval=token->sval});
+        node_create(process, &(struct node){.type=NODE_TYPE_IDENTIFIER, .offset=token->offset, .sval=token->sval});
         break;
 
         case TOKEN_TYPE_STRING:
-        node=node_create(&(struct node){.type=NODE_TYPE_STRING, .sval=token->sval});
+        node_create(process, &(struct node){.type=NODE_TYPE_STRING, .offset=token->offset, .span=token->span});
         break;
 
 
         default:
-        compiler_error(current_process, "当前token无法生成语法树节点");
+        compiler_error(process, "当前token无法生成语法树节点");
     }
 }
-int parse_next(){
-    struct token* token=token_peek_next();
-    if(!token){
-        return -1;
+//表达式的语法分析：优先级爬升，操作数和运算符各用一个栈
+//读到运算符时先把栈顶优先级更高的运算符归约成节点再压栈，括号、?和函数调用也作为标记压进运算符栈
+//每个token只看一次，不需要回溯；嵌套的深度只影响堆上两个栈的大小，不占用调用栈
+
+enum{
+    PARSER_PRECEDENCE_NONE,
+    PARSER_PRECEDENCE_COMMA,
+    PARSER_PRECEDENCE_ASSIGNMENT,
+    PARSER_PRECEDENCE_CONDITIONAL,
+    PARSER_PRECEDENCE_LOGICAL_OR,
+    PARSER_PRECEDENCE_LOGICAL_AND,
+    PARSER_PRECEDENCE_BITWISE_OR,
+    PARSER_PRECEDENCE_BITWISE_XOR,
+    PARSER_PRECEDENCE_BITWISE_AND,
+    PARSER_PRECEDENCE_EQUALITY,
+    PARSER_PRECEDENCE_RELATIONAL,
+    PARSER_PRECEDENCE_SHIFT,
+    PARSER_PRECEDENCE_ADDITIVE,
+    PARSER_PRECEDENCE_MULTIPLICATIVE,
+    //前缀的一元运算符、cast和sizeof
+    PARSER_PRECEDENCE_PREFIX,
+    //.、->以及后缀的++、--、函数调用和下标
+    PARSER_PRECEDENCE_POSTFIX
+};
+
+enum{
+    //已经可以归约的运算符
+    PARSER_OPERATOR_PREFIX,
+    PARSER_OPERATOR_CAST,
+    PARSER_OPERATOR_SIZEOF,
+    PARSER_OPERATOR_BINARY,
+    //已经读到':'，等待第三个操作数的?:
+    PARSER_OPERATOR_TERNARY,
+    //下面这些是还没有结束的标记，归约到它们就停下
+    PARSER_OPERATOR_PARENTHESES,
+    PARSER_OPERATOR_CALL,
+    PARSER_OPERATOR_BRACKET,
+    //还没有读到':'的?
+    PARSER_OPERATOR_CONDITION
+};
+
+//二元运算符的优先级，0表示不是二元运算符
+static const uint8_t parser_binary_precedence[OPERATOR_TOTAL]={
+    [OPERATOR_COMMA]=PARSER_PRECEDENCE_COMMA,
+    [OPERATOR_ASSIGN]=PARSER_PRECEDENCE_ASSIGNMENT,
+    [OPERATOR_PLUS_ASSIGN]=PARSER_PRECEDENCE_ASSIGNMENT,
+    [OPERATOR_MINUS_ASSIGN]=PARSER_PRECEDENCE_ASSIGNMENT,
+    [OPERATOR_STAR_ASSIGN]=PARSER_PRECEDENCE_ASSIGNMENT,
+    [OPERATOR_SLASH_ASSIGN]=PARSER_PRECEDENCE_ASSIGNMENT,
+    [OPERATOR_PERCENT_ASSIGN]=PARSER_PRECEDENCE_ASSIGNMENT,
+    [OPERATOR_XOR_ASSIGN]=PARSER_PRECEDENCE_ASSIGNMENT,
+    [OPERATOR_OR_ASSIGN]=PARSER_PRECEDENCE_ASSIGNMENT,
+    [OPERATOR_AND_ASSIGN]=PARSER_PRECEDENCE_ASSIGNMENT,
+    [OPERATOR_SHIFT_LEFT_ASSIGN]=PARSER_PRECEDENCE_ASSIGNMENT,
+    [OPERATOR_SHIFT_RIGHT_ASSIGN]=PARSER_PRECEDENCE_ASSIGNMENT,
+    [OPERATOR_LOGICAL_OR]=PARSER_PRECEDENCE_LOGICAL_OR,
+    [OPERATOR_LOGICAL_AND]=PARSER_PRECEDENCE_LOGICAL_AND,
+    [OPERATOR_BITWISE_OR]=PARSER_PRECEDENCE_BITWISE_OR,
+    [OPERATOR_XOR]=PARSER_PRECEDENCE_BITWISE_XOR,
+    [OPERATOR_BITWISE_AND]=PARSER_PRECEDENCE_BITWISE_AND,
+    [OPERATOR_EQUAL]=PARSER_PRECEDENCE_EQUALITY,
+    [OPERATOR_NOT_EQUAL]=PARSER_PRECEDENCE_EQUALITY,
+    [OPERATOR_LESS]=PARSER_PRECEDENCE_RELATIONAL,
+    [OPERATOR_GREATER]=PARSER_PRECEDENCE_RELATIONAL,
+    [OPERATOR_LESS_EQUAL]=PARSER_PRECEDENCE_RELATIONAL,
+    [OPERATOR_GREATER_EQUAL]=PARSER_PRECEDENCE_RELATIONAL,
+    [OPERATOR_SHIFT_LEFT]=PARSER_PRECEDENCE_SHIFT,
+    [OPERATOR_SHIFT_RIGHT]=PARSER_PRECEDENCE_SHIFT,
+    [OPERATOR_PLUS]=PARSER_PRECEDENCE_ADDITIVE,
+    [OPERATOR_MINUS]=PARSER_PRECEDENCE_ADDITIVE,
+    [OPERATOR_STAR]=PARSER_PRECEDENCE_MULTIPLICATIVE,
+    [OPERATOR_SLASH]=PARSER_PRECEDENCE_MULTIPLICATIVE,
+    [OPERATOR_PERCENT]=PARSER_PRECEDENCE_MULTIPLICATIVE,
+    //成员访问的右边只当作普通的操作数，是不是成员名留给语义分析检查
+    [OPERATOR_DOT]=PARSER_PRECEDENCE_POSTFIX,
+    [OPERATOR_ARROW]=PARSER_PRECEDENCE_POSTFIX
+};
+
+//赋值、?:和前缀运算符是右结合的，其余都是左结合
+static bool parser_right_associative(int precedence){
+    return precedence==PARSER_PRECEDENCE_ASSIGNMENT||precedence==PARSER_PRECEDENCE_CONDITIONAL||precedence==PARSER_PRECEDENCE_PREFIX;
+}
+
+static bool parser_is_prefix_operator(int op){
+    switch(op){
+        case OPERATOR_PLUS:
+        case OPERATOR_MINUS:
+        case OPERATOR_NOT:
+        case OPERATOR_BITWISE_NOT:
+        case OPERATOR_STAR:
+        case OPERATOR_BITWISE_AND:
+        case OPERATOR_INCREMENT:
+        case OPERATOR_DECREMENT:
+            return true;
     }
-    int res=0;
-    switch(token->type){
-        case TOKEN_TYPE_NUMBER:
-        case TOKEN_TYPE_IDENTIFIER:
-        case TOKEN_TYPE_STRING:
-         parse_single_to_node();
-        break;
+    return false;
+}
+
+static bool parser_is_datatype_start(struct token* token){
+    if(!token||token->type!=TOKEN_TYPE_KEYWORD){
+        return false;
+    }
+    switch(token->kw){
+        case KEYWORD_UNSIGNED:
+        case KEYWORD_SIGNED:
+        case KEYWORD_CHAR:
+        case KEYWORD_INT:
+        case KEYWORD_SHORT:
+        case KEYWORD_LONG:
+        case KEYWORD_FLOAT:
+        case KEYWORD_DOUBLE:
+        case KEYWORD_VOID:
+        case KEYWORD_STRUCT:
+        case KEYWORD_UNION:
+        case KEYWORD_CONST:
+        case KEYWORD_RESTRICT:
+            return true;
+    }
+    return false;
+}
+
+static struct parser_operator* parser_operator_top(struct compile_process* process, int base){
+    struct vector* operators=process->parser_operators;
+    return vector_count(operators)>base?vector_back(operators):NULL;
+}
+
+static void parser_operator_push(struct compile_process* process, struct parser_operator* op){
+    vector_push(process->parser_operators, op);
+}
+
+//操作数栈顶的total个节点成为新节点的子节点，新节点压回操作数栈
+//子节点都是常量时新节点直接折叠成常量，不再需要的子节点在节点数组末尾时一起回收
+static node_ref parser_make_node(struct compile_process* process, struct node* node, int total){
+    int count=vector_count(process->node_vec);
+    node_ref* refs=(node_ref*)vector_data_ptr(process->node_vec)+count-total;
+    if(fold_node(process, node, refs, total)){
+        node_release_tail(process, refs, total);
+    } else {
+        node->children=node_list_create(process, refs, total);
+    }
+    vector_pop_multiple_at(process->node_vec, count-total, total);
+    return node_create(process, node);
+}
+
+static void parser_expect_symbol(struct compile_process* process, char c, const char* message){
+    struct token* token=token_next(process);
+    if(!token||!token_is_symbol(token, c)){
+        compiler_error(process, "%s", message);
+    }
+}
+
+static void parser_datatype_error(struct compile_process* process){
+    compiler_error(process, "类型名不正确\n");
+}
+
+//cast和sizeof括号里的类型名：类型关键字、修饰和后面的*，struct、union的名字节点压进操作数栈
+//返回是否压入了名字节点
+static bool parse_datatype(struct compile_process* process, struct node_datatype* datatype){
+    int base=-1;
+    int longs=0;
+    bool has_int=false;
+    bool has_name=false;
+    int flags=0;
+    for(struct token* token=token_peek_next(process);token&&token->type==TOKEN_TYPE_KEYWORD;token=token_peek_next(process)){
+        int kw=token->kw;
+        int type=-1;
+        switch(kw){
+            case KEYWORD_UNSIGNED:
+            case KEYWORD_SIGNED:
+            {
+                int flag=kw==KEYWORD_UNSIGNED?DATA_TYPE_FLAG_UNSIGNED:DATA_TYPE_FLAG_SIGNED;
+                if(flags&(DATA_TYPE_FLAG_UNSIGNED|DATA_TYPE_FLAG_SIGNED)){
+                    parser_datatype_error(process);
+                }
+                flags|=flag;
+                break;
+            }
+            case KEYWORD_CONST:
+                flags|=DATA_TYPE_FLAG_CONST;
+                break;
+            case KEYWORD_RESTRICT:
+                break;
+            case KEYWORD_LONG:
+                if(++longs>2){
+                    parser_datatype_error(process);
+                }
+                break;
+            case KEYWORD_INT:
+                if(has_int){
+                    parser_datatype_error(process);
+                }
+                has_int=true;
+                break;
+            case KEYWORD_CHAR: type=DATA_TYPE_CHAR; break;
+            case KEYWORD_SHORT: type=DATA_TYPE_SHORT; break;
+            case KEYWORD_FLOAT: type=DATA_TYPE_FLOAT; break;
+            case KEYWORD_DOUBLE: type=DATA_TYPE_DOUBLE; break;
+            case KEYWORD_VOID: type=DATA_TYPE_VOID; break;
+            case KEYWORD_STRUCT: type=DATA_TYPE_STRUCT; break;
+            case KEYWORD_UNION: type=DATA_TYPE_UNION; break;
+            default:
+                goto done;
+        }
+        if(type!=-1){
+            if(base!=-1){
+                parser_datatype_error(process);
+            }
+            base=type;
+        }
+        uint32_t offset=token->offset;
+        token_next(process);
+        if(type==DATA_TYPE_STRUCT||type==DATA_TYPE_UNION){
+            struct token* name=token_next(process);
+            if(!name||name->type!=TOKEN_TYPE_IDENTIFIER){
+                compiler_error(process, "%s后面缺少名字\n", keyword_name(kw));
+            }
+            node_create(process, &(struct node){.type=type==DATA_TYPE_STRUCT?NODE_TYPE_STRUCT:NODE_TYPE_UNION, .offset=offset, .sval=name->sval});
+            has_name=true;
+        }
     }
-    return 0;
+done:
+    //只有signed、unsigned、long时是int；int只能和short、long一起出现，long只能修饰int和double
+    if(base==-1){
+        if(!longs&&!has_int&&!(flags&(DATA_TYPE_FLAG_UNSIGNED|DATA_TYPE_FLAG_SIGNED))){
+            parser_datatype_error(process);
+        }
+        base=longs==2?DATA_TYPE_LONG_LONG:longs==1?DATA_TYPE_LONG:DATA_TYPE_INT;
+    } else if(base==DATA_TYPE_DOUBLE&&longs==1&&!has_int){
+        //long double按double处理
+    } else if((has_int&&base!=DATA_TYPE_SHORT)||longs){
+        parser_datatype_error(process);
+    }
+    if((flags&(DATA_TYPE_FLAG_UNSIGNED|DATA_TYPE_FLAG_SIGNED))&&base>DATA_TYPE_LONG_LONG){
+        parser_datatype_error(process);
+    }
+    if((flags&(DATA_TYPE_FLAG_UNSIGNED|DATA_TYPE_FLAG_SIGNED))&&base==DATA_TYPE_VOID){
+        parser_datatype_error(process);
+    }
+
+    int pointer_depth=0;
+    for(struct token* token=token_peek_next(process);token;token=token_peek_next(process)){
+        if(token_is_operator(token, OPERATOR_STAR)){
+            pointer_depth++;
+        } else if(!token_is_keyword(token, KEYWORD_CONST)&&!token_is_keyword(token, KEYWORD_RESTRICT)){
+            break;
+        }
+        token_next(process);
+    }
+    *datatype=(struct node_datatype){.type=base, .flags=flags, .pointer_depth=pointer_depth};
+    parser_expect_symbol(process, ')', "类型名后面缺少')'\n");
+    return has_name;
+}
+
+//栈顶的运算符归约成节点
+static void parser_reduce(struct compile_process* process){
+    struct parser_operator op=*(struct parser_operator*)vector_back(process->parser_operators);
+    vector_pop(process->parser_operators);
+    switch(op.kind){
+        case PARSER_OPERATOR_PREFIX:
+            parser_make_node(process, &(struct node){.type=NODE_TYPE_NUARY, .offset=op.offset, .op=op.op}, 1);
+            break;
+        case PARSER_OPERATOR_CAST:
+            //struct、union的名字节点在操作数之前
+            parser_make_node(process, &(struct node){.type=NODE_TYPE_CAST, .offset=op.offset, .datatype=op.datatype}, 1+op.operands);
+            break;
+        case PARSER_OPERATOR_SIZEOF:
+            parser_make_node(process, &(struct node){.type=NODE_TYPE_SIZEOF, .offset=op.offset}, 1);
+            break;
+        case PARSER_OPERATOR_BINARY:
+            parser_make_node(process, &(struct node){.type=NODE_TYPE_EXPRESSION, .offset=op.offset, .op=op.op}, 2);
+            break;
+        case PARSER_OPERATOR_TERNARY:
+            parser_make_node(process, &(struct node){.type=NODE_TYPE_TENARY, .offset=op.offset}, 3);
+            break;
+    }
+}
+
+//归约所有比precedence结合得更紧的运算符，遇到还没有结束的括号标记时停下
+static struct parser_operator* parser_reduce_above(struct compile_process* process, int base, int precedence){
+    struct parser_operator* top;
+    while((top=parser_operator_top(process, base))&&top->kind<PARSER_OPERATOR_PARENTHESES){
+        if(top->precedence<precedence||(top->precedence==precedence&&parser_right_associative(precedence))){
+            break;
+        }
+        parser_reduce(process);
+    }
+    return top;
+}
+
+//读到一个完整的操作数为止：前缀运算符、cast和没有结束的括号压进运算符栈，最后的基本操作数压进操作数栈
+static void parse_operand(struct compile_process* process){
+    while(1){
+        struct token* token=token_peek_next(process);
+        if(!token){
+            compiler_error(process, "表达式没有结束\n");
+        }
+        uint32_t offset=token->offset;
+        if(token->type==TOKEN_TYPE_NUMBER||token->type==TOKEN_TYPE_IDENTIFIER||token->type==TOKEN_TYPE_STRING){
+            parse_single_to_node(process);
+            return;
+        }
+        if(token_is_operator(token, OPERATOR_LEFT_PAREN)){
+            token_next(process);
+            struct parser_operator op={.kind=PARSER_OPERATOR_PARENTHESES, .offset=offset};
+            if(parser_is_datatype_start(token_peek_next(process))){
+                op.kind=PARSER_OPERATOR_CAST;
+                op.precedence=PARSER_PRECEDENCE_PREFIX;
+                op.operands=parse_datatype(process, &op.datatype);
+            }
+            parser_operator_push(process, &op);
+            continue;
+        }
+        if(token->type==TOKEN_TYPE_OPERATOR&&parser_is_prefix_operator(token->op)){
+            parser_operator_push(process, &(struct parser_operator){.kind=PARSER_OPERATOR_PREFIX, .op=token->op, .precedence=PARSER_PRECEDENCE_PREFIX, .offset=offset});
+            token_next(process);
+            continue;
+        }
+        if(token_is_keyword(token, KEYWORD_SIZEOF)){
+            token_next(process);
+            parser_operator_push(process, &(struct parser_operator){.kind=PARSER_OPERATOR_SIZEOF, .precedence=PARSER_PRECEDENCE_PREFIX, .offset=offset});
+            token=token_peek_next(process);
+            if(!token||!token_is_operator(token, OPERATOR_LEFT_PAREN)){
+                continue;
+            }
+            token_next(process);
+            if(!parser_is_datatype_start(token_peek_next(process))){
+                //sizeof(表达式)，括号照常压栈，括号后面还可以接后缀运算符
+                parser_operator_push(process, &(struct parser_operator){.kind=PARSER_OPERATOR_PARENTHESES, .offset=offset});
+                continue;
+            }
+            //sizeof(类型名)本身就是完整的操作数
+            vector_pop(process->parser_operators);
+            struct node node={.type=NODE_TYPE_SIZEOF, .flags=NODE_FLAG_SIZEOF_TYPE, .offset=offset};
+            int total=parse_datatype(process, &node.datatype);
+            parser_make_node(process, &node, total);
+            return;
+        }
+        if(token->type==TOKEN_TYPE_KEYWORD){
+            compiler_error(process, "表达式中不能出现关键字%s\n", keyword_name(token->kw));
+        }
+        compiler_error(process, "表达式中缺少操作数\n");
+    }
+}
+
+//')'、']'结束最近的括号标记，不属于这个表达式时返回false
+static bool parse_close(struct compile_process* process, int base, char c){
+    struct parser_operator* top=parser_reduce_above(process, base, PARSER_PRECEDENCE_NONE);
+    if(!top){
+        return false;
+    }
+    struct parser_operator op=*top;
+    if(c==')'&&op.kind!=PARSER_OPERATOR_PARENTHESES&&op.kind!=PARSER_OPERATOR_CALL){
+        compiler_error(process, op.kind==PARSER_OPERATOR_BRACKET?"缺少']'\n":"?后面缺少':'\n");
+    }
+    if(c==']'&&op.kind!=PARSER_OPERATOR_BRACKET){
+        compiler_error(process, op.kind==PARSER_OPERATOR_CONDITION?"?后面缺少':'\n":"缺少')'\n");
+    }
+    vector_pop(process->parser_operators);
+    token_next(process);
+    switch(op.kind){
+        case PARSER_OPERATOR_PARENTHESES:
+            parser_make_node(process, &(struct node){.type=NODE_TYPE_EXPRESSION_PARENTHESES, .offset=op.offset}, 1);
+            break;
+        case PARSER_OPERATOR_CALL:
+            //函数调用的子节点是被调用的表达式和各个实参
+            parser_make_node(process, &(struct node){.type=NODE_TYPE_EXPRESSION, .offset=op.offset, .op=OPERATOR_LEFT_PAREN}, vector_count(process->node_vec)-op.operands);
+            break;
+        case PARSER_OPERATOR_BRACKET:
+            parser_make_node(process, &(struct node){.type=NODE_TYPE_BRACKET, .offset=op.offset}, 2);
+            break;
+    }
+    return true;
+}
+
+//操作数之后：处理后缀运算符和结束的括号，读到需要下一个操作数的运算符时返回true，表达式结束时返回false
+static bool parse_operator(struct compile_process* process, int base){
+    while(1){
+        struct token* token=token_peek_next(process);
+        if(!token){
+            return false;
+        }
+        uint32_t offset=token->offset;
+        if(token->type==TOKEN_TYPE_SYMBOL){
+            if(token->cval==')'||token->cval==']'){
+                if(!parse_close(process, base, token->cval)){
+                    return false;
+                }
+                continue;
+            }
+            if(token->cval==':'){
+                struct parser_operator* top=parser_reduce_above(process, base, PARSER_PRECEDENCE_NONE);
+                if(!top||top->kind!=PARSER_OPERATOR_CONDITION){
+                    return false;
+                }
+                top->kind=PARSER_OPERATOR_TERNARY;
+                top->precedence=PARSER_PRECEDENCE_CONDITIONAL;
+                token_next(process);
+                return true;
+            }
+            return false;
+        }
+        if(token->type!=TOKEN_TYPE_OPERATOR){
+            return false;
+        }
+
+        int op=token->op;
+        switch(op){
+            case OPERATOR_INCREMENT:
+            case OPERATOR_DECREMENT:
+                parser_reduce_above(process, base, PARSER_PRECEDENCE_POSTFIX);
+                token_next(process);
+                parser_make_node(process, &(struct node){.type=NODE_TYPE_NUARY, .flags=NODE_FLAG_POSTFIX, .offset=offset, .op=op}, 1);
+                continue;
+            case OPERATOR_LEFT_PAREN:
+                parser_reduce_above(process, base, PARSER_PRECEDENCE_POSTFIX);
+                token_next(process);
+                token=token_peek_next(process);
+                if(token&&token_is_symbol(token, ')')){
+                    token_next(process);
+                    parser_make_node(process, &(struct node){.type=NODE_TYPE_EXPRESSION, .offset=offset, .op=OPERATOR_LEFT_PAREN}, 1);
+                    continue;
+                }
+                parser_operator_push(process, &(struct parser_operator){.kind=PARSER_OPERATOR_CALL, .offset=offset, .operands=vector_count(process->node_vec)-1});
+                return true;
+            case OPERATOR_LEFT_BRACKET:
+                parser_reduce_above(process, base, PARSER_PRECEDENCE_POSTFIX);
+                token_next(process);
+                parser_operator_push(process, &(struct parser_operator){.kind=PARSER_OPERATOR_BRACKET, .offset=offset});
+                return true;
+            case OPERATOR_QUESTION:
+                parser_reduce_above(process, base, PARSER_PRECEDENCE_CONDITIONAL);
+                token_next(process);
+                parser_operator_push(process, &(struct parser_operator){.kind=PARSER_OPERATOR_CONDITION, .offset=offset});
+                return true;
+        }
+
+        int precedence=parser_binary_precedence[op];
+        if(!precedence){
+            return false;
+        }
+        struct parser_operator* top=parser_reduce_above(process, base, precedence);
+        token_next(process);
+        //函数调用里的逗号分隔实参，不是逗号运算符
+        if(op==OPERATOR_COMMA&&top&&top->kind==PARSER_OPERATOR_CALL){
+            return true;
+        }
+        parser_operator_push(process, &(struct parser_operator){.kind=PARSER_OPERATOR_BINARY, .op=op, .precedence=precedence, .offset=offset});
+        return true;
+    }
+}
+
+//读取一个完整的表达式，结果压进操作数栈
+static void parse_expression(struct compile_process* process){
+    int base=vector_count(process->parser_operators);
+    do{
+        parse_operand(process);
+    } while(parse_operator(process, base));
+
+    struct parser_operator* top=parser_reduce_above(process, base, PARSER_PRECEDENCE_NONE);
+    if(top){
+        compiler_error(process, top->kind==PARSER_OPERATOR_BRACKET?"缺少']'\n":top->kind==PARSER_OPERATOR_CONDITION?"?后面缺少':'\n":"缺少')'\n");
+    }
+}
+
+//生成下一个语法树节点，没有更多token时返回-1
+int parse_next(struct compile_process* process){
+    struct token* token=token_peek_next(process);
+    for(;token;token=token_peek_next(process)){
+        switch(token->type){
+            case TOKEN_TYPE_NUMBER:
+            case TOKEN_TYPE_IDENTIFIER:
+            case TOKEN_TYPE_STRING:
+            parse_expression(process);
+            return 0;
+            case TOKEN_TYPE_OPERATOR:
+            if(token->op==OPERATOR_LEFT_PAREN||parser_is_prefix_operator(token->op)){
+                parse_expression(process);
+                return 0;
+            }
+            break;
+            case TOKEN_TYPE_KEYWORD:
+            //sizeof也是操作数的开始，跳过它会把后面的括号当成cast或者普通的括号
+            if(token->kw==KEYWORD_SIZEOF){
+                parse_expression(process);
+                return 0;
+            }
+            break;
+        }
+        //其他的运算符、符号和关键字暂时还不能生成节点，先跳过，否则会一直停在这个token上
+        token_next(process);
+    }
+    return -1;
 }
 
 int parse(struct compile_process* process){
-    current_process= process;
-
-    parser_last_token=NULL;
-    node_set_vector(process->node_vec, process->node_tree_vec);
-    struct node* node=NULL;
-    vector_set_peek_pointer(process->token_vec,0);
-    while(parse_next()==0){
-        node=node_peek();
+    memset(&process->parser, 0, sizeof(process->parser));
+    //上一次出错时可能留下没有归约完的运算符
+    vector_clear(process->parser_operators);
+    node_ref node=NODE_REF_NULL;
+    process->token_stream->pindex=0;
+    while(parse_next(process)==0){
+        node=node_peek(process);
         vector_push(process->node_tree_vec,&node);
     }
     
     return PARSE_ALL_OK;
-}
\ No newline at end of file
+}
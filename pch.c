@@ -0,0 +1,380 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/arena.h"
+#include "helpers/intern.h"
+#include "helpers/ptr_map.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//预编译头文件：-emit-pch把一个头文件预处理之后的token、宏表和用到的源码写成一个文件
+//-include-pch在编译开始时把它mmap进来，相当于在编译文件开头#include了这个头文件
+//之后再#include其中的头文件时，include guard和#pragma once照常生效，不会再读取和词法分析
+//token段的格式和token缓存相同，读写都复用token_cache.c
+
+#define PCH_MAGIC "LCPCH"
+//文件格式或者token_cache_tokens有变化时加一
+#define PCH_VERSION 4
+
+#define PCH_NO_STRING UINT32_MAX
+
+enum{
+    PCH_SOURCE_PRAGMA_ONCE=0b00000001,
+    PCH_SOURCE_INCLUDED=0b00000010
+};
+
+enum{
+    PCH_MACRO_FUNCTION_LIKE=0b00000001,
+    PCH_MACRO_VARIADIC=0b00000010
+};
+
+//用到的一份源码，前面的是编译的头文件本身
+struct pch_source{
+    //生成时的偏移，所有源码的base在文件里保持原来的相对位置
+    uint32_t base;
+    uint32_t size;
+    //names中的偏移
+    uint32_t filename;
+    //realpath，不是从文件读取的源码为PCH_NO_STRING
+    uint32_t real_path;
+    //include guard的宏名，没有时为PCH_NO_STRING
+    uint32_t guard;
+    //PCH_SOURCE_*
+    uint32_t flags;
+    //生成时文件的修改时间，文件变了预编译头文件就不能再用
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+};
+
+struct pch_macro{
+    uint32_t name;
+    //PCH_MACRO_*
+    uint32_t flags;
+    //params中的下标
+    uint32_t first_param;
+    uint32_t param_count;
+    //macro_tokens中的下标
+    uint32_t first_token;
+    uint32_t body_count;
+    uint32_t offset;
+    uint32_t reserved;
+};
+
+//文件开头的固定部分，各段的位置都相对文件开头
+struct pch_header{
+    char magic[8];
+    uint32_t version;
+    uint32_t value_size;
+    uint32_t source_count;
+    uint32_t macro_count;
+    uint32_t param_count;
+    uint32_t reserved;
+    //所有源码按生成时的偏移排好，源码之间空出的字节为0，token的偏移就是这里的下标
+    uint64_t text;
+    uint64_t text_size;
+    //struct pch_source
+    uint64_t sources;
+    //struct pch_macro
+    uint64_t macros;
+    //uint32_t，参数名在names中的偏移
+    uint64_t params;
+    //以'\0'结尾的文件名、宏名和参数名
+    uint64_t names;
+    uint64_t names_size;
+    //预处理之后的token
+    struct token_cache_tokens tokens;
+    //所有宏的内容依次排在一起
+    struct token_cache_tokens macro_tokens;
+};
+
+static uint32_t pch_add_name(struct vector* names, const char* name){
+    if(!name){
+        return PCH_NO_STRING;
+    }
+    uint32_t offset=vector_count(names);
+    vector_splice(names, offset, 0, (void*)name, strlen(name)+1);
+    return offset;
+}
+
+static struct preprocessor_header* pch_header_for_source(struct preprocessor* preprocessor, struct source_file* source){
+    if(!preprocessor){
+        return NULL;
+    }
+    struct ptr_map* headers=preprocessor->headers;
+    for(size_t i=0;i<headers->capacity;i++){
+        struct preprocessor_header* header=headers->entries[i].value;
+        if(header&&header->source==source){
+            return header;
+        }
+    }
+    return NULL;
+}
+
+static int pch_compare_macros(const void* a, const void* b){
+    const struct preprocessor_macro* left=*(struct preprocessor_macro* const*)a;
+    const struct preprocessor_macro* right=*(struct preprocessor_macro* const*)b;
+    if(left->offset!=right->offset){
+        return left->offset<right->offset?-1:1;
+    }
+    return strcmp(left->name, right->name);
+}
+
+static void pch_set_mtime(struct pch_source* pch_source, const char* real_path){
+    struct stat st;
+    if(stat(real_path, &st)==0){
+        pch_source->mtime_sec=st.st_mtim.tv_sec;
+        pch_source->mtime_nsec=st.st_mtim.tv_nsec;
+    }
+}
+
+//预处理结束之后调用，把process->token_stream和宏表写进输出文件
+void pch_write(struct compile_process* process){
+    struct preprocessor* preprocessor=process->preprocessor;
+    FILE* fp=process->ofile;
+    if(!fp){
+        compiler_error(process, "生成预编译头文件需要输出文件\n");
+    }
+    struct pch_header header={.magic=PCH_MAGIC};
+    header.version=PCH_VERSION;
+    header.value_size=sizeof(unsigned long long);
+
+    int source_count=vector_count(process->source_files);
+    struct source_file** source_files=vector_data_ptr(process->source_files);
+    for(int i=0;i<source_count;i++){
+        if(!source_files[i]->data){
+            compiler_error(process, "%s的内容没有保留下来，不能生成预编译头文件\n", source_files[i]->filename);
+        }
+    }
+
+    struct vector* names=vector_create(sizeof(char));
+    struct vector* sources=vector_create(sizeof(struct pch_source));
+    for(int i=0;i<source_count;i++){
+        struct source_file* source=source_files[i];
+        struct pch_source pch_source={.base=source->base, .size=source->size, .real_path=PCH_NO_STRING, .guard=PCH_NO_STRING};
+        pch_source.filename=pch_add_name(names, source->filename?source->filename:"");
+        struct preprocessor_header* header=pch_header_for_source(preprocessor, source);
+        char real_path[PATH_MAX];
+        if(header){
+            pch_source.real_path=pch_add_name(names, header->path);
+            pch_source.guard=pch_add_name(names, header->guard);
+            pch_source.flags=(header->pragma_once?PCH_SOURCE_PRAGMA_ONCE:0)|(header->included?PCH_SOURCE_INCLUDED:0);
+            pch_set_mtime(&pch_source, header->path);
+        } else if(source==process->cfile.source&&realpath(source->filename, real_path)){
+            //编译的头文件本身，读入预编译头文件就相当于已经包含过它
+            pch_source.real_path=pch_add_name(names, real_path);
+            if(preprocessor){
+                pch_source.guard=pch_add_name(names, preprocessor_find_guard(preprocessor, process->lexed_tokens));
+                pch_source.flags=preprocessor->main_pragma_once?PCH_SOURCE_PRAGMA_ONCE:0;
+            }
+            pch_source.flags|=PCH_SOURCE_INCLUDED;
+            pch_set_mtime(&pch_source, real_path);
+        }
+        vector_push(sources, &pch_source);
+    }
+
+    //宏的内容先放进一个token_stream，和预处理之后的token用同样的格式写出去
+    struct vector* macros=vector_create(sizeof(struct pch_macro));
+    struct vector* params=vector_create(sizeof(uint32_t));
+    struct token_stream* macro_tokens=token_stream_create();
+    //宏表按指针散列，按#define的位置排序之后同一个头文件每次生成的文件都一样
+    struct vector* defined=vector_create(sizeof(struct preprocessor_macro*));
+    if(preprocessor){
+        struct ptr_map* map=preprocessor->macros;
+        for(size_t i=0;i<map->capacity;i++){
+            if(map->entries[i].value){
+                vector_push(defined, &map->entries[i].value);
+            }
+        }
+    }
+    qsort(vector_data_ptr(defined), vector_count(defined), sizeof(struct preprocessor_macro*), pch_compare_macros);
+    for(int i=0;i<vector_count(defined);i++){
+        struct preprocessor_macro* macro=vector_peek_ptr_at(defined, i);
+        struct pch_macro pch_macro={.name=pch_add_name(names, macro->name)};
+        pch_macro.flags=(macro->function_like?PCH_MACRO_FUNCTION_LIKE:0)|(macro->variadic?PCH_MACRO_VARIADIC:0);
+        pch_macro.first_param=vector_count(params);
+        pch_macro.param_count=macro->param_count;
+        for(int j=0;j<macro->param_count;j++){
+            uint32_t param=pch_add_name(names, macro->params[j]);
+            vector_push(params, &param);
+        }
+        pch_macro.first_token=token_stream_count(macro_tokens);
+        pch_macro.body_count=macro->body_count;
+        for(int j=0;j<macro->body_count;j++){
+            token_stream_push(macro_tokens, &macro->body[j]);
+        }
+        pch_macro.offset=macro->offset;
+        vector_push(macros, &pch_macro);
+    }
+    vector_free(defined);
+    header.source_count=source_count;
+    header.macro_count=vector_count(macros);
+    header.param_count=vector_count(params);
+    header.names_size=vector_count(names);
+
+    long start=ftell(fp);
+    fwrite(&header, sizeof(header), 1, fp);
+    struct source_file* last=source_files[source_count-1];
+    header.text_size=last->base+last->size+1;
+    char* text=calloc(header.text_size, 1);
+    for(int i=0;i<source_count;i++){
+        memcpy(text+source_files[i]->base, source_files[i]->data, source_files[i]->size);
+    }
+    header.text=token_cache_write_data(fp, text, header.text_size);
+    free(text);
+    header.sources=token_cache_write_data(fp, vector_data_ptr(sources), source_count*sizeof(struct pch_source));
+    header.macros=token_cache_write_data(fp, vector_data_ptr(macros), header.macro_count*sizeof(struct pch_macro));
+    header.params=token_cache_write_data(fp, vector_data_ptr(params), header.param_count*sizeof(uint32_t));
+    header.names=token_cache_write_data(fp, vector_data_ptr(names), header.names_size);
+    token_cache_write_tokens(process, fp, &header.tokens, process->token_stream, 0, token_stream_count(process->token_stream), 0);
+    token_cache_write_tokens(process, fp, &header.macro_tokens, macro_tokens, 0, token_stream_count(macro_tokens), 0);
+    //各段的位置写完才知道，最后回到开头补上
+    fseek(fp, start, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, fp);
+    fseek(fp, 0, SEEK_END);
+
+    token_stream_free(macro_tokens);
+    vector_free(params);
+    vector_free(macros);
+    vector_free(sources);
+    vector_free(names);
+    if(ferror(fp)){
+        compiler_error(process, "写入预编译头文件失败\n");
+    }
+}
+
+static bool pch_check_header(struct pch_header* header, size_t size){
+    return memcmp(header->magic, PCH_MAGIC, sizeof(PCH_MAGIC))==0&&
+           header->version==PCH_VERSION&&
+           header->value_size==sizeof(unsigned long long)&&
+           header->text+header->text_size<=size&&
+           header->sources+(uint64_t)header->source_count*sizeof(struct pch_source)<=size&&
+           header->macros+(uint64_t)header->macro_count*sizeof(struct pch_macro)<=size&&
+           header->params+(uint64_t)header->param_count*sizeof(uint32_t)<=size&&
+           header->names+header->names_size<=size&&
+           header->source_count&&header->text_size<=UINT32_MAX&&
+           (!header->names_size||((const char*)header)[header->names+header->names_size-1]=='\0');
+}
+
+//读入include_pch给出的预编译头文件，它的token追加到out，源码、头文件和宏登记进编译过程
+//源码登记在编译文件后面，token的偏移整体平移，报错时仍然能找到头文件中的位置
+void pch_load(struct compile_process* process, struct token_stream* out){
+    struct preprocessor* preprocessor=process->preprocessor;
+    const char* path=process->options.include_pch;
+    //相当于在编译文件开头包含的，出错时指向开头
+    process->offset=0;
+    int fd=open(path, O_RDONLY);
+    struct stat st;
+    if(fd<0||fstat(fd, &st)!=0||(size_t)st.st_size<sizeof(struct pch_header)){
+        if(fd>=0){
+            close(fd);
+        }
+        compiler_error(process, "无法读取预编译头文件%s\n", path);
+    }
+    char* data=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data==MAP_FAILED){
+        compiler_error(process, "无法读取预编译头文件%s\n", path);
+    }
+    compile_process_add_mapping(process, data, st.st_size);
+    struct pch_header* header=(struct pch_header*)data;
+    if(!pch_check_header(header, st.st_size)){
+        compiler_error(process, "%s不是这个编译器生成的预编译头文件\n", path);
+    }
+    const char* text=data+header->text;
+    const char* names=data+header->names;
+    const struct pch_source* sources=(const struct pch_source*)(data+header->sources);
+    const struct pch_macro* macros=(const struct pch_macro*)(data+header->macros);
+    const uint32_t* params=(const uint32_t*)(data+header->params);
+
+    //先确认用到的头文件都没有改过，再改动编译过程
+    for(uint32_t i=0;i<header->source_count;i++){
+        const struct pch_source* source=&sources[i];
+        if((uint64_t)source->base+source->size>=header->text_size||source->filename>=header->names_size||
+            (source->real_path!=PCH_NO_STRING&&source->real_path>=header->names_size)||
+            (source->guard!=PCH_NO_STRING&&source->guard>=header->names_size)){
+            compiler_error(process, "预编译头文件%s已损坏\n", path);
+        }
+        if(source->real_path==PCH_NO_STRING){
+            continue;
+        }
+        const char* real_path=names+source->real_path;
+        struct stat source_st;
+        if(stat(real_path, &source_st)!=0||(size_t)source_st.st_size!=source->size||
+            source_st.st_mtim.tv_sec!=source->mtime_sec||source_st.st_mtim.tv_nsec!=source->mtime_nsec){
+            compiler_error(process, "生成预编译头文件%s之后%s被修改过，需要重新生成\n", path, real_path);
+        }
+    }
+
+    //所有源码按原来的间隔接在后面，偏移只差一个常数
+    preprocessor_finish_main(preprocessor);
+    uint32_t delta=0;
+    for(uint32_t i=0;i<header->source_count;i++){
+        const struct pch_source* pch_source=&sources[i];
+        struct source_file* source=compile_process_add_source(process, names+pch_source->filename, text+pch_source->base, pch_source->size);
+        if(i==0){
+            delta=source->base-pch_source->base;
+        } else if(source->base!=pch_source->base+delta){
+            compiler_error(process, "预编译头文件%s已损坏\n", path);
+        }
+        if(pch_source->real_path==PCH_NO_STRING){
+            continue;
+        }
+        const char* real_path=intern_cstr(process->interns, names+pch_source->real_path);
+        if(ptr_map_get(preprocessor->headers, real_path)){
+            continue;
+        }
+        struct preprocessor_header* pp_header=arena_alloc(process->arena, sizeof(struct preprocessor_header));
+        memset(pp_header, 0, sizeof(struct preprocessor_header));
+        pp_header->path=real_path;
+        pp_header->source=source;
+        pp_header->guard=pch_source->guard==PCH_NO_STRING?NULL:intern_cstr(process->interns, names+pch_source->guard);
+        pp_header->pragma_once=pch_source->flags&PCH_SOURCE_PRAGMA_ONCE;
+        pp_header->included=pch_source->flags&PCH_SOURCE_INCLUDED;
+        ptr_map_set(preprocessor->headers, real_path, pp_header);
+    }
+
+    //宏的内容读进临时的token_stream，再拷贝到arena里
+    struct token_stream* macro_tokens=token_stream_create();
+    if(!token_cache_read_tokens(process, macro_tokens, data, st.st_size, &header->macro_tokens, header->text_size, delta)){
+        token_stream_free(macro_tokens);
+        compiler_error(process, "预编译头文件%s已损坏\n", path);
+    }
+    for(uint32_t i=0;i<header->macro_count;i++){
+        const struct pch_macro* pch_macro=&macros[i];
+        if(pch_macro->name>=header->names_size||
+            (uint64_t)pch_macro->first_param+pch_macro->param_count>header->param_count||
+            (uint64_t)pch_macro->first_token+pch_macro->body_count>header->macro_tokens.token_count){
+            token_stream_free(macro_tokens);
+            compiler_error(process, "预编译头文件%s已损坏\n", path);
+        }
+        struct preprocessor_macro* macro=arena_alloc(process->arena, sizeof(struct preprocessor_macro));
+        memset(macro, 0, sizeof(struct preprocessor_macro));
+        macro->name=intern_cstr(process->interns, names+pch_macro->name);
+        macro->function_like=pch_macro->flags&PCH_MACRO_FUNCTION_LIKE;
+        macro->variadic=pch_macro->flags&PCH_MACRO_VARIADIC;
+        macro->param_count=pch_macro->param_count;
+        macro->params=arena_alloc(process->arena, (macro->param_count+1)*sizeof(const char*));
+        for(int j=0;j<macro->param_count;j++){
+            uint32_t param=params[pch_macro->first_param+j];
+            macro->params[j]=param<header->names_size?intern_cstr(process->interns, names+param):macro->name;
+        }
+        macro->body_count=pch_macro->body_count;
+        macro->body=arena_alloc(process->arena, (macro->body_count+1)*sizeof(struct token));
+        for(int j=0;j<macro->body_count;j++){
+            token_stream_get(macro_tokens, pch_macro->first_token+j, &macro->body[j]);
+        }
+        macro->offset=pch_macro->offset+delta;
+        ptr_map_set(preprocessor->macros, macro->name, macro);
+    }
+    token_stream_free(macro_tokens);
+
+    int first=token_stream_count(out);
+    if(!token_cache_read_tokens(process, out, data, st.st_size, &header->tokens, header->text_size, delta)){
+        compiler_error(process, "预编译头文件%s已损坏\n", path);
+    }
+    process->stats.pch_tokens=token_stream_count(out)-first;
+}
@@ -0,0 +1,845 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/buffer.h"
+#include "helpers/arena.h"
+#include "helpers/intern.h"
+#include "helpers/ptr_map.h"
+#include <stdlib.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//预处理：在词法分析和语法分析之间处理#include、#define/#undef和条件编译
+//头文件在一次编译中只做一次词法分析，token留在preprocessor_header里，再次包含时直接重放
+//整个文件被include guard包住或者有#pragma once的头文件，再次包含时连重放都不需要
+
+//#include嵌套超过这个深度就认为是循环包含
+#define PREPROCESSOR_MAX_INCLUDE_DEPTH 200
+
+struct preprocessor* preprocessor_create(struct compile_process* compiler){
+    struct preprocessor* preprocessor=calloc(1, sizeof(struct preprocessor));
+    preprocessor->compiler=compiler;
+    preprocessor->frames=vector_create(sizeof(struct preprocessor_frame));
+    preprocessor->conditionals=vector_create(sizeof(struct preprocessor_conditional));
+    preprocessor->macros=ptr_map_create();
+    preprocessor->headers=ptr_map_create();
+    preprocessor->include_paths=ptr_map_create();
+    preprocessor->line=vector_create(sizeof(struct token));
+    preprocessor->pending=vector_create(sizeof(struct preprocessor_pending));
+    preprocessor->pending_floor=-1;
+    preprocessor->macro_args=vector_create(sizeof(struct preprocessor_pending));
+    preprocessor->macro_arg_ranges=vector_create(sizeof(struct preprocessor_macro_arg));
+    preprocessor->macro_output=vector_create(sizeof(struct preprocessor_pending));
+    preprocessor->spelling=buffer_create();
+    return preprocessor;
+}
+
+//丢掉上一次编译的宏和头文件，头文件的token指向编译过程的arena，arena重置之前必须调用
+void preprocessor_reset(struct preprocessor* preprocessor){
+    struct ptr_map* headers=preprocessor->headers;
+    for(size_t i=0;i<headers->capacity;i++){
+        struct preprocessor_header* header=headers->entries[i].value;
+        if(header&&header->tokens){
+            token_stream_free(header->tokens);
+        }
+    }
+    ptr_map_clear(preprocessor->headers);
+    ptr_map_clear(preprocessor->include_paths);
+    ptr_map_clear(preprocessor->macros);
+    vector_clear(preprocessor->frames);
+    vector_clear(preprocessor->conditionals);
+    vector_clear(preprocessor->line);
+    vector_clear(preprocessor->pending);
+    preprocessor->pending_floor=-1;
+    vector_clear(preprocessor->macro_args);
+    vector_clear(preprocessor->macro_arg_ranges);
+    vector_clear(preprocessor->macro_output);
+    preprocessor->main_pragma_once=false;
+}
+
+void preprocessor_free(struct preprocessor* preprocessor){
+    preprocessor_reset(preprocessor);
+    vector_free(preprocessor->frames);
+    vector_free(preprocessor->conditionals);
+    ptr_map_free(preprocessor->macros);
+    ptr_map_free(preprocessor->headers);
+    ptr_map_free(preprocessor->include_paths);
+    vector_free(preprocessor->line);
+    vector_free(preprocessor->pending);
+    vector_free(preprocessor->macro_args);
+    vector_free(preprocessor->macro_arg_ranges);
+    vector_free(preprocessor->macro_output);
+    buffer_free(preprocessor->spelling);
+    if(preprocessor->lexer){
+        lex_process_free(preprocessor->lexer);
+    }
+    free(preprocessor);
+}
+
+//从tokens开始预处理，tokens是编译文件的token，流式读取时可以还在词法分析
+void preprocessor_begin(struct preprocessor* preprocessor, struct token_stream* tokens){
+    struct intern_table* interns=preprocessor->compiler->interns;
+    //驻留表每次编译都会清空，指令名也要重新驻留
+    struct preprocessor_names* names=&preprocessor->names;
+    names->define=intern_cstr(interns, "define");
+    names->undef=intern_cstr(interns, "undef");
+    names->ifdef=intern_cstr(interns, "ifdef");
+    names->ifndef=intern_cstr(interns, "ifndef");
+    names->elif=intern_cstr(interns, "elif");
+    names->endif=intern_cstr(interns, "endif");
+    names->pragma=intern_cstr(interns, "pragma");
+    names->once=intern_cstr(interns, "once");
+    names->defined=intern_cstr(interns, "defined");
+    names->error=intern_cstr(interns, "error");
+    names->warning=intern_cstr(interns, "warning");
+    names->line=intern_cstr(interns, "line");
+    names->va_args=intern_cstr(interns, "__VA_ARGS__");
+
+    struct preprocessor_frame frame={.tokens=tokens, .index=0, .header=NULL, .conditional_depth=0};
+    vector_push(preprocessor->frames, &frame);
+}
+
+//只看类型、标志和值数组，行首没有#的文件不需要经过预处理
+bool preprocessor_has_directives(struct token_stream* tokens){
+    const uint8_t* types=vector_data_ptr(tokens->types);
+    const unsigned long long* values=vector_data_ptr(tokens->values);
+    int total=vector_count(tokens->types);
+    for(int i=0;i<total;i++){
+        struct token token={.llnum=values[i]};
+        if(types[i]==TOKEN_TYPE_SYMBOL&&token.cval=='#'&&token_stream_line_start(tokens, tokens->base+i)){
+            return true;
+        }
+    }
+    return false;
+}
+
+struct preprocessor_macro* preprocessor_macro_lookup(struct preprocessor* preprocessor, const char* name){
+    return ptr_map_get(preprocessor->macros, name);
+}
+
+static bool preprocessor_is_identifier(struct token* token, const char* name){
+    return token->type==TOKEN_TYPE_IDENTIFIER&&token->sval==name;
+}
+
+static bool preprocessor_is_skipping(struct preprocessor* preprocessor){
+    struct preprocessor_conditional* conditional=vector_back_or_null(preprocessor->conditionals);
+    return conditional&&!conditional->active;
+}
+
+static struct preprocessor_frame* preprocessor_frame(struct preprocessor* preprocessor){
+    return vector_back_or_null(preprocessor->frames);
+}
+
+//读出一整行预处理指令放进preprocessor->line，读到下一个行首的token为止
+//续行和注释已经在token_stream的附属表里，不会出现在这一行中
+static void preprocessor_read_line(struct preprocessor* preprocessor, struct preprocessor_frame* frame){
+    struct vector* line=preprocessor->line;
+    vector_clear(line);
+    struct token token;
+    while(token_stream_get(frame->tokens, frame->index, &token)){
+        if(token.line_start){
+            break;
+        }
+        frame->index++;
+        vector_push(line, &token);
+    }
+}
+
+static struct token* preprocessor_line_at(struct preprocessor* preprocessor, int index){
+    if(index>=vector_count(preprocessor->line)){
+        return NULL;
+    }
+    return vector_at(preprocessor->line, index);
+}
+
+//指令后面必须跟着一个标识符，比如#ifdef、#define、#undef的宏名
+static const char* preprocessor_expect_name(struct preprocessor* preprocessor, int index, const char* directive){
+    struct token* token=preprocessor_line_at(preprocessor, index);
+    if(!token||token->type!=TOKEN_TYPE_IDENTIFIER){
+        compiler_error(preprocessor->compiler, "#%s后面需要一个宏名\n", directive);
+    }
+    return token->sval;
+}
+
+static bool preprocessor_is_defined(struct preprocessor* preprocessor, const char* name){
+    return ptr_map_get(preprocessor->macros, name)!=NULL;
+}
+
+static void preprocessor_define(struct preprocessor* preprocessor){
+    struct compile_process* compiler=preprocessor->compiler;
+    struct token* name=preprocessor_line_at(preprocessor, 1);
+    struct preprocessor_macro* macro=arena_alloc(compiler->arena, sizeof(struct preprocessor_macro));
+    memset(macro, 0, sizeof(struct preprocessor_macro));
+    macro->name=preprocessor_expect_name(preprocessor, 1, "define");
+    macro->offset=name->offset;
+
+    int index=2;
+    struct token* token=preprocessor_line_at(preprocessor, index);
+    //名字和'('之间没有空白才是带参数的宏，否则'('属于宏的内容
+    if(token&&token_is_operator(token, OPERATOR_LEFT_PAREN)&&!name->whitespace){
+        macro->function_like=true;
+        int start=++index;
+        int total=vector_count(preprocessor->line);
+        while(index<total&&!token_is_symbol(preprocessor_line_at(preprocessor, index), ')')){
+            index++;
+        }
+        if(index>=total){
+            compiler_error(compiler, "宏%s的参数列表没有结束的')'\n", macro->name);
+        }
+        macro->params=arena_alloc(compiler->arena, (index-start)*sizeof(const char*)+1);
+        for(int i=start;i<index;i++){
+            token=preprocessor_line_at(preprocessor, i);
+            bool last=i==index-1;
+            if(token_is_operator(token, OPERATOR_ELLIPSIS)&&last){
+                macro->variadic=true;
+            } else if(token->type==TOKEN_TYPE_IDENTIFIER){
+                macro->params[macro->param_count++]=token->sval;
+            } else if(!token_is_operator(token, OPERATOR_COMMA)){
+                compiler_error(compiler, "宏%s的参数列表中有不是参数名的内容\n", macro->name);
+            }
+        }
+        index++;
+    }
+
+    macro->body_count=vector_count(preprocessor->line)-index;
+    macro->body=arena_alloc(compiler->arena, macro->body_count*sizeof(struct token)+1);
+    if(macro->body_count){
+        memcpy(macro->body, preprocessor_line_at(preprocessor, index), macro->body_count*sizeof(struct token));
+    }
+    //#和##放错位置的宏在定义时就报错，展开时不用再检查
+    for(int i=0;i<macro->body_count;i++){
+        struct token* token=&macro->body[i];
+        if(!token_is_symbol(token, '#')){
+            continue;
+        }
+        bool paste=i+1<macro->body_count&&!token->whitespace&&token_is_symbol(&macro->body[i+1], '#');
+        if(paste){
+            if(i==0||i+2>=macro->body_count){
+                compiler_error(compiler, "宏%s的'##'不能在开头或结尾\n", macro->name);
+            }
+            i++;
+        } else if(macro->function_like&&(i+1>=macro->body_count||macro_param_index(preprocessor, macro, &macro->body[i+1])<0)){
+            compiler_error(compiler, "宏%s中的'#'后面需要一个参数名\n", macro->name);
+        }
+    }
+    ptr_map_set(preprocessor->macros, macro->name, macro);
+}
+
+//#if和#elif的条件，递归下降求值，优先级和C语言相同
+//defined先换成0或1，然后展开宏，剩下的标识符都当作0
+struct preprocessor_expression{
+    struct preprocessor* preprocessor;
+    int index;
+};
+
+static long long preprocessor_eval(struct preprocessor_expression* expression, int min_precedence);
+
+static struct token* preprocessor_eval_peek(struct preprocessor_expression* expression){
+    return preprocessor_line_at(expression->preprocessor, expression->index);
+}
+
+static struct token* preprocessor_eval_next(struct preprocessor_expression* expression){
+    struct token* token=preprocessor_eval_peek(expression);
+    if(!token){
+        compiler_error(expression->preprocessor->compiler, "#if的条件不完整\n");
+    }
+    expression->index++;
+    return token;
+}
+
+static void preprocessor_eval_expect_symbol(struct preprocessor_expression* expression, char c){
+    struct token* token=preprocessor_eval_next(expression);
+    if(!token_is_symbol(token, c)){
+        compiler_error(expression->preprocessor->compiler, "#if的条件中缺少'%c'\n", c);
+    }
+}
+
+static long long preprocessor_eval_primary(struct preprocessor_expression* expression){
+    struct preprocessor* preprocessor=expression->preprocessor;
+    struct token* token=preprocessor_eval_next(expression);
+    if(token->type==TOKEN_TYPE_NUMBER){
+        if(token->num.type==NUMBER_TYPE_FLOAT||token->num.type==NUMBER_TYPE_DOUBLE){
+            compiler_error(preprocessor->compiler, "#if的条件中不能使用浮点数\n");
+        }
+        return token->llnum;
+    }
+    if(token_is_operator(token, OPERATOR_LEFT_PAREN)){
+        long long value=preprocessor_eval(expression, 0);
+        preprocessor_eval_expect_symbol(expression, ')');
+        return value;
+    }
+    if(token->type==TOKEN_TYPE_OPERATOR){
+        long long value=preprocessor_eval_primary(expression);
+        switch(token->op){
+            case OPERATOR_NOT: return !value;
+            case OPERATOR_BITWISE_NOT: return ~value;
+            case OPERATOR_MINUS: return -value;
+            case OPERATOR_PLUS: return value;
+        }
+    }
+    if(token->type==TOKEN_TYPE_IDENTIFIER||token->type==TOKEN_TYPE_KEYWORD){
+        return 0;
+    }
+    compiler_error(preprocessor->compiler, "#if的条件中不能出现这个token\n");
+    return 0;
+}
+
+//二元运算符的优先级，越大越先结合，不是二元运算符时返回-1
+static int preprocessor_eval_precedence(struct token* token){
+    if(!token){
+        return -1;
+    }
+    if(token_is_operator(token, OPERATOR_QUESTION)){
+        return 1;
+    }
+    if(token->type!=TOKEN_TYPE_OPERATOR){
+        return -1;
+    }
+    switch(token->op){
+        case OPERATOR_LOGICAL_OR: return 2;
+        case OPERATOR_LOGICAL_AND: return 3;
+        case OPERATOR_BITWISE_OR: return 4;
+        case OPERATOR_XOR: return 5;
+        case OPERATOR_BITWISE_AND: return 6;
+        case OPERATOR_EQUAL: case OPERATOR_NOT_EQUAL: return 7;
+        case OPERATOR_LESS: case OPERATOR_GREATER: case OPERATOR_LESS_EQUAL: case OPERATOR_GREATER_EQUAL: return 8;
+        case OPERATOR_SHIFT_LEFT: case OPERATOR_SHIFT_RIGHT: return 9;
+        case OPERATOR_PLUS: case OPERATOR_MINUS: return 10;
+        case OPERATOR_STAR: case OPERATOR_SLASH: case OPERATOR_PERCENT: return 11;
+    }
+    return -1;
+}
+
+static long long preprocessor_eval_binary(struct preprocessor_expression* expression, int op, long long left, long long right){
+    switch(op){
+        case OPERATOR_LOGICAL_OR: return left||right;
+        case OPERATOR_LOGICAL_AND: return left&&right;
+        case OPERATOR_BITWISE_OR: return left|right;
+        case OPERATOR_XOR: return left^right;
+        case OPERATOR_BITWISE_AND: return left&right;
+        case OPERATOR_EQUAL: return left==right;
+        case OPERATOR_NOT_EQUAL: return left!=right;
+        case OPERATOR_LESS: return left<right;
+        case OPERATOR_GREATER: return left>right;
+        case OPERATOR_LESS_EQUAL: return left<=right;
+        case OPERATOR_GREATER_EQUAL: return left>=right;
+        case OPERATOR_SHIFT_LEFT: return left<<right;
+        case OPERATOR_SHIFT_RIGHT: return left>>right;
+        case OPERATOR_PLUS: return left+right;
+        case OPERATOR_MINUS: return left-right;
+        case OPERATOR_STAR: return left*right;
+    }
+    if(right==0){
+        compiler_error(expression->preprocessor->compiler, "#if的条件中除以0\n");
+    }
+    return op==OPERATOR_SLASH?left/right:left%right;
+}
+
+static long long preprocessor_eval(struct preprocessor_expression* expression, int min_precedence){
+    long long left=preprocessor_eval_primary(expression);
+    while(1){
+        struct token* token=preprocessor_eval_peek(expression);
+        int precedence=preprocessor_eval_precedence(token);
+        if(precedence<min_precedence||precedence<0){
+            return left;
+        }
+        expression->index++;
+        if(token_is_operator(token, OPERATOR_QUESTION)){
+            //?:是右结合的，两个分支都要求值才能知道用到了哪些token
+            long long then_value=preprocessor_eval(expression, 0);
+            preprocessor_eval_expect_symbol(expression, ':');
+            long long else_value=preprocessor_eval(expression, precedence);
+            left=left?then_value:else_value;
+            continue;
+        }
+        long long right=preprocessor_eval(expression, precedence+1);
+        left=preprocessor_eval_binary(expression, token->op, left, right);
+    }
+}
+
+//把条件中的defined X和defined(X)换成数字，必须在展开宏之前做，X本身不能被展开
+static void preprocessor_replace_defined(struct preprocessor* preprocessor){
+    struct vector* line=preprocessor->line;
+    int total=vector_count(line);
+    int count=1;
+    for(int i=1;i<total;i++){
+        struct token* token=vector_at(line, i);
+        if(preprocessor_is_identifier(token, preprocessor->names.defined)){
+            struct token* name=preprocessor_line_at(preprocessor, ++i);
+            bool parentheses=name&&token_is_operator(name, OPERATOR_LEFT_PAREN);
+            if(parentheses){
+                name=preprocessor_line_at(preprocessor, ++i);
+            }
+            if(!name||name->type!=TOKEN_TYPE_IDENTIFIER){
+                compiler_error(preprocessor->compiler, "defined后面需要一个宏名\n");
+            }
+            if(parentheses){
+                struct token* close=preprocessor_line_at(preprocessor, ++i);
+                if(!close||!token_is_symbol(close, ')')){
+                    compiler_error(preprocessor->compiler, "#if的条件中缺少')'\n");
+                }
+            }
+            struct token value={.type=TOKEN_TYPE_NUMBER, .offset=token->offset};
+            value.llnum=preprocessor_is_defined(preprocessor, name->sval);
+            value.whitespace=true;
+            memcpy(vector_at(line, count++), &value, sizeof(value));
+            continue;
+        }
+        memmove(vector_at(line, count++), token, sizeof(struct token));
+    }
+    vector_pop_multiple_at(line, count, total-count);
+}
+
+static bool preprocessor_eval_condition(struct preprocessor* preprocessor){
+    preprocessor_replace_defined(preprocessor);
+    macro_expand_line(preprocessor, preprocessor->line, 1);
+    struct preprocessor_expression expression={.preprocessor=preprocessor, .index=1};
+    long long value=preprocessor_eval(&expression, 0);
+    if(preprocessor_eval_peek(&expression)){
+        compiler_error(preprocessor->compiler, "#if的条件后面有多余的内容\n");
+    }
+    return value!=0;
+}
+
+//外层没有选中时里面的分支都不会选中，也不需要求条件的值
+static void preprocessor_push_conditional(struct preprocessor* preprocessor, uint32_t offset, bool (*condition)(struct preprocessor*)){
+    struct preprocessor_conditional conditional={.offset=offset};
+    if(preprocessor_is_skipping(preprocessor)){
+        conditional.done=true;
+    } else {
+        conditional.active=condition(preprocessor);
+        conditional.done=conditional.active;
+    }
+    vector_push(preprocessor->conditionals, &conditional);
+}
+
+static bool preprocessor_ifdef_condition(struct preprocessor* preprocessor){
+    return preprocessor_is_defined(preprocessor, preprocessor_expect_name(preprocessor, 1, "ifdef"));
+}
+
+static bool preprocessor_ifndef_condition(struct preprocessor* preprocessor){
+    return !preprocessor_is_defined(preprocessor, preprocessor_expect_name(preprocessor, 1, "ifndef"));
+}
+
+//当前文件里打开的条件编译，#elif、#else、#endif不能跨文件匹配
+static struct preprocessor_conditional* preprocessor_current_conditional(struct preprocessor* preprocessor, const char* directive){
+    struct preprocessor_frame* frame=preprocessor_frame(preprocessor);
+    if(vector_count(preprocessor->conditionals)<=frame->conditional_depth){
+        compiler_error(preprocessor->compiler, "#%s没有对应的#if\n", directive);
+    }
+    return vector_back(preprocessor->conditionals);
+}
+
+static void preprocessor_elif(struct preprocessor* preprocessor){
+    struct preprocessor_conditional* conditional=preprocessor_current_conditional(preprocessor, "elif");
+    if(conditional->seen_else){
+        compiler_error(preprocessor->compiler, "#else后面不能再有#elif\n");
+    }
+    if(conditional->done){
+        conditional->active=false;
+        return;
+    }
+    conditional->active=preprocessor_eval_condition(preprocessor);
+    conditional->done=conditional->active;
+}
+
+static void preprocessor_else(struct preprocessor* preprocessor){
+    struct preprocessor_conditional* conditional=preprocessor_current_conditional(preprocessor, "else");
+    if(conditional->seen_else){
+        compiler_error(preprocessor->compiler, "#else后面不能再有#else\n");
+    }
+    conditional->seen_else=true;
+    conditional->active=!conditional->done;
+    conditional->done=true;
+}
+
+static void preprocessor_endif(struct preprocessor* preprocessor){
+    preprocessor_current_conditional(preprocessor, "endif");
+    vector_pop(preprocessor->conditionals);
+}
+
+//#error和#warning后面的内容原样取自源码
+static void preprocessor_message(struct preprocessor* preprocessor, bool error){
+    struct compile_process* compiler=preprocessor->compiler;
+    const char* text="";
+    int len=0;
+    struct token* first=preprocessor_line_at(preprocessor, 1);
+    struct source_file* source=first?compile_process_source_for_offset(compiler, first->offset):NULL;
+    if(source&&source->data){
+        text=source->data+(first->offset-source->base);
+        const char* end=memchr(text, '\n', source->data+source->size-text);
+        len=end?end-text:source->data+source->size-text;
+    }
+    if(error){
+        compiler_error(compiler, "#error %.*s\n", len, text);
+    }
+    compiler_warning(compiler, "#warning %.*s\n", len, text);
+}
+
+//整个头文件被#ifndef X ... #endif包住时返回已驻留的X
+//#endif后面不能再有token，中间也不能有同一层的#elif或#else
+const char* preprocessor_find_guard(struct preprocessor* preprocessor, struct token_stream* tokens){
+    struct preprocessor_names* names=&preprocessor->names;
+    int total=token_stream_count(tokens);
+    const char* guard=NULL;
+    int depth=0;
+    struct token token;
+    for(int i=0;i<total;i++){
+        token_stream_get(tokens, i, &token);
+        bool directive=token.line_start&&token_is_symbol(&token, '#');
+        if(guard&&depth==0){
+            //#endif之后还有别的内容
+            return NULL;
+        }
+        if(!directive){
+            if(!guard){
+                return NULL;
+            }
+            continue;
+        }
+
+        //指令名要和#在同一行
+        if(++i>=total||token_stream_line_start(tokens, i)){
+            return NULL;
+        }
+        token_stream_get(tokens, i, &token);
+        if(!guard){
+            //文件里第一个有意义的内容必须是#ifndef X
+            struct token name;
+            if(!preprocessor_is_identifier(&token, names->ifndef)||++i>=total||!token_stream_get(tokens, i, &name)||
+                name.line_start||name.type!=TOKEN_TYPE_IDENTIFIER){
+                return NULL;
+            }
+            guard=name.sval;
+            depth=1;
+        } else if(token_is_keyword(&token, KEYWORD_IF)||preprocessor_is_identifier(&token, names->ifdef)||preprocessor_is_identifier(&token, names->ifndef)){
+            depth++;
+        } else if(preprocessor_is_identifier(&token, names->endif)){
+            depth--;
+        } else if(depth==1&&(token_is_keyword(&token, KEYWORD_ELSE)||preprocessor_is_identifier(&token, names->elif))){
+            return NULL;
+        }
+    }
+    return depth==0?guard:NULL;
+}
+
+//流式读取管道输入时编译文件还没读完，长度还在变，在它后面登记别的源码之前要先读完它
+void preprocessor_finish_main(struct preprocessor* preprocessor){
+    struct preprocessor_frame* main_frame=vector_at(preprocessor->frames, 0);
+    struct source_file* last=vector_back_ptr(preprocessor->compiler->source_files);
+    if(!last->data){
+        while(main_frame->tokens->lexer&&token_stream_has(main_frame->tokens, token_stream_count(main_frame->tokens)));
+    }
+}
+
+//头文件的token优先从缓存读取，否则用复用的词法分析器分析header->source
+static void preprocessor_lex_header(struct preprocessor* preprocessor, struct preprocessor_header* header){
+    struct compile_process* compiler=preprocessor->compiler;
+    header->tokens=token_stream_create();
+    if(!token_cache_load(compiler, header->tokens, header->source)){
+        if(!preprocessor->lexer){
+            preprocessor->lexer=lex_process_create(compiler, &lexer_source_functions, header->source);
+        } else {
+            lex_process_reset(preprocessor->lexer, &lexer_source_functions, header->source);
+        }
+        vector_reserve(preprocessor->lexer->token_vec, header->source->size/LEX_AVERAGE_BYTES_PER_TOKEN);
+        preprocessor->lexer->offset=header->source->base;
+        lex(preprocessor->lexer);
+        token_stream_push_vector(header->tokens, preprocessor->lexer->token_vec);
+        token_cache_store(compiler, header->tokens, header->source, 0);
+    }
+    compiler->stats.headers++;
+}
+
+//读取、词法分析并登记一个头文件，path已经确认是存在的普通文件
+static struct preprocessor_header* preprocessor_load_header(struct preprocessor* preprocessor, const char* path, const char* real_path){
+    struct compile_process* compiler=preprocessor->compiler;
+    int fd=open(path, O_RDONLY);
+    struct stat st;
+    if(fd<0||fstat(fd, &st)!=0){
+        if(fd>=0){
+            close(fd);
+        }
+        compiler_error(compiler, "无法读取头文件%s\n", path);
+    }
+    const char* data="";
+    if(st.st_size){
+        void* mapped=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapped==MAP_FAILED){
+            close(fd);
+            compiler_error(compiler, "无法读取头文件%s\n", path);
+        }
+        compile_process_add_mapping(compiler, mapped, st.st_size);
+        data=mapped;
+    }
+    close(fd);
+
+    preprocessor_finish_main(preprocessor);
+    struct preprocessor_header* header=arena_alloc(compiler->arena, sizeof(struct preprocessor_header));
+    memset(header, 0, sizeof(struct preprocessor_header));
+    header->path=real_path;
+    header->source=compile_process_add_source(compiler, path, data, st.st_size);
+    preprocessor_lex_header(preprocessor, header);
+    header->guard=preprocessor_find_guard(preprocessor, header->tokens);
+    ptr_map_set(preprocessor->headers, real_path, header);
+    return header;
+}
+
+//path存在时返回对应的头文件，同一个文件不管用什么路径包含都只读取一次
+static struct preprocessor_header* preprocessor_try_header(struct preprocessor* preprocessor, const char* path){
+    char real_path[PATH_MAX];
+    struct stat st;
+    if(!realpath(path, real_path)||stat(real_path, &st)!=0||!S_ISREG(st.st_mode)){
+        return NULL;
+    }
+    const char* key=intern_cstr(preprocessor->compiler->interns, real_path);
+    struct preprocessor_header* header=ptr_map_get(preprocessor->headers, key);
+    if(!header){
+        header=preprocessor_load_header(preprocessor, path, key);
+    }
+    return header;
+}
+
+//#include "name"先在包含它的文件所在目录中查找，然后和#include <name>一样按-I的顺序查找
+static struct preprocessor_header* preprocessor_find_header(struct preprocessor* preprocessor, struct token* token){
+    struct compile_process* compiler=preprocessor->compiler;
+    struct source_file* includer=compile_process_source_for_offset(compiler, token->offset);
+    //两种写法的文件名都是字符串token，只能看源码里的定界符
+    bool angled=includer->data&&includer->data[token->offset-includer->base]=='<';
+    //文件名只是源码中的一段，驻留之后才有结尾的'\0'
+    const char* name=intern(compiler->interns, compile_process_text(compiler, token->span), token->span.len);
+
+    int dir_len=0;
+    const char* slash=includer->filename?strrchr(includer->filename, '/'):NULL;
+    if(slash){
+        dir_len=slash-includer->filename;
+    }
+    char path[PATH_MAX];
+    int len=snprintf(path, sizeof(path), "%.*s\n%c%s", dir_len, slash?includer->filename:"", angled?'<':'"', name);
+    if(len>=(int)sizeof(path)){
+        compiler_error(compiler, "头文件路径太长\n");
+    }
+    const char* key=intern(compiler->interns, path, len);
+    struct preprocessor_header* header=ptr_map_get(preprocessor->include_paths, key);
+    if(header){
+        return header;
+    }
+
+    if(name[0]=='/'){
+        header=preprocessor_try_header(preprocessor, name);
+    }
+    if(!header&&!angled&&name[0]!='/'){
+        snprintf(path, sizeof(path), "%.*s%s%s", dir_len, slash?includer->filename:"", slash?"/":"", name);
+        header=preprocessor_try_header(preprocessor, path);
+    }
+    for(int i=0;!header&&name[0]!='/'&&i<compiler->options.include_dir_count;i++){
+        snprintf(path, sizeof(path), "%s/%s", compiler->options.include_dirs[i], name);
+        header=preprocessor_try_header(preprocessor, path);
+    }
+    if(!header){
+        compiler_error(compiler, "找不到头文件%s\n", name);
+    }
+    ptr_map_set(preprocessor->include_paths, key, header);
+    return header;
+}
+
+static void preprocessor_include(struct preprocessor* preprocessor){
+    struct compile_process* compiler=preprocessor->compiler;
+    struct token* token=preprocessor_line_at(preprocessor, 1);
+    if(!token||token->type!=TOKEN_TYPE_STRING){
+        compiler_error(compiler, "#include后面需要\"文件名\"或者<文件名>\n");
+    }
+    struct preprocessor_header* header=preprocessor_find_header(preprocessor, token);
+    compiler->stats.includes++;
+    if((header->pragma_once&&header->included)||(header->guard&&preprocessor_is_defined(preprocessor, header->guard))){
+        compiler->stats.includes_skipped++;
+        return;
+    }
+    if(vector_count(preprocessor->frames)>=PREPROCESSOR_MAX_INCLUDE_DEPTH){
+        compiler_error(compiler, "#include嵌套太深，可能是循环包含了%s\n", header->source->filename);
+    }
+    if(!header->tokens){
+        //预编译头文件里的头文件，内容已经在映射进来的文件里，不需要再读取
+        preprocessor_lex_header(preprocessor, header);
+    }
+    header->included=true;
+    struct preprocessor_frame frame={
+        .tokens=header->tokens,
+        .index=0,
+        .header=header,
+        .conditional_depth=vector_count(preprocessor->conditionals)
+    };
+    vector_push(preprocessor->frames, &frame);
+}
+
+static void preprocessor_pragma(struct preprocessor* preprocessor, struct preprocessor_frame* frame){
+    struct token* token=preprocessor_line_at(preprocessor, 1);
+    //编译文件本身的#pragma once只在生成预编译头文件时有用，其余的#pragma都忽略
+    if(token&&preprocessor_is_identifier(token, preprocessor->names.once)){
+        if(frame->header){
+            frame->header->pragma_once=true;
+        } else {
+            preprocessor->main_pragma_once=true;
+        }
+    }
+}
+
+//处理frame中#后面的一行，跳过的分支里只处理条件编译指令
+static void preprocessor_directive(struct preprocessor* preprocessor, struct preprocessor_frame* frame){
+    preprocessor_read_line(preprocessor, frame);
+    struct token* name=preprocessor_line_at(preprocessor, 0);
+    if(!name){
+        //只有一个#的空指令
+        return;
+    }
+    struct compile_process* compiler=preprocessor->compiler;
+    struct preprocessor_names* names=&preprocessor->names;
+    compiler->offset=name->offset;
+
+    if(token_is_keyword(name, KEYWORD_IF)){
+        preprocessor_push_conditional(preprocessor, name->offset, preprocessor_eval_condition);
+    } else if(preprocessor_is_identifier(name, names->ifdef)){
+        preprocessor_push_conditional(preprocessor, name->offset, preprocessor_ifdef_condition);
+    } else if(preprocessor_is_identifier(name, names->ifndef)){
+        preprocessor_push_conditional(preprocessor, name->offset, preprocessor_ifndef_condition);
+    } else if(preprocessor_is_identifier(name, names->elif)){
+        preprocessor_elif(preprocessor);
+    } else if(token_is_keyword(name, KEYWORD_ELSE)){
+        preprocessor_else(preprocessor);
+    } else if(preprocessor_is_identifier(name, names->endif)){
+        preprocessor_endif(preprocessor);
+    } else if(preprocessor_is_skipping(preprocessor)){
+        //没有选中的分支里的其他指令都不处理
+    } else if(token_is_keyword(name, KEYWORD_INCLUDE)){
+        preprocessor_include(preprocessor);
+    } else if(preprocessor_is_identifier(name, names->define)){
+        preprocessor_define(preprocessor);
+    } else if(preprocessor_is_identifier(name, names->undef)){
+        ptr_map_set(preprocessor->macros, preprocessor_expect_name(preprocessor, 1, "undef"), NULL);
+    } else if(preprocessor_is_identifier(name, names->pragma)){
+        preprocessor_pragma(preprocessor, frame);
+    } else if(preprocessor_is_identifier(name, names->error)){
+        preprocessor_message(preprocessor, true);
+    } else if(preprocessor_is_identifier(name, names->warning)){
+        preprocessor_message(preprocessor, false);
+    } else if(preprocessor_is_identifier(name, names->line)){
+        //位置由token的偏移决定，#line不改变报错位置
+    } else {
+        compiler_error(compiler, "未知的预处理指令\n");
+    }
+}
+
+//一个文件读完了，回到包含它的文件
+static void preprocessor_pop_frame(struct preprocessor* preprocessor, struct preprocessor_frame* frame){
+    if(vector_count(preprocessor->conditionals)>frame->conditional_depth){
+        struct preprocessor_conditional* conditional=vector_back(preprocessor->conditionals);
+        preprocessor->compiler->offset=conditional->offset;
+        compiler_error(preprocessor->compiler, "#if没有对应的#endif\n");
+    }
+    vector_pop(preprocessor->frames);
+}
+
+//返回处理完指令和条件编译、还没有展开宏的下一个token，全部读完时返回NULL
+//返回的token在下一次调用之前有效
+struct token* preprocessor_read_token(struct preprocessor* preprocessor){
+    struct preprocessor_frame* frame;
+    while((frame=preprocessor_frame(preprocessor))){
+        struct token_stream* tokens=frame->tokens;
+        if(!token_stream_has(tokens, frame->index)){
+            preprocessor_pop_frame(preprocessor, frame);
+            continue;
+        }
+        //流式读取时编译文件已经读过的token可以丢掉了
+        tokens->pindex=frame->index;
+        token_stream_discard_consumed(tokens);
+
+        int type=token_stream_type(tokens, frame->index);
+        if(type==TOKEN_TYPE_SYMBOL&&token_stream_cval(tokens, frame->index)=='#'&&token_stream_line_start(tokens, frame->index)){
+            frame->index++;
+            preprocessor_directive(preprocessor, frame);
+            continue;
+        }
+        if(preprocessor_is_skipping(preprocessor)){
+            frame->index++;
+            continue;
+        }
+        token_stream_get(tokens, frame->index++, &preprocessor->token);
+        return &preprocessor->token;
+    }
+    return NULL;
+}
+
+//返回预处理和宏展开之后的下一个token，全部读完时返回NULL
+//返回的token在下一次调用之前有效
+struct token* preprocessor_next_token(struct preprocessor* preprocessor){
+    //没有宏的时候不需要经过宏展开
+    if(!preprocessor->macros->count&&!vector_count(preprocessor->pending)){
+        struct token* token=preprocessor_read_token(preprocessor);
+        //读这个token时可能刚处理完第一条#define，它还要经过宏展开
+        if(!token||!preprocessor->macros->count){
+            return token;
+        }
+        struct preprocessor_pending pending={.token=*token};
+        vector_push(preprocessor->pending, &pending);
+    }
+    if(!macro_next_token(preprocessor, &preprocessor->token)){
+        return NULL;
+    }
+    return &preprocessor->token;
+}
+
+//从frame->index开始找下一个在行首的#，返回它的下标，没有时返回token总数
+//macros不为NULL时遇到其中的宏名也停下来
+//直接看类型、值和标志数组，只能用于已经全部读进来的token
+static int preprocessor_find_directive(struct preprocessor_frame* frame, struct ptr_map* macros){
+    struct token_stream* tokens=frame->tokens;
+    const uint8_t* types=vector_data_ptr(tokens->types);
+    const unsigned long long* values=vector_data_ptr(tokens->values);
+    int total=token_stream_count(tokens);
+    int i=frame->index;
+    for(;i<total;i++){
+        int type=types[i-tokens->base];
+        struct token token={.llnum=values[i-tokens->base]};
+        if(type==TOKEN_TYPE_SYMBOL&&token.cval=='#'&&token_stream_line_start(tokens, i)){
+            break;
+        }
+        if(macros&&type==TOKEN_TYPE_IDENTIFIER&&ptr_map_get(macros, token.sval)){
+            break;
+        }
+    }
+    return i;
+}
+
+//编译文件已经全部词法分析完时使用：两条指令或宏之间的token整段拷贝到out，不用一个个读出来
+//遇到宏名时逐个token读取，直到展开的结果都读完
+void preprocessor_run(struct preprocessor* preprocessor, struct token_stream* out){
+    struct preprocessor_frame* frame;
+    while((frame=preprocessor_frame(preprocessor))){
+        bool skipping=preprocessor_is_skipping(preprocessor);
+        struct ptr_map* macros=!skipping&&preprocessor->macros->count?preprocessor->macros:NULL;
+        int end=preprocessor_find_directive(frame, macros);
+        if(!skipping&&end>frame->index){
+            token_stream_append(out, frame->tokens, frame->index, end-frame->index);
+        }
+        frame->index=end;
+        if(end>=token_stream_count(frame->tokens)){
+            preprocessor_pop_frame(preprocessor, frame);
+            continue;
+        }
+        if(token_stream_type(frame->tokens, end)==TOKEN_TYPE_IDENTIFIER){
+            struct token* token;
+            do{
+                token=preprocessor_next_token(preprocessor);
+                if(token){
+                    token_stream_push(out, token);
+                }
+            } while(token&&vector_count(preprocessor->pending));
+            continue;
+        }
+        //跳过#
+        frame->index++;
+        preprocessor_directive(preprocessor, frame);
+    }
+}
@@ -0,0 +1,154 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <assert.h>
+
+//增量词法分析：源码被编辑后只重新分析受影响的那一段token，再拼回原来的token_vec
+//从编辑位置之前最近的安全token开始重新分析，直到新的token起点和旧的token起点重新对齐为止
+
+//词法分析器在这个token之前处于初始状态，可以从这里重新开始：
+//不在括号里面（括号里的token带有between_brackets），也不是回到括号外的')'，
+//也不是#include后面需要看上一个token才能识别的<...>
+static bool relex_is_restart_token(struct token* tokens, int index){
+    struct token* token=&tokens[index];
+    if(token->between_brackets||token_is_symbol(token, ')')){
+        return false;
+    }
+    return !(index>0&&token_is_keyword(&tokens[index-1], KEYWORD_INCLUDE));
+}
+
+static bool relex_last_is_include(struct lex_process* lex_process){
+    struct token* last=vector_back_or_null(lex_process->token_vec);
+    return last&&token_is_keyword(last, KEYWORD_INCLUDE);
+}
+
+//把多处编辑合并成旧源码中的一段[*start, *old_end)，返回新旧源码长度之差
+static int64_t relex_merge_edits(struct lex_edit* edits, int total, uint32_t* start, uint32_t* old_end){
+    int64_t delta=0;
+    *start=UINT32_MAX;
+    *old_end=0;
+    for(int i=0;i<total;i++){
+        if(edits[i].offset<*start){
+            *start=edits[i].offset;
+        }
+        if(edits[i].offset+edits[i].removed>*old_end){
+            *old_end=edits[i].offset+edits[i].removed;
+        }
+        delta+=(int64_t)edits[i].inserted-edits[i].removed;
+    }
+    return delta;
+}
+
+//token_vec是source的全部token，data和size是编辑之后的源码，edits中的偏移都是相对编辑之前的源码
+//成功时token_vec中[result->first, result->old_end)的旧token被替换成了[result->first, result->new_end)
+//source->data改为指向data，调用者需要保证data在之后使用这些token时仍然有效
+int lex_relex(struct compile_process* compiler, struct vector* token_vec, struct source_file* source, const char* data, size_t size, struct lex_edit* edits, int total, struct lex_relex_result* result){
+    //源码没有保留在内存中（从管道读取），没法重新读取
+    //源码长度变化时后面的源码的base也要跟着变，所以只支持最后一份源码
+    if(!source->data||!total||source!=vector_back_ptr(compiler->source_files)){
+        return LEXICAL_AYALYSIS_INPUT_ERROR;
+    }
+    uint32_t start, old_end;
+    int64_t delta=relex_merge_edits(edits, total, &start, &old_end);
+    if(old_end>source->size||(int64_t)source->size+delta!=(int64_t)size){
+        return LEXICAL_AYALYSIS_INPUT_ERROR;
+    }
+
+    struct token* tokens=vector_data_ptr(token_vec);
+    int count=vector_count(token_vec);
+    uint32_t base=source->base;
+    //编辑区域在新源码中的结束位置，过了这里新旧源码的内容又是一样的
+    uint32_t new_end=base+old_end+delta;
+
+    //找到起点在编辑位置之前的最后一个token，它可能被编辑延长，所以要从它或者更早的安全token开始
+    int first=0;
+    for(int low=0, high=count-1;low<=high;){
+        int mid=(low+high)/2;
+        if(tokens[mid].offset<base+start){
+            first=mid;
+            low=mid+1;
+        } else {
+            high=mid-1;
+        }
+    }
+    while(first>0&&!relex_is_restart_token(tokens, first)){
+        first--;
+    }
+
+    //从这里开始用新源码重新分析
+    const char* old_data=source->data;
+    uint32_t old_size=source->size;
+    source->data=data;
+    source->size=size;
+    struct lex_process* lex_process=lex_process_create(compiler, &lexer_source_functions, source);
+    lex_process->offset=first?tokens[first].offset:base;
+    if(first>0){
+        //上一个token留给词法分析器查看，比如判断<是不是#include的文件名
+        vector_push(lex_process->token_vec, &tokens[first-1]);
+    }
+
+    jmp_buf error_jmp;
+    jmp_buf* old_error_jmp=compiler->error_jmp;
+    if(setjmp(error_jmp)){
+        //出错时token_vec保持原样
+        compiler->error_jmp=old_error_jmp;
+        source->data=old_data;
+        source->size=old_size;
+        lex_process_free(lex_process);
+        return LEXICAL_AYALYSIS_INPUT_ERROR;
+    }
+    compiler->error_jmp=&error_jmp;
+
+    //第一个可能重新对齐的旧token
+    int resync=first;
+    while(1){
+        uint32_t offset=lex_process->offset;
+        if(offset>=new_end){
+            while(resync<count&&tokens[resync].offset+delta<offset){
+                resync++;
+            }
+            //新token将从旧token的对应位置开始，并且两边的词法分析器状态相同，之后的token都不会变
+            if(resync<count&&tokens[resync].offset+delta==offset&&
+                !lex_is_in_expression(lex_process)&&relex_is_restart_token(tokens, resync)&&
+                relex_last_is_include(lex_process)==(resync>0&&token_is_keyword(&tokens[resync-1], KEYWORD_INCLUDE))){
+                break;
+            }
+        }
+        if(!lex_next_token(lex_process)){
+            resync=count;
+            break;
+        }
+    }
+    compiler->error_jmp=old_error_jmp;
+
+    //拼接：去掉开头借来的上一个token，剩下的替换旧token，之后的token平移delta
+    struct vector* new_tokens=lex_process->token_vec;
+    int borrowed=first>0?1:0;
+    int added=vector_count(new_tokens)-borrowed;
+    vector_splice(token_vec, first, resync-first, vector_at(new_tokens, borrowed), added);
+    tokens=vector_data_ptr(token_vec);
+    int new_count=vector_count(token_vec);
+    //括号的起点和字符串、注释的文本也都是源码偏移
+    if(delta){
+        for(int i=first+added;i<new_count;i++){
+            tokens[i].offset+=delta;
+            if(tokens[i].between_brackets){
+                tokens[i].between_brackets+=delta;
+            }
+            if((tokens[i].type==TOKEN_TYPE_STRING||tokens[i].type==TOKEN_TYPE_COMMENT)&&!(tokens[i].span.offset&TOKEN_SPAN_POOL)){
+                tokens[i].span.offset+=delta;
+            }
+        }
+    }
+    lex_process_free(lex_process);
+
+    //行的起始位置变了，下次换算位置时重新建立
+    if(source->line_starts){
+        vector_free(source->line_starts);
+        source->line_starts=NULL;
+    }
+
+    result->first=first;
+    result->old_end=resync;
+    result->new_end=first+added;
+    return LEXICAL_ANALYSIS_ALL_OK;
+}
@@ -0,0 +1,223 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdio.h>
+#include <string.h>
+
+//增量词法分析的用例：对old做edits的编辑得到new，重新分析后的token应当和直接分析new的完全相同
+struct relex_test_case{
+    const char* old;
+    const char* new;
+    struct lex_edit edits[2];
+    int total;
+};
+
+static const struct relex_test_case relex_test_cases[]={
+    //改长一个数字，后面的token都要平移
+    {"a=1;\nb=2;\n", "a=100;\nb=2;\n", {{2, 1, 3}}, 1},
+    //中间插入一整行
+    {"a;\nc;\n", "a;\nb;\nc;\n", {{3, 0, 3}}, 1},
+    //删掉一段
+    {"x=1+2;\ny=3;\n", "x=1;\ny=3;\n", {{3, 2, 0}}, 1},
+    //两处编辑合并成一段，中间的token变成了注释
+    {"a=1;\nb=2;\n", "/*a=1;*/\nb=2;\n", {{0, 0, 2}, {4, 0, 2}}, 2},
+    //编辑在括号里，要从括号外面开始重新分析
+    {"f(a, b);\nx=1;\n", "f(a, bb+c);\nx=1;\n", {{5, 1, 4}}, 1},
+    //字符串里的编辑
+    {"s=\"ab\";\nt=1;\n", "s=\"a b c\";\nt=1;\n", {{4, 1, 4}}, 1}
+};
+
+//数字常量的用例：number单独作为一行源码分析，error为true时应当报错
+struct number_test_case{
+    const char* number;
+    unsigned long long value;
+    double dvalue;
+    int type;
+    bool is_unsigned;
+    bool error;
+};
+
+static const struct number_test_case number_test_cases[]={
+    {"42", 42, 0, NUMBER_TYPE_NORMAL, false, false},
+    //后缀大小写和顺序都可以不同
+    {"42u", 42, 0, NUMBER_TYPE_NORMAL, true, false},
+    {"42l", 42, 0, NUMBER_TYPE_LONG, false, false},
+    {"42LL", 42, 0, NUMBER_TYPE_LONG_LONG, false, false},
+    {"42uLL", 42, 0, NUMBER_TYPE_LONG_LONG, true, false},
+    {"42llU", 42, 0, NUMBER_TYPE_LONG_LONG, true, false},
+    {"42Lu", 42, 0, NUMBER_TYPE_LONG, true, false},
+    //十六进制、八进制和二进制
+    {"0x1F", 31, 0, NUMBER_TYPE_NORMAL, false, false},
+    {"017", 15, 0, NUMBER_TYPE_NORMAL, false, false},
+    {"0", 0, 0, NUMBER_TYPE_NORMAL, false, false},
+    {"0b101", 5, 0, NUMBER_TYPE_NORMAL, false, false},
+    //int放不下时十进制数变成long，其他进制先变成unsigned int
+    {"2147483647", 2147483647, 0, NUMBER_TYPE_NORMAL, false, false},
+    {"2147483648", 2147483648ULL, 0, NUMBER_TYPE_LONG, false, false},
+    {"0x80000000", 0x80000000ULL, 0, NUMBER_TYPE_NORMAL, true, false},
+    {"0x100000000", 0x100000000ULL, 0, NUMBER_TYPE_LONG, false, false},
+    {"4294967295u", 4294967295ULL, 0, NUMBER_TYPE_NORMAL, true, false},
+    {"4294967296u", 4294967296ULL, 0, NUMBER_TYPE_LONG, true, false},
+    //有符号的64位放不下时当作无符号数，unsigned long long也放不下时报错
+    {"0xffffffffffffffff", 0xffffffffffffffffULL, 0, NUMBER_TYPE_LONG, true, false},
+    {"18446744073709551615", 18446744073709551615ULL, 0, NUMBER_TYPE_LONG, true, false},
+    {"18446744073709551616", 0, 0, 0, false, true},
+    {"0x10000000000000000", 0, 0, 0, false, true},
+    //非法的数字和后缀
+    {"08", 0, 0, 0, false, true},
+    {"0x", 0, 0, 0, false, true},
+    {"0b2", 0, 0, 0, false, true},
+    {"1lul", 0, 0, 0, false, true},
+    {"1uu", 0, 0, 0, false, true},
+    {"12abc", 0, 0, 0, false, true},
+    //浮点数，快速路径和strtod得到的值都要正确舍入
+    {"1.5", 0, 1.5, NUMBER_TYPE_DOUBLE, false, false},
+    {"1.5f", 0, 1.5f, NUMBER_TYPE_FLOAT, false, false},
+    {"0.1", 0, 0.1, NUMBER_TYPE_DOUBLE, false, false},
+    {"0.1f", 0, 0.1f, NUMBER_TYPE_FLOAT, false, false},
+    {".25", 0, 0.25, NUMBER_TYPE_DOUBLE, false, false},
+    {"1e3", 0, 1e3, NUMBER_TYPE_DOUBLE, false, false},
+    {"2.5E-3", 0, 2.5e-3, NUMBER_TYPE_DOUBLE, false, false},
+    {"1e23", 0, 1e23, NUMBER_TYPE_DOUBLE, false, false},
+    {"123456789012345678901234567890.0", 0, 123456789012345678901234567890.0, NUMBER_TYPE_DOUBLE, false, false},
+    {"4.9406564584124654e-324", 0, 4.9406564584124654e-324, NUMBER_TYPE_DOUBLE, false, false},
+    {"0x1p4", 0, 16, NUMBER_TYPE_DOUBLE, false, false},
+    {"0x1.8p1", 0, 3, NUMBER_TYPE_DOUBLE, false, false},
+    {"1.0L", 0, 1, NUMBER_TYPE_DOUBLE, false, false},
+    {"1e", 0, 0, 0, false, true},
+    {"1e+", 0, 0, 0, false, true},
+    {"0x1.8", 0, 0, 0, false, true},
+    {"1.5u", 0, 0, 0, false, true},
+    {"1e400", 0, 0, 0, false, true}
+};
+
+static struct lex_process* lexer_test_lex(struct compile_process* process, const char* data){
+    struct source_file* source=compile_process_add_source(process, "lexer_test.c", data, strlen(data));
+    struct lex_process* lex_process=lex_process_create(process, &lexer_source_functions, source);
+    lex_process->offset=source->base;
+    if(lex(lex_process)!=LEXICAL_ANALYSIS_ALL_OK){
+        lex_process_free(lex_process);
+        return NULL;
+    }
+    return lex_process;
+}
+
+//字符串和注释的文本在各自的编译过程里，按span取出来比较
+static bool lexer_test_same_text(struct compile_process* a_process, struct token* a, struct compile_process* b_process, struct token* b){
+    return a->span.len==b->span.len&&
+           memcmp(compile_process_text(a_process, a->span), compile_process_text(b_process, b->span), a->span.len)==0;
+}
+
+static bool lexer_test_same_token(struct compile_process* a_process, struct token* a, struct compile_process* b_process, struct token* b){
+    if(a->type!=b->type||a->offset!=b->offset||a->whitespace!=b->whitespace||!a->between_brackets!=!b->between_brackets){
+        return false;
+    }
+    switch(a->type){
+        case TOKEN_TYPE_IDENTIFIER:
+        return strcmp(a->sval, b->sval)==0;
+        case TOKEN_TYPE_STRING:
+        case TOKEN_TYPE_COMMENT:
+        return lexer_test_same_text(a_process, a, b_process, b);
+        case TOKEN_TYPE_KEYWORD:
+        return a->kw==b->kw;
+        case TOKEN_TYPE_OPERATOR:
+        return a->op==b->op;
+        case TOKEN_TYPE_SYMBOL:
+        return a->cval==b->cval;
+        case TOKEN_TYPE_NUMBER:
+        return a->llnum==b->llnum;
+    }
+    return true;
+}
+
+static bool lexer_test_same_tokens(struct compile_process* a_process, struct vector* a, struct compile_process* b_process, struct vector* b){
+    if(vector_count(a)!=vector_count(b)){
+        return false;
+    }
+    for(int i=0;i<vector_count(a);i++){
+        if(!lexer_test_same_token(a_process, vector_at(a, i), b_process, vector_at(b, i))){
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool relex_test_run(const struct relex_test_case* test){
+    struct compile_process* process=compile_process_create_for_memory(0);
+    struct compile_process* expected_process=compile_process_create_for_memory(0);
+    struct lex_process* lexed=lexer_test_lex(process, test->old);
+    struct lex_process* expected=lexer_test_lex(expected_process, test->new);
+    bool ok=false;
+    if(lexed&&expected){
+        struct vector* tokens=lex_process_tokens(lexed);
+        struct source_file* source=vector_back_ptr(process->source_files);
+        struct lex_relex_result result;
+        if(lex_relex(process, tokens, source, test->new, strlen(test->new), (struct lex_edit*)test->edits, test->total, &result)!=LEXICAL_ANALYSIS_ALL_OK){
+            fprintf(stderr, "%s：增量分析失败\n", test->new);
+        } else if(!lexer_test_same_tokens(process, tokens, expected_process, lex_process_tokens(expected))){
+            fprintf(stderr, "%s：增量分析得到%i个token，和直接分析的%i个不同\n", test->new,
+                vector_count(tokens), vector_count(lex_process_tokens(expected)));
+        } else {
+            ok=true;
+        }
+    } else {
+        fprintf(stderr, "%s：词法分析失败\n", test->old);
+    }
+    if(lexed){
+        lex_process_free(lexed);
+    }
+    if(expected){
+        lex_process_free(expected);
+    }
+    compile_process_free(process);
+    compile_process_free(expected_process);
+    return ok;
+}
+
+static bool number_test_run(const struct number_test_case* test){
+    struct compile_process* process=compile_process_create_for_memory(0);
+    char source[128];
+    snprintf(source, sizeof(source), "x=%s;\n", test->number);
+    bool failed=compile_memory(process, "lexer_test.c", source, strlen(source))!=COMPILOR_FILE_COMPLETE_OK;
+    bool ok=false;
+    if(test->error||failed){
+        ok=test->error==failed;
+        if(!ok){
+            fprintf(stderr, "%s：%s\n", test->number, test->error?"应当报错":"词法分析失败");
+        }
+    } else {
+        struct token token={0};
+        for(int i=0;i<token_stream_count(process->token_stream)&&token.type!=TOKEN_TYPE_NUMBER;i++){
+            token_stream_get(process->token_stream, i, &token);
+        }
+        bool is_float=test->type==NUMBER_TYPE_FLOAT||test->type==NUMBER_TYPE_DOUBLE;
+        ok=token.type==TOKEN_TYPE_NUMBER&&token.num.type==test->type&&token.num.is_unsigned==test->is_unsigned&&
+           (is_float?token.dnum==test->dvalue:token.llnum==test->value);
+        if(!ok){
+            fprintf(stderr, "%s：得到类型%i%s，值%llu（%.17g）\n", test->number, token.num.type,
+                token.num.is_unsigned?"（无符号）":"", token.llnum, token.dnum);
+        }
+    }
+    compile_process_free(process);
+    return ok;
+}
+
+int main(){
+    int total=sizeof(relex_test_cases)/sizeof(relex_test_cases[0]);
+    int failed=0;
+    for(int i=0;i<total;i++){
+        if(!relex_test_run(&relex_test_cases[i])){
+            failed++;
+        }
+    }
+    printf("增量词法分析：%i个用例，%i个失败\n", total, failed);
+
+    int number_total=sizeof(number_test_cases)/sizeof(number_test_cases[0]);
+    int number_failed=0;
+    for(int i=0;i<number_total;i++){
+        if(!number_test_run(&number_test_cases[i])){
+            number_failed++;
+        }
+    }
+    printf("数字常量：%i个用例，%i个失败\n", number_total, number_failed);
+    return failed||number_failed?1:0;
+}
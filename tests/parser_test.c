@@ -0,0 +1,193 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/buffer.h"
+#include <stdio.h>
+#include <string.h>
+
+//每个用例是一条语句，语法分析后的第一个顶层节点写成前缀形式应当是tree
+//运算符写成(运算符 操作数...)，后缀的++、--在运算符后面加post，函数调用的运算符是(
+//常量写成带后缀的C常量，char和short写成(char)44，能折叠的常量运算只剩下结果
+struct parser_test_case{
+    const char* source;
+    const char* tree;
+};
+
+static const struct parser_test_case parser_test_cases[]={
+    //sizeof的结果是unsigned long，和别的常量一起折叠
+    {"sizeof(int)+1;", "5ul"},
+    {"sizeof 3;", "4ul"},
+    {"sizeof(char)*sizeof x;", "(* 1ul (sizeof x))"},
+    {"(sizeof(short));", "2ul"},
+    //优先级和结合性
+    {"a=b+c*d-e;", "(= a (- (+ b (* c d)) e))"},
+    {"a=b=c;", "(= a (= b c))"},
+    {"a||b&&c|d^e&f==g<h<<i;", "(|| a (&& b (| c (^ d (& e (== f (< g (<< h i))))))))"},
+    {"a?b:c?d:e;", "(? a b (? c d e))"},
+    //前缀、后缀运算符，函数调用和下标
+    {"!-~x;", "(! (- (~ x)))"},
+    {"*p++;", "(* (++post p))"},
+    {"f(a, b+1)[i]--;", "(--post (bracket (( f a (+ b 1)) i))"},
+    {"f();", "(( f)"},
+    //类型转换
+    {"(char)300;", "(char)44"},
+    {"(unsigned long*)p+1;", "(+ (cast unsigned long* p) 1)"},
+    //常量折叠：整数提升、寻常算术转换和回绕
+    {"1+2*3-4/3;", "6"},
+    {"-(2147483647u+1);", "2147483648u"},
+    {"-1<1u;", "0"},
+    {"(unsigned char)-1+1;", "256"},
+    {"-7/2+-7%2;", "-4"},
+    {"1l<<40;", "1099511627776l"},
+    {"1?2:3u;", "2u"},
+    {"1.5f*2;", "3f"},
+    {"(int)2.9+0.5;", "2.5"},
+    //只有部分操作数是常量时只折叠常量的部分
+    {"x+(2*3);", "(+ x 6)"},
+    //未定义行为留到运行时
+    {"1/0;", "(/ 1 0)"},
+    {"1<<32;", "(<< 1 32)"}
+};
+
+static const char* parser_test_type_names[]={
+    [DATA_TYPE_VOID]="void",
+    [DATA_TYPE_CHAR]="char",
+    [DATA_TYPE_SHORT]="short",
+    [DATA_TYPE_INT]="int",
+    [DATA_TYPE_LONG]="long",
+    [DATA_TYPE_LONG_LONG]="long long",
+    [DATA_TYPE_FLOAT]="float",
+    [DATA_TYPE_DOUBLE]="double",
+    [DATA_TYPE_STRUCT]="struct",
+    [DATA_TYPE_UNION]="union"
+};
+
+static void parser_test_write(struct buffer* buffer, const char* str){
+    for(;*str;str++){
+        buffer_write(buffer, *str);
+    }
+}
+
+static void parser_test_write_type(struct buffer* buffer, struct node_datatype* datatype){
+    if(datatype->flags&DATA_TYPE_FLAG_UNSIGNED){
+        parser_test_write(buffer, "unsigned ");
+    }
+    parser_test_write(buffer, parser_test_type_names[datatype->type]);
+    for(int i=0;i<datatype->pointer_depth;i++){
+        buffer_write(buffer, '*');
+    }
+}
+
+static void parser_test_write_number(struct buffer* buffer, struct node* node){
+    char number[64];
+    const char* suffix="";
+    switch(node->num.type){
+        case DATA_TYPE_FLOAT:
+        case DATA_TYPE_DOUBLE:
+        snprintf(number, sizeof(number), "%g%s", node->dnum, node->num.type==DATA_TYPE_FLOAT?"f":"");
+        parser_test_write(buffer, number);
+        return;
+        case DATA_TYPE_CHAR:
+        case DATA_TYPE_SHORT:
+        buffer_write(buffer, '(');
+        if(node->num.is_unsigned){
+            parser_test_write(buffer, "unsigned ");
+        }
+        parser_test_write(buffer, parser_test_type_names[node->num.type]);
+        buffer_write(buffer, ')');
+        break;
+        case DATA_TYPE_LONG:
+        suffix="l";
+        break;
+        case DATA_TYPE_LONG_LONG:
+        suffix="ll";
+        break;
+    }
+    if(node->num.is_unsigned){
+        snprintf(number, sizeof(number), "%llu%s%s", node->llnum, node->num.type<DATA_TYPE_INT?"":"u", suffix);
+    } else {
+        snprintf(number, sizeof(number), "%lld%s", (long long)node->llnum, suffix);
+    }
+    parser_test_write(buffer, number);
+}
+
+static void parser_test_write_node(struct compile_process* process, struct buffer* buffer, node_ref ref){
+    struct node* node=node_get(process, ref);
+    switch(node->type){
+        case NODE_TYPE_NUMBER:
+        parser_test_write_number(buffer, node);
+        return;
+        case NODE_TYPE_IDENTIFIER:
+        parser_test_write(buffer, node->sval);
+        return;
+    }
+
+    buffer_write(buffer, '(');
+    switch(node->type){
+        case NODE_TYPE_EXPRESSION:
+        case NODE_TYPE_NUARY:
+        parser_test_write(buffer, operator_name(node->op));
+        if(node->flags&NODE_FLAG_POSTFIX){
+            parser_test_write(buffer, "post");
+        }
+        break;
+        case NODE_TYPE_EXPRESSION_PARENTHESES:
+        parser_test_write(buffer, "paren");
+        break;
+        case NODE_TYPE_TENARY:
+        buffer_write(buffer, '?');
+        break;
+        case NODE_TYPE_BRACKET:
+        parser_test_write(buffer, "bracket");
+        break;
+        case NODE_TYPE_CAST:
+        parser_test_write(buffer, "cast ");
+        parser_test_write_type(buffer, &node->datatype);
+        break;
+        case NODE_TYPE_SIZEOF:
+        parser_test_write(buffer, "sizeof");
+        if(node->flags&NODE_FLAG_SIZEOF_TYPE){
+            buffer_write(buffer, ' ');
+            parser_test_write_type(buffer, &node->datatype);
+        }
+        break;
+        default:
+        parser_test_write(buffer, node_type_name(node->type));
+    }
+    for(uint32_t i=0;i<node->children.count;i++){
+        buffer_write(buffer, ' ');
+        //node_get返回的指针在创建节点之后可能失效，这里只读取不会创建
+        parser_test_write_node(process, buffer, node_list_at(process, node->children, i));
+    }
+    buffer_write(buffer, ')');
+}
+
+static bool parser_test_run(const struct parser_test_case* test){
+    struct compile_process* process=compile_process_create_for_memory(COMPILE_PROCESS_FLAG_NO_WARNINGS);
+    bool ok=false;
+    if(compile_memory(process, "parser_test.c", test->source, strlen(test->source))==COMPILOR_FILE_COMPLETE_OK&&!vector_empty(process->node_tree_vec)){
+        struct buffer* buffer=buffer_create();
+        parser_test_write_node(process, buffer, *(node_ref*)vector_at(process->node_tree_vec, 0));
+        buffer_write(buffer, '\0');
+        ok=strcmp(buffer->data, test->tree)==0;
+        if(!ok){
+            fprintf(stderr, "%s：得到%s，应当是%s\n", test->source, buffer->data, test->tree);
+        }
+        buffer_free(buffer);
+    } else {
+        fprintf(stderr, "%s：编译失败\n", test->source);
+    }
+    compile_process_free(process);
+    return ok;
+}
+
+int main(){
+    int total=sizeof(parser_test_cases)/sizeof(parser_test_cases[0]);
+    int failed=0;
+    for(int i=0;i<total;i++){
+        if(!parser_test_run(&parser_test_cases[i])){
+            failed++;
+        }
+    }
+    printf("语法分析：%i个用例，%i个失败\n", total, failed);
+    return failed?1:0;
+}
@@ -0,0 +1,153 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+//预编译头文件的往返：先用-emit-pch生成pch.h.pch，再用-include-pch编译main.c
+//结果应当和不用预编译头文件、直接#include "pch.h"得到的token相同
+static const char* pch_test_headers[][2]={
+    {"pch.h", "#ifndef PCH_H\n#define PCH_H\n#include \"inner.h\"\n#define N 4\nh=1;\n#endif\n"},
+    {"inner.h", "#pragma once\ni=2;\n"}
+};
+
+//编译文件本身再包含一次，两个头文件都应当跳过
+static const char* pch_test_source="#include \"pch.h\"\n#include \"inner.h\"\n#if N==4\nx=h+i;\n#endif\n";
+
+static bool pch_test_write(const char* dir, const char* name, const char* text){
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE* fp=fopen(path, "w");
+    if(!fp){
+        return false;
+    }
+    fputs(text, fp);
+    return fclose(fp)==0;
+}
+
+//字符串和注释的文本在各自的编译过程里，按span取出来比较
+static bool pch_test_same_text(struct compile_process* a_process, struct token* a, struct compile_process* b_process, struct token* b){
+    return a->span.len==b->span.len&&
+           memcmp(compile_process_text(a_process, a->span), compile_process_text(b_process, b->span), a->span.len)==0;
+}
+
+static bool pch_test_same_token(struct compile_process* a_process, struct token* a, struct compile_process* b_process, struct token* b){
+    if(a->type!=b->type){
+        return false;
+    }
+    switch(a->type){
+        case TOKEN_TYPE_IDENTIFIER:
+        return strcmp(a->sval, b->sval)==0;
+        case TOKEN_TYPE_STRING:
+        return pch_test_same_text(a_process, a, b_process, b);
+    }
+    return a->llnum==b->llnum;
+}
+
+//下一个要比较的token，跳过换行和注释，没有了返回false
+static bool pch_test_next(struct token_stream* tokens, int* index, struct token* token){
+    while(*index<token_stream_count(tokens)){
+        token_stream_get(tokens, (*index)++, token);
+        if(token->type!=TOKEN_TYPE_NEWLINE&&token->type!=TOKEN_TYPE_COMMENT){
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool pch_test_same_tokens(struct compile_process* a_process, struct token_stream* a, struct compile_process* b_process, struct token_stream* b){
+    int a_index=0;
+    int b_index=0;
+    struct token a_token;
+    struct token b_token;
+    while(pch_test_next(b, &b_index, &b_token)){
+        if(!pch_test_next(a, &a_index, &a_token)||!pch_test_same_token(a_process, &a_token, b_process, &b_token)){
+            return false;
+        }
+    }
+    return !pch_test_next(a, &a_index, &a_token);
+}
+
+//用pch编译main.c，结果应当是expected，返回编译是否成功
+static int pch_test_compile(const char* dir, const char* pch, struct compile_process* expected, bool* same){
+    char filename[512];
+    snprintf(filename, sizeof(filename), "%s/main.c", dir);
+    struct compile_process* process=compile_process_create_for_memory(0);
+    process->options.include_pch=pch;
+    int res=compile_memory(process, filename, pch_test_source, strlen(pch_test_source));
+    *same=res==COMPILOR_FILE_COMPLETE_OK&&
+          process->stats.headers==0&&process->stats.includes_skipped==2&&process->stats.pch_tokens>0&&
+          pch_test_same_tokens(process, process->token_stream, expected, expected->token_stream);
+    compile_process_free(process);
+    return res;
+}
+
+int main(){
+    char dir[]="/tmp/pch_test.XXXXXX";
+    if(!mkdtemp(dir)){
+        perror("mkdtemp");
+        return 1;
+    }
+    int header_count=sizeof(pch_test_headers)/sizeof(pch_test_headers[0]);
+    for(int i=0;i<header_count;i++){
+        if(!pch_test_write(dir, pch_test_headers[i][0], pch_test_headers[i][1])){
+            perror(pch_test_headers[i][0]);
+            return 1;
+        }
+    }
+    char header[512];
+    char pch[512];
+    char filename[512];
+    snprintf(header, sizeof(header), "%s/pch.h", dir);
+    snprintf(pch, sizeof(pch), "%s/pch.h.pch", dir);
+    snprintf(filename, sizeof(filename), "%s/main.c", dir);
+    int total=0;
+    int failed=0;
+    bool same;
+
+    //不用预编译头文件时应当得到的token
+    struct compile_process* expected=compile_process_create_for_memory(0);
+    if(compile_memory(expected, filename, pch_test_source, strlen(pch_test_source))!=COMPILOR_FILE_COMPLETE_OK){
+        fprintf(stderr, "%s：编译失败\n", pch_test_source);
+        return 1;
+    }
+
+    //生成之后读入，头文件不再读取，得到的token和直接包含相同
+    total++;
+    if(compile_file(header, pch, COMPILE_PROCESS_FLAG_EMIT_PCH, NULL)!=COMPILOR_FILE_COMPLETE_OK){
+        fprintf(stderr, "%s：生成预编译头文件失败\n", header);
+        failed++;
+    } else if(pch_test_compile(dir, pch, expected, &same)!=COMPILOR_FILE_COMPLETE_OK||!same){
+        fprintf(stderr, "%s：用预编译头文件编译的结果和直接包含不同\n", pch);
+        failed++;
+    }
+
+    //用到的头文件改过之后预编译头文件不能再用
+    total++;
+    if(!pch_test_write(dir, "inner.h", "#pragma once\ni=22;\n")||
+        pch_test_compile(dir, pch, expected, &same)==COMPILOR_FILE_COMPLETE_OK){
+        fprintf(stderr, "%s：头文件改过之后仍然用了预编译头文件\n", pch);
+        failed++;
+    }
+
+    //损坏的预编译头文件报错，不能读到文件外面
+    total++;
+    struct stat st;
+    if(stat(pch, &st)!=0||truncate(pch, st.st_size/2)!=0||pch_test_compile(dir, pch, expected, &same)==COMPILOR_FILE_COMPLETE_OK){
+        fprintf(stderr, "%s：损坏的预编译头文件没有报错\n", pch);
+        failed++;
+    }
+
+    compile_process_free(expected);
+    unlink(pch);
+    for(int i=0;i<header_count;i++){
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", dir, pch_test_headers[i][0]);
+        unlink(path);
+    }
+    rmdir(dir);
+    printf("预编译头文件：%i个用例，%i个失败\n", total, failed);
+    return failed?1:0;
+}
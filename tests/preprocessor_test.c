@@ -0,0 +1,185 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+//预处理的用例：source预处理之后的token应当和直接分析expected得到的相同，换行和注释不比较
+//源码放在临时目录里的main.c，#include "..."在这个目录里查找，#include <...>在它的inc子目录里查找
+struct preprocessor_test_case{
+    const char* source;
+    const char* expected;
+    //读取的头文件数和因为include guard或者#pragma once跳过的#include数
+    size_t headers;
+    size_t includes_skipped;
+};
+
+//临时目录里的头文件，inc/开头的放在inc子目录里
+static const char* preprocessor_test_headers[][2]={
+    {"guard.h", "// 注释不影响识别include guard\n#ifndef GUARD_H\n#define GUARD_H\ng=1;\n#endif\n"},
+    {"once.h", "#pragma once\no=2;\n"},
+    {"plain.h", "p=3;\n"},
+    {"nested.h", "#include \"guard.h\"\nn=4;\n"},
+    {"inc/angled.h", "#ifndef ANGLED_H\n#define ANGLED_H\na=5;\n#endif\n"},
+    //#endif之后还有内容，不是include guard
+    {"open.h", "#ifndef OPEN_H\n#define OPEN_H\n#endif\nopen=6;\n"}
+};
+
+static const struct preprocessor_test_case preprocessor_test_cases[]={
+    //#ifdef、#ifndef和#else
+    {"#define A\n#ifdef A\nx=1;\n#else\nx=2;\n#endif\n#ifndef A\ny=1;\n#endif\n", "x=1;\n", 0, 0},
+    //#if的条件：数字宏、defined、运算符优先级
+    {"#define V 2\n#if V*2+1==5&&!defined(B)\nx=1;\n#elif 1\nx=2;\n#else\nx=3;\n#endif\n", "x=1;\n", 0, 0},
+    {"#if 0\nx=1;\n#elif defined V||3>2\nx=2;\n#endif\n", "x=2;\n", 0, 0},
+    //嵌套的条件，外层没有选中时里面的分支都不选中
+    {"#if 0\n#if 1\nx=1;\n#else\nx=2;\n#endif\n#else\nx=3;\n#endif\n", "x=3;\n", 0, 0},
+    //#undef之后不再有定义
+    {"#define A\n#undef A\n#ifdef A\nx=1;\n#endif\ny=2;\n", "y=2;\n", 0, 0},
+    //include guard：头文件只读取一次，第二次包含直接跳过
+    {"#include \"guard.h\"\n#include \"guard.h\"\nx=g;\n", "g=1;\nx=g;\n", 1, 1},
+    {"#pragma once\n#include \"once.h\"\n#include \"once.h\"\nx=o;\n", "o=2;\nx=o;\n", 1, 1},
+    //没有保护的头文件每次都展开，但也只读取一次
+    {"#include \"plain.h\"\n#include \"plain.h\"\n", "p=3;\np=3;\n", 1, 0},
+    {"#include \"nested.h\"\n#include \"guard.h\"\n", "g=1;\nn=4;\n", 2, 1},
+    {"#include <angled.h>\n#include <angled.h>\n", "a=5;\n", 1, 1},
+    {"#include \"open.h\"\n#include \"open.h\"\n", "open=6;\nopen=6;\n", 1, 0},
+    //guard宏已经定义时第一次包含就跳过
+    {"#define GUARD_H\n#include \"guard.h\"\nx=1;\n", "x=1;\n", 1, 1},
+    //宏展开：宏的内容里的宏继续展开
+    {"#define A B+1\n#define B 3\nx=A;\n", "x=3+1;\n", 0, 0},
+    //带参数的宏，实参里的宏先展开，实参里的逗号在括号里时不分隔参数
+    {"#define ADD(a, b) ((a)+(b))\n#define N 4\nx=ADD(N, f(y, 2));\n", "x=((4)+(f(y, 2)));\n", 0, 0},
+    {"#define ID(a) a\nx=ID(ID(ID(1)));\n", "x=1;\n", 0, 0},
+    //名字后面没有'('时带参数的宏不展开
+    {"#define F(a) a\nF=1;\nx=F\n(2);\n", "F=1;\nx=2;\n", 0, 0},
+    //展开过程中不再展开自己，直接和间接的递归都停下来
+    {"#define x x+1\ny=x;\n", "y=x+1;\n", 0, 0},
+    {"#define f g\n#define g f\ny=f;\nz=g;\n", "y=f;\nz=g;\n", 0, 0},
+    {"#define F(a) a+F(a)\nx=F(1);\n", "x=1+F(1);\n", 0, 0},
+    //#把实参变成字符串，中间的空白合并成一个空格
+    {"#define S(a) #a\ns=S(x  +\t(y));\nt=S( a );\n", "s=\"x + (y)\";\nt=\"a\";\n", 0, 0},
+    //##拼接两个token，拼接的结果可以再展开
+    {"#define CAT(a, b) a##b\n#define xy 7\nz=CAT(x, y);\nw=CAT(1, 2);\n", "z=7;\nw=12;\n", 0, 0},
+    //可变参数，GNU的, ## __VA_ARGS__在没有可变参数时去掉逗号
+    {"#define V(a, ...) f(a, __VA_ARGS__)\nx=V(1, 2, 3);\n", "x=f(1, 2, 3);\n", 0, 0},
+    {"#define G(a, ...) f(a, ## __VA_ARGS__)\nx=G(1);\ny=G(1, 2);\n", "x=f(1);\ny=f(1, 2);\n", 0, 0},
+    //#undef之后不再展开，#if的条件也要展开宏
+    {"#define A 1\n#undef A\nx=A;\n", "x=A;\n", 0, 0},
+    {"#define TWO 1+1\n#define EQ(a, b) a==b\n#if EQ(TWO, 2)\nx=1;\n#endif\n", "x=1;\n", 0, 0}
+};
+
+//字符串和注释的文本在各自的编译过程里，按span取出来比较
+static bool preprocessor_test_same_text(struct compile_process* a_process, struct token* a, struct compile_process* b_process, struct token* b){
+    return a->span.len==b->span.len&&
+           memcmp(compile_process_text(a_process, a->span), compile_process_text(b_process, b->span), a->span.len)==0;
+}
+
+static bool preprocessor_test_same_token(struct compile_process* a_process, struct token* a, struct compile_process* b_process, struct token* b){
+    if(a->type!=b->type){
+        return false;
+    }
+    switch(a->type){
+        case TOKEN_TYPE_IDENTIFIER:
+        return strcmp(a->sval, b->sval)==0;
+        case TOKEN_TYPE_STRING:
+        return preprocessor_test_same_text(a_process, a, b_process, b);
+    }
+    return a->llnum==b->llnum;
+}
+
+//下一个要比较的token，跳过换行和注释，没有了返回false
+static bool preprocessor_test_next(struct token_stream* tokens, int* index, struct token* token){
+    while(*index<token_stream_count(tokens)){
+        token_stream_get(tokens, (*index)++, token);
+        if(token->type!=TOKEN_TYPE_NEWLINE&&token->type!=TOKEN_TYPE_COMMENT){
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool preprocessor_test_run(const char* dir, const struct preprocessor_test_case* test){
+    char filename[512];
+    snprintf(filename, sizeof(filename), "%s/main.c", dir);
+    char inc[512];
+    snprintf(inc, sizeof(inc), "%s/inc", dir);
+    const char* include_dirs[]={inc};
+
+    struct compile_process* process=compile_process_create_for_memory(0);
+    struct compile_process* expected=compile_process_create_for_memory(0);
+    process->options.include_dirs=include_dirs;
+    process->options.include_dir_count=1;
+    bool ok=false;
+    if(compile_memory(process, filename, test->source, strlen(test->source))!=COMPILOR_FILE_COMPLETE_OK){
+        fprintf(stderr, "%s：预处理失败\n", test->source);
+    } else if(compile_memory(expected, "expected.c", test->expected, strlen(test->expected))!=COMPILOR_FILE_COMPLETE_OK){
+        fprintf(stderr, "%s：编译失败\n", test->expected);
+    } else if(process->stats.headers!=test->headers||process->stats.includes_skipped!=test->includes_skipped){
+        fprintf(stderr, "%s：读取了%zu个头文件，跳过了%zu次包含，应当是%zu和%zu\n", test->source,
+            process->stats.headers, process->stats.includes_skipped, test->headers, test->includes_skipped);
+    } else {
+        int index=0;
+        int expected_index=0;
+        struct token token;
+        struct token expected_token;
+        bool more;
+        ok=true;
+        while((more=preprocessor_test_next(expected->token_stream, &expected_index, &expected_token))){
+            if(!preprocessor_test_next(process->token_stream, &index, &token)||!preprocessor_test_same_token(process, &token, expected, &expected_token)){
+                ok=false;
+                break;
+            }
+        }
+        if(!more&&preprocessor_test_next(process->token_stream, &index, &token)){
+            ok=false;
+        }
+        if(!ok){
+            fprintf(stderr, "%s：预处理结果和%s不同\n", test->source, test->expected);
+        }
+    }
+    compile_process_free(process);
+    compile_process_free(expected);
+    return ok;
+}
+
+int main(){
+    char dir[]="/tmp/preprocessor_test.XXXXXX";
+    if(!mkdtemp(dir)){
+        perror("mkdtemp");
+        return 1;
+    }
+    char path[512];
+    snprintf(path, sizeof(path), "%s/inc", dir);
+    mkdir(path, 0700);
+    int header_count=sizeof(preprocessor_test_headers)/sizeof(preprocessor_test_headers[0]);
+    for(int i=0;i<header_count;i++){
+        snprintf(path, sizeof(path), "%s/%s", dir, preprocessor_test_headers[i][0]);
+        FILE* fp=fopen(path, "w");
+        if(!fp){
+            perror(path);
+            return 1;
+        }
+        fputs(preprocessor_test_headers[i][1], fp);
+        fclose(fp);
+    }
+
+    int total=sizeof(preprocessor_test_cases)/sizeof(preprocessor_test_cases[0]);
+    int failed=0;
+    for(int i=0;i<total;i++){
+        if(!preprocessor_test_run(dir, &preprocessor_test_cases[i])){
+            failed++;
+        }
+    }
+
+    for(int i=0;i<header_count;i++){
+        snprintf(path, sizeof(path), "%s/%s", dir, preprocessor_test_headers[i][0]);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/inc", dir);
+    rmdir(path);
+    rmdir(dir);
+    printf("预处理：%i个用例，%i个失败\n", total, failed);
+    return failed?1:0;
+}
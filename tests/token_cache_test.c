@@ -0,0 +1,198 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+
+//两份内容不同的源码，各自使用一个缓存目录，目录里只会有一个缓存文件
+static const char* token_cache_test_a="a=1;\n\"str\"; /* c */ b=a*(2+x);\n";
+//b中的字符串有转义，文本不在源码里而在text_pool里
+static const char* token_cache_test_b="y=3;\n\"oth\\ter\";\n";
+
+struct token_cache_test_dir{
+    char path[64];
+};
+
+static void token_cache_test_dir_create(struct token_cache_test_dir* dir){
+    strcpy(dir->path, "/tmp/token_cache_test.XXXXXX");
+    if(!mkdtemp(dir->path)){
+        perror("mkdtemp");
+        exit(1);
+    }
+}
+
+//缓存文件的路径，目录里还没有缓存文件时返回false
+static bool token_cache_test_file(struct token_cache_test_dir* dir, char* path, size_t size){
+    DIR* d=opendir(dir->path);
+    struct dirent* entry;
+    bool found=false;
+    while(d&&(entry=readdir(d))){
+        if(entry->d_name[0]!='.'){
+            snprintf(path, size, "%s/%s", dir->path, entry->d_name);
+            found=true;
+        }
+    }
+    if(d){
+        closedir(d);
+    }
+    return found;
+}
+
+static void token_cache_test_dir_remove(struct token_cache_test_dir* dir){
+    char path[512];
+    while(token_cache_test_file(dir, path, sizeof(path))){
+        unlink(path);
+    }
+    rmdir(dir->path);
+}
+
+//字符串和注释的文本在各自的编译过程里，按span取出来比较
+static bool token_cache_test_same_text(struct compile_process* a_process, struct token* a, struct compile_process* b_process, struct token* b){
+    return a->span.len==b->span.len&&
+           memcmp(compile_process_text(a_process, a->span), compile_process_text(b_process, b->span), a->span.len)==0;
+}
+
+static bool token_cache_test_same_token(struct compile_process* a_process, struct token* a, struct compile_process* b_process, struct token* b){
+    if(a->type!=b->type||a->offset!=b->offset||a->whitespace!=b->whitespace){
+        return false;
+    }
+    switch(a->type){
+        case TOKEN_TYPE_IDENTIFIER:
+        return strcmp(a->sval, b->sval)==0;
+        case TOKEN_TYPE_STRING:
+        case TOKEN_TYPE_COMMENT:
+        return token_cache_test_same_text(a_process, a, b_process, b);
+        case TOKEN_TYPE_NEWLINE:
+        return true;
+    }
+    return a->llnum==b->llnum;
+}
+
+//用一个不带缓存的编译过程得到应有的token，和带缓存编译的结果逐个比较
+static bool token_cache_test_compile(struct compile_process* process, const char* source, bool hit){
+    struct compile_process* expected=compile_process_create_for_memory(0);
+    bool ok=compile_memory(process, "token_cache_test.c", source, strlen(source))==COMPILOR_FILE_COMPLETE_OK&&
+            compile_memory(expected, "token_cache_test.c", source, strlen(source))==COMPILOR_FILE_COMPLETE_OK;
+    if(!ok){
+        fprintf(stderr, "%s：编译失败\n", source);
+    } else if(process->stats.token_cache_hit!=hit){
+        fprintf(stderr, "%s：应当%s缓存\n", source, hit?"命中":"不命中");
+        ok=false;
+    } else if(memcmp(process->stats.tokens, expected->stats.tokens, sizeof(process->stats.tokens))!=0){
+        //换行和注释在附属表里，命中缓存时也要和词法分析一样计数
+        fprintf(stderr, "%s：各类token的数目和词法分析的统计不同\n", source);
+        ok=false;
+    } else if(token_stream_count(process->token_stream)!=token_stream_count(expected->token_stream)){
+        fprintf(stderr, "%s：得到%i个token，应当是%i个\n", source,
+            token_stream_count(process->token_stream), token_stream_count(expected->token_stream));
+        ok=false;
+    } else {
+        for(int i=0;i<token_stream_count(expected->token_stream);i++){
+            struct token token;
+            struct token expected_token;
+            token_stream_get(process->token_stream, i, &token);
+            token_stream_get(expected->token_stream, i, &expected_token);
+            if(!token_cache_test_same_token(process, &token, expected, &expected_token)){
+                fprintf(stderr, "%s：第%i个token和词法分析的结果不同\n", source, i);
+                ok=false;
+                break;
+            }
+        }
+    }
+    compile_process_free(expected);
+    return ok;
+}
+
+static bool token_cache_test_copy(const char* from, const char* to){
+    FILE* in=fopen(from, "rb");
+    FILE* out=fopen(to, "wb");
+    int c;
+    while(in&&out&&(c=fgetc(in))!=EOF){
+        fputc(c, out);
+    }
+    bool ok=in&&out;
+    if(in){
+        fclose(in);
+    }
+    if(out){
+        fclose(out);
+    }
+    return ok;
+}
+
+//把文件截短到一半，或者改掉最后几个字节
+//最后是写入时的源码原文，改掉之后哈希还对得上，相当于两份源码的哈希冲突
+static bool token_cache_test_damage(const char* path, bool truncate_file){
+    FILE* fp=fopen(path, "r+b");
+    if(!fp){
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size=ftell(fp);
+    bool ok;
+    if(truncate_file){
+        ok=ftruncate(fileno(fp), size/2)==0;
+    } else {
+        fseek(fp, size-4, SEEK_SET);
+        ok=fwrite("\xff\xff\xff\xff", 1, 4, fp)==4;
+    }
+    fclose(fp);
+    return ok;
+}
+
+int main(){
+    struct token_cache_test_dir dir_a;
+    struct token_cache_test_dir dir_b;
+    token_cache_test_dir_create(&dir_a);
+    token_cache_test_dir_create(&dir_b);
+    struct compile_process* process_a=compile_process_create_for_memory(0);
+    struct compile_process* process_b=compile_process_create_for_memory(0);
+    process_a->options.cache_dir=dir_a.path;
+    process_b->options.cache_dir=dir_b.path;
+    char path_a[512];
+    char path_b[512];
+    int total=0;
+    int failed=0;
+
+    //第一次编译写入缓存，第二次命中
+    total++;
+    if(!token_cache_test_compile(process_a, token_cache_test_a, false)||
+        !token_cache_test_compile(process_a, token_cache_test_a, true)||
+        !token_cache_test_file(&dir_a, path_a, sizeof(path_a))){
+        failed++;
+    }
+
+    //内容不同的源码不命中
+    total++;
+    if(!token_cache_test_compile(process_b, token_cache_test_b, false)||
+        !token_cache_test_file(&dir_b, path_b, sizeof(path_b))){
+        failed++;
+    }
+
+    //另一份源码的缓存文件放在了这个名字下，不能拿到另一份源码的token
+    total++;
+    if(!token_cache_test_copy(path_a, path_b)||
+        !token_cache_test_compile(process_b, token_cache_test_b, false)||
+        !token_cache_test_compile(process_b, token_cache_test_b, true)){
+        failed++;
+    }
+
+    //截短的和原文对不上的缓存文件都当作不存在，重新词法分析并重写缓存
+    for(int i=0;i<2;i++){
+        total++;
+        if(!token_cache_test_damage(path_a, i==0)||
+            !token_cache_test_compile(process_a, token_cache_test_a, false)||
+            !token_cache_test_compile(process_a, token_cache_test_a, true)){
+            failed++;
+        }
+    }
+
+    compile_process_free(process_a);
+    compile_process_free(process_b);
+    token_cache_test_dir_remove(&dir_a);
+    token_cache_test_dir_remove(&dir_b);
+    printf("token缓存：%i个用例，%i个失败\n", total, failed);
+    return failed?1:0;
+}
@@ -1,8 +1,29 @@
 #include "compiler.h"
 
-bool token_is_keyword(struct token *token, const char *value)
+static const char* token_type_names[TOKEN_TYPE_TOTAL]={
+    [TOKEN_TYPE_IDENTIFIER]="标识符",
+    [TOKEN_TYPE_KEYWORD]="关键字",
+    [TOKEN_TYPE_OPERATOR]="运算符",
+    [TOKEN_TYPE_SYMBOL]="符号",
+    [TOKEN_TYPE_NUMBER]="数字",
+    [TOKEN_TYPE_STRING]="字符串",
+    [TOKEN_TYPE_COMMENT]="注释",
+    [TOKEN_TYPE_NEWLINE]="换行"
+};
+
+const char* token_type_name(int type)
 {
-    return token->type == TOKEN_TYPE_KEYWORD && S_EQ(token->sval, value);
+    return type>=0&&type<TOKEN_TYPE_TOTAL?token_type_names[type]:NULL;
+}
+
+bool token_is_keyword(struct token *token, int keyword)
+{
+    return token->type == TOKEN_TYPE_KEYWORD && token->kw == keyword;
+}
+
+bool token_is_operator(struct token *token, int op)
+{
+    return token->type == TOKEN_TYPE_OPERATOR && token->op == op;
 }
 
 bool token_is_symbol(struct token *token, char c)
@@ -10,9 +31,11 @@ bool token_is_symbol(struct token *token, char c)
     return token->type == TOKEN_TYPE_SYMBOL && token->cval == c;
 }
 
+//换行、注释和续行符'\'对语法分析没有意义，进入token_stream时会被移到附属表里
 bool token_is_nl_or_newline_seperator(struct token *token)
 {
     return token->type == TOKEN_TYPE_NEWLINE ||
            token->type == TOKEN_TYPE_COMMENT ||
            token_is_symbol(token, '\\');
-}
\ No newline at end of file
+}
+
@@ -0,0 +1,389 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/intern.h"
+#include "helpers/ptr_map.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//token缓存：以源码内容的哈希为键，把token_stream的几个数组原样写进缓存目录
+//读取时把文件映射进来，各个数组整段拷贝进token_stream，再逐个检查并把标识符、字符串和偏移按当前编译过程重新定位
+//拷贝完就解除映射，token_stream不引用缓存文件
+
+#define TOKEN_CACHE_MAGIC "LCTOKEN"
+//词法分析器或者文件格式有变化时加一，旧的缓存文件会被当作不存在
+#define TOKEN_CACHE_VERSION 5
+
+#define TOKEN_CACHE_FNV_OFFSET 0xcbf29ce484222325ULL
+#define TOKEN_CACHE_FNV_PRIME 0x100000001b3ULL
+
+//文件开头的固定部分，之后各段的位置都相对文件开头，每段按8字节对齐
+struct token_cache_header{
+    char magic[8];
+    uint32_t version;
+    //写入时token联合体的大小，不同平台生成的缓存不能混用
+    uint32_t value_size;
+    uint64_t hash;
+    uint64_t source_size;
+    //写入时的源码原文，命中前逐字节比较，哈希相同而内容不同的文件不会拿到别人的token
+    uint64_t source;
+    struct token_cache_tokens tokens;
+};
+
+//FNV-1a，只用来给缓存文件取名，是不是同一份源码由保存的原文决定
+static uint64_t token_cache_hash(const char* data, size_t size){
+    uint64_t hash=TOKEN_CACHE_FNV_OFFSET;
+    for(size_t i=0;i<size;i++){
+        hash^=(unsigned char)data[i];
+        hash*=TOKEN_CACHE_FNV_PRIME;
+    }
+    return hash;
+}
+
+static char* token_cache_path(struct compile_process* process, uint64_t hash){
+    const char* dir=process->options.cache_dir;
+    size_t len=strlen(dir)+sizeof("/0123456789abcdef.tok");
+    char* path=malloc(len);
+    snprintf(path, len, "%s/%016llx.tok", dir, (unsigned long long)hash);
+    return path;
+}
+
+static size_t token_cache_align(size_t offset){
+    return (offset+7)&~(size_t)7;
+}
+
+static bool token_cache_is_string(int type){
+    return type==TOKEN_TYPE_STRING||type==TOKEN_TYPE_COMMENT;
+}
+
+//缓存不可用时的统一出口
+static bool token_cache_unmap(void* data, size_t size){
+    munmap(data, size);
+    return false;
+}
+
+static bool token_cache_check_tokens(const char* data, size_t size, struct token_cache_tokens* tokens){
+    uint64_t total=tokens->token_count;
+    return tokens->types+total<=size&&
+           tokens->flags+total<=size&&
+           tokens->values+total*sizeof(unsigned long long)<=size&&
+           tokens->offsets+total*sizeof(uint32_t)<=size&&
+           tokens->brackets+total*sizeof(uint32_t)<=size&&
+           tokens->trivia+(uint64_t)tokens->trivia_count*sizeof(struct token_cache_trivia)<=size&&
+           tokens->identifiers+(uint64_t)tokens->identifier_count*sizeof(uint32_t)<=size&&
+           tokens->strings+tokens->strings_size<=size&&
+           (!tokens->strings_size||data[tokens->strings+tokens->strings_size-1]=='\0');
+}
+
+//源码里的文本加上base，写进strings的文本拷贝到text_pool，超出范围时返回false
+static bool token_cache_read_span(struct compile_process* process, struct token_span* span, const char* strings, uint64_t strings_size, uint32_t text_size, uint32_t base){
+    if(span->offset&TOKEN_SPAN_POOL){
+        //文本后面还有一个'\0'
+        uint64_t offset=span->offset&~TOKEN_SPAN_POOL;
+        if(offset+span->len>=strings_size){
+            return false;
+        }
+        *span=compile_process_pool_text(process, strings+offset, span->len);
+        return true;
+    }
+    if((uint64_t)span->offset+span->len>text_size){
+        return false;
+    }
+    span->offset+=base;
+    return true;
+}
+
+//把映射进来的一段token追加到stream末尾，偏移、括号位置和字符串注释的span都加上base
+//这些token所在的源码长度是text_size，偏移和span都不能超出它
+bool token_cache_read_tokens(struct compile_process* process, struct token_stream* stream, const char* data, size_t size, struct token_cache_tokens* tokens, uint32_t text_size, uint32_t base){
+    if(!token_cache_check_tokens(data, size, tokens)){
+        return false;
+    }
+
+    //每个不同的标识符驻留一次，token里的标识符和词法分析得到的一样可以用==比较
+    const char* strings=data+tokens->strings;
+    const uint32_t* identifier_offsets=(const uint32_t*)(data+tokens->identifiers);
+    const char** identifiers=malloc((tokens->identifier_count+1)*sizeof(const char*));
+    for(uint32_t i=0;i<tokens->identifier_count;i++){
+        if(identifier_offsets[i]>=tokens->strings_size){
+            free(identifiers);
+            return false;
+        }
+        const char* str=strings+identifier_offsets[i];
+        identifiers[i]=intern(process->interns, str, strlen(str));
+    }
+
+    //流式读取时数组前面可能已经丢弃了一部分，这里用数组中的下标
+    int first=vector_count(stream->types);
+    int total=tokens->token_count;
+    vector_splice(stream->types, first, 0, (void*)(data+tokens->types), total);
+    vector_splice(stream->flags, first, 0, (void*)(data+tokens->flags), total);
+    vector_splice(stream->values, first, 0, (void*)(data+tokens->values), total);
+    vector_splice(stream->offsets, first, 0, (void*)(data+tokens->offsets), total);
+    vector_splice(stream->brackets, first, 0, (void*)(data+tokens->brackets), total);
+
+    const uint8_t* types=(const uint8_t*)(data+tokens->types);
+    unsigned long long* values=(unsigned long long*)vector_data_ptr(stream->values)+first;
+    uint32_t* offsets=(uint32_t*)vector_data_ptr(stream->offsets)+first;
+    uint32_t* brackets=(uint32_t*)vector_data_ptr(stream->brackets)+first;
+    size_t counts[TOKEN_TYPE_TOTAL]={0};
+    for(int i=0;i<total;i++){
+        int type=types[i];
+        if(type>=TOKEN_TYPE_TOTAL||offsets[i]>=text_size||brackets[i]>text_size){
+            goto corrupt;
+        }
+        if(type==TOKEN_TYPE_IDENTIFIER){
+            if(values[i]>=tokens->identifier_count){
+                goto corrupt;
+            }
+            struct token token={.sval=identifiers[values[i]]};
+            values[i]=token.llnum;
+        } else if(token_cache_is_string(type)){
+            struct token token={.llnum=values[i]};
+            if(!token_cache_read_span(process, &token.span, strings, tokens->strings_size, text_size, base)){
+                goto corrupt;
+            }
+            values[i]=token.llnum;
+        }
+        offsets[i]+=base;
+        if(brackets[i]){
+            brackets[i]+=base;
+        }
+        counts[type]++;
+    }
+    free(identifiers);
+
+    //附属项的next加上这段token在stream中的序号
+    const struct token_cache_trivia* cached_trivia=(const struct token_cache_trivia*)(data+tokens->trivia);
+    int trivia_first=vector_count(stream->trivia);
+    struct token_trivia* trivia=vector_extend(stream->trivia, tokens->trivia_count);
+    for(uint32_t i=0;i<tokens->trivia_count;i++){
+        const struct token_cache_trivia* cached=&cached_trivia[i];
+        trivia[i]=(struct token_trivia){.next=stream->base+first+cached->next, .offset=cached->offset+base, .type=cached->type};
+        if(cached->type==TOKEN_TYPE_COMMENT){
+            trivia[i].span=cached->span;
+        }
+        if(cached->type>=TOKEN_TYPE_TOTAL||cached->next>tokens->token_count||cached->offset>=text_size||
+            (cached->type==TOKEN_TYPE_COMMENT&&!token_cache_read_span(process, &trivia[i].span, strings, tokens->strings_size, text_size, base))){
+            vector_pop_multiple_at(stream->trivia, trivia_first, tokens->trivia_count);
+            goto corrupt_tokens;
+        }
+        //词法分析时换行、注释和续行也都计过数，统计不应该因为命中缓存而不同
+        counts[cached->type]++;
+    }
+    stream->line_start=true;
+
+    for(int i=0;i<TOKEN_TYPE_TOTAL;i++){
+        process->stats.tokens[i]+=counts[i];
+    }
+    return true;
+
+corrupt:
+    free(identifiers);
+corrupt_tokens:
+    vector_pop_multiple_at(stream->types, first, total);
+    vector_pop_multiple_at(stream->flags, first, total);
+    vector_pop_multiple_at(stream->values, first, total);
+    vector_pop_multiple_at(stream->offsets, first, total);
+    vector_pop_multiple_at(stream->brackets, first, total);
+    return false;
+}
+
+//命中时source的全部token追加到了stream的末尾，词法分析可以整个跳过
+//字符串和注释还是指向source的文本，只有标识符需要重新驻留
+bool token_cache_load(struct compile_process* process, struct token_stream* stream, struct source_file* source){
+    if(!process->options.cache_dir||!source->data){
+        return false;
+    }
+    uint64_t hash=token_cache_hash(source->data, source->size);
+    char* path=token_cache_path(process, hash);
+    int fd=open(path, O_RDONLY);
+    free(path);
+    if(fd<0){
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st)!=0||(size_t)st.st_size<sizeof(struct token_cache_header)){
+        close(fd);
+        return false;
+    }
+    char* data=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data==MAP_FAILED){
+        return false;
+    }
+    struct token_cache_header* header=(struct token_cache_header*)data;
+    if(memcmp(header->magic, TOKEN_CACHE_MAGIC, sizeof(header->magic))!=0||
+        header->version!=TOKEN_CACHE_VERSION||
+        header->value_size!=sizeof(unsigned long long)||
+        header->hash!=hash||header->source_size!=source->size||
+        header->source>(uint64_t)st.st_size||st.st_size-header->source<source->size||
+        memcmp(data+header->source, source->data, source->size)!=0||
+        !token_cache_read_tokens(process, stream, data, st.st_size, &header->tokens, source->size, source->base)){
+        return token_cache_unmap(data, st.st_size);
+    }
+    //token里已经没有指向缓存文件的指针了
+    munmap(data, st.st_size);
+    return true;
+}
+
+static void token_cache_write_section(FILE* fp, uint64_t* section, const void* data, size_t size){
+    long position=ftell(fp);
+    long aligned=token_cache_align(position);
+    for(;position<aligned;position++){
+        fputc(0, fp);
+    }
+    *section=aligned;
+    fwrite(data, 1, size, fp);
+}
+
+//next在[first, first+total]中的附属项是连续的一段
+static struct token_trivia* token_cache_trivia_range(struct token_stream* stream, int first, int total, int* count){
+    struct token_trivia* trivia=vector_data_ptr(stream->trivia);
+    int end=vector_count(stream->trivia);
+    int start=0;
+    while(start<end&&trivia[start].next<first){
+        start++;
+    }
+    int stop=start;
+    while(stop<end&&trivia[stop].next<=first+total){
+        stop++;
+    }
+    *count=stop-start;
+    return trivia+start;
+}
+
+//字符串和注释的span：源码里的文本只保存相对base的位置，不在源码里的文本写进strings
+static struct token_span token_cache_write_span(struct compile_process* process, struct vector* strings, struct token_span span, uint32_t base){
+    if(!(span.offset&TOKEN_SPAN_POOL)){
+        return (struct token_span){.offset=span.offset-base, .len=span.len};
+    }
+    struct token_span cached={.offset=vector_count(strings)|TOKEN_SPAN_POOL, .len=span.len};
+    char terminator='\0';
+    vector_splice(strings, vector_count(strings), 0, (void*)compile_process_text(process, span), span.len);
+    vector_push(strings, &terminator);
+    return cached;
+}
+
+//把stream中从first开始的total个token按各段写进fp的当前位置，各段的位置记进tokens
+//偏移减去base后保存，读取时再加上新的base
+void token_cache_write_tokens(struct compile_process* process, FILE* fp, struct token_cache_tokens* tokens, struct token_stream* stream, int first, int total, uint32_t base){
+    const uint8_t* types=(const uint8_t*)vector_data_ptr(stream->types)+first-stream->base;
+    const unsigned long long* values=(const unsigned long long*)vector_data_ptr(stream->values)+first-stream->base;
+    const uint32_t* offsets=(const uint32_t*)vector_data_ptr(stream->offsets)+first-stream->base;
+    const uint32_t* brackets=(const uint32_t*)vector_data_ptr(stream->brackets)+first-stream->base;
+
+    unsigned long long* cached_values=malloc(total*sizeof(unsigned long long)+1);
+    uint32_t* cached_offsets=malloc(total*sizeof(uint32_t)+1);
+    uint32_t* cached_brackets=malloc(total*sizeof(uint32_t)+1);
+    struct vector* identifier_offsets=vector_create(sizeof(uint32_t));
+    struct vector* strings=vector_create(sizeof(char));
+    //标识符已经驻留过，按指针去重就是按内容去重，值是下标加1
+    struct ptr_map* identifiers=ptr_map_create();
+
+    for(int i=0;i<total;i++){
+        struct token token={.llnum=values[i]};
+        cached_values[i]=values[i];
+        if(types[i]==TOKEN_TYPE_IDENTIFIER){
+            uintptr_t index=(uintptr_t)ptr_map_get(identifiers, token.sval);
+            if(!index){
+                uint32_t offset=vector_count(strings);
+                vector_push(identifier_offsets, &offset);
+                vector_splice(strings, offset, 0, (void*)token.sval, strlen(token.sval)+1);
+                index=vector_count(identifier_offsets);
+                ptr_map_set(identifiers, token.sval, (void*)index);
+            }
+            cached_values[i]=index-1;
+        } else if(token_cache_is_string(types[i])){
+            struct token cached={.span=token_cache_write_span(process, strings, token.span, base)};
+            cached_values[i]=cached.llnum;
+        }
+        cached_offsets[i]=offsets[i]-base;
+        cached_brackets[i]=brackets[i]?brackets[i]-base:0;
+    }
+    //这段token之前和最后一个token之后的附属项
+    int trivia_count;
+    struct token_trivia* trivia=token_cache_trivia_range(stream, first, total, &trivia_count);
+    struct token_cache_trivia* cached_trivia=malloc(trivia_count*sizeof(struct token_cache_trivia)+1);
+    for(int i=0;i<trivia_count;i++){
+        cached_trivia[i]=(struct token_cache_trivia){.next=trivia[i].next-first, .offset=trivia[i].offset-base, .type=trivia[i].type};
+        if(trivia[i].type==TOKEN_TYPE_COMMENT){
+            cached_trivia[i].span=token_cache_write_span(process, strings, trivia[i].span, base);
+        }
+    }
+
+    tokens->token_count=total;
+    tokens->trivia_count=trivia_count;
+    tokens->identifier_count=vector_count(identifier_offsets);
+    tokens->strings_size=vector_count(strings);
+
+    token_cache_write_section(fp, &tokens->types, types, total);
+    token_cache_write_section(fp, &tokens->flags, (const uint8_t*)vector_data_ptr(stream->flags)+first-stream->base, total);
+    token_cache_write_section(fp, &tokens->values, cached_values, total*sizeof(unsigned long long));
+    token_cache_write_section(fp, &tokens->offsets, cached_offsets, total*sizeof(uint32_t));
+    token_cache_write_section(fp, &tokens->brackets, cached_brackets, total*sizeof(uint32_t));
+    token_cache_write_section(fp, &tokens->trivia, cached_trivia, trivia_count*sizeof(struct token_cache_trivia));
+    token_cache_write_section(fp, &tokens->identifiers, vector_data_ptr(identifier_offsets), tokens->identifier_count*sizeof(uint32_t));
+    token_cache_write_section(fp, &tokens->strings, vector_data_ptr(strings), tokens->strings_size);
+
+    ptr_map_free(identifiers);
+    vector_free(strings);
+    vector_free(identifier_offsets);
+    free(cached_trivia);
+    free(cached_brackets);
+    free(cached_offsets);
+    free(cached_values);
+}
+
+//写入一段不定长的数据，返回它在文件中的位置，和token段一样按8字节对齐
+uint64_t token_cache_write_data(FILE* fp, const void* data, size_t size){
+    uint64_t section;
+    token_cache_write_section(fp, &section, data, size);
+    return section;
+}
+
+//把stream中从first开始属于source的token写进缓存目录
+//先写到临时文件再改名，同时编译同一份源码的进程只会看到完整的缓存文件
+//写入失败不影响编译，下次再重新生成
+void token_cache_store(struct compile_process* process, struct token_stream* stream, struct source_file* source, int first){
+    if(!process->options.cache_dir||!source->data){
+        return;
+    }
+    struct token_cache_header header={.magic=TOKEN_CACHE_MAGIC};
+    header.version=TOKEN_CACHE_VERSION;
+    header.value_size=sizeof(unsigned long long);
+    header.hash=token_cache_hash(source->data, source->size);
+    header.source_size=source->size;
+
+    char* path=token_cache_path(process, header.hash);
+    char* tmp_path=malloc(strlen(path)+sizeof(".XXXXXX"));
+    sprintf(tmp_path, "%s.XXXXXX", path);
+    mkdir(process->options.cache_dir, 0777);
+    int fd=mkstemp(tmp_path);
+    if(fd>=0){
+        //mkstemp创建的文件只有自己能读，缓存目录可能是多人共用的
+        fchmod(fd, 0644);
+    }
+    FILE* fp=fd<0?NULL:fdopen(fd, "wb");
+    if(fp){
+        fwrite(&header, sizeof(header), 1, fp);
+        token_cache_write_tokens(process, fp, &header.tokens, stream, first, token_stream_count(stream)-first, source->base);
+        token_cache_write_section(fp, &header.source, source->data, source->size);
+        //各段的位置写完才知道，最后回到开头补上
+        rewind(fp);
+        fwrite(&header, sizeof(header), 1, fp);
+        bool ok=!ferror(fp);
+        if(fclose(fp)!=0||!ok||rename(tmp_path, path)!=0){
+            unlink(tmp_path);
+        }
+    } else if(fd>=0){
+        close(fd);
+        unlink(tmp_path);
+    }
+
+    free(tmp_path);
+    free(path);
+}
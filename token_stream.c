@@ -0,0 +1,293 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+//token的结构数组形式：类型、标志、值、偏移分别存放在各自的紧凑数组里
+//语法分析器线性扫描时大多只需要看类型，一个缓存行就能装下64个token的类型
+
+//流式读取时已经读过的token在数组中也保留这么多个之后才整体丢弃
+#define TOKEN_STREAM_WINDOW 256
+
+#define TOKEN_STREAM_FLAG_WHITESPACE 0b00000001
+#define TOKEN_STREAM_NUMBER_TYPE_SHIFT 1
+#define TOKEN_STREAM_NUMBER_TYPE_MASK 0b00000111
+#define TOKEN_STREAM_FLAG_UNSIGNED 0b00010000
+#define TOKEN_STREAM_FLAG_LINE_START 0b00100000
+
+struct token_stream* token_stream_create(){
+    struct token_stream* stream=calloc(1, sizeof(struct token_stream));
+    stream->types=vector_create(sizeof(uint8_t));
+    stream->flags=vector_create(sizeof(uint8_t));
+    stream->values=vector_create(sizeof(unsigned long long));
+    stream->offsets=vector_create(sizeof(uint32_t));
+    stream->brackets=vector_create(sizeof(uint32_t));
+    stream->saves=vector_create(sizeof(int));
+    stream->trivia=vector_create(sizeof(struct token_trivia));
+    stream->line_start=true;
+    return stream;
+}
+
+//语法分析需要哪个token时才从词法分析器读取，数组里只保留最近的一小段
+struct token_stream* token_stream_create_for_lexer(struct lex_process* lexer){
+    struct token_stream* stream=token_stream_create();
+    stream->lexer=lexer;
+    return stream;
+}
+
+void token_stream_free(struct token_stream* stream){
+    vector_free(stream->types);
+    vector_free(stream->flags);
+    vector_free(stream->values);
+    vector_free(stream->offsets);
+    vector_free(stream->brackets);
+    vector_free(stream->saves);
+    vector_free(stream->trivia);
+    free(stream);
+}
+
+void token_stream_reserve(struct token_stream* stream, int total){
+    vector_reserve(stream->types, total);
+    vector_reserve(stream->flags, total);
+    vector_reserve(stream->values, total);
+    vector_reserve(stream->offsets, total);
+    vector_reserve(stream->brackets, total);
+}
+
+//换行、注释和续行的反斜杠记进附属表，前一个token的whitespace标志代替它们把两边隔开
+static void token_stream_push_trivia(struct token_stream* stream, struct token* token){
+    struct token_trivia trivia={.next=token_stream_count(stream), .offset=token->offset, .type=token->type};
+    if(token->type==TOKEN_TYPE_COMMENT){
+        trivia.span=token->span;
+    }
+    vector_push(stream->trivia, &trivia);
+    if(token->type==TOKEN_TYPE_NEWLINE&&!stream->continuation){
+        stream->line_start=true;
+    }
+    stream->continuation=token->type==TOKEN_TYPE_SYMBOL;
+
+    uint8_t* last=vector_back_or_null(stream->flags);
+    if(last){
+        *last|=TOKEN_STREAM_FLAG_WHITESPACE;
+    }
+}
+
+void token_stream_push(struct token_stream* stream, struct token* token){
+    if(token_is_nl_or_newline_seperator(token)){
+        token_stream_push_trivia(stream, token);
+        return;
+    }
+    uint8_t type=token->type;
+    uint8_t flags=(token->whitespace?TOKEN_STREAM_FLAG_WHITESPACE:0)|(token->num.type<<TOKEN_STREAM_NUMBER_TYPE_SHIFT)|
+        (token->num.is_unsigned?TOKEN_STREAM_FLAG_UNSIGNED:0)|
+        (token->line_start||stream->line_start?TOKEN_STREAM_FLAG_LINE_START:0);
+    stream->line_start=false;
+    stream->continuation=false;
+    //联合体里最宽的成员是llnum，整体按8字节拷贝
+    unsigned long long value=token->llnum;
+    vector_push(stream->types, &type);
+    vector_push(stream->flags, &flags);
+    vector_push(stream->values, &value);
+    vector_push(stream->offsets, &token->offset);
+    vector_push(stream->brackets, &token->between_brackets);
+}
+
+void token_stream_push_vector(struct token_stream* stream, struct vector* token_vec){
+    int total=vector_count(token_vec);
+    token_stream_reserve(stream, token_stream_count(stream)-stream->base+total);
+    for(int i=0;i<total;i++){
+        token_stream_push(stream, vector_at(token_vec, i));
+    }
+}
+
+//把src中从start开始的total个token整段追加到stream，每个数组一次拷贝
+void token_stream_append(struct token_stream* stream, struct token_stream* src, int start, int total){
+    int from=start-src->base;
+    int to=vector_count(stream->types);
+    vector_splice(stream->types, to, 0, vector_at(src->types, from), total);
+    vector_splice(stream->flags, to, 0, vector_at(src->flags, from), total);
+    vector_splice(stream->values, to, 0, vector_at(src->values, from), total);
+    vector_splice(stream->offsets, to, 0, vector_at(src->offsets, from), total);
+    vector_splice(stream->brackets, to, 0, vector_at(src->brackets, from), total);
+}
+
+struct token_stream* token_stream_from_vector(struct vector* token_vec){
+    struct token_stream* stream=token_stream_create();
+    token_stream_push_vector(stream, token_vec);
+    return stream;
+}
+
+//清空所有token准备接收新的输入，数组申请的内存保留下来
+void token_stream_clear(struct token_stream* stream){
+    vector_clear(stream->types);
+    vector_clear(stream->flags);
+    vector_clear(stream->values);
+    vector_clear(stream->offsets);
+    vector_clear(stream->brackets);
+    vector_clear(stream->saves);
+    vector_clear(stream->trivia);
+    stream->line_start=true;
+    stream->continuation=false;
+    stream->base=0;
+    stream->pindex=0;
+    stream->lexer=NULL;
+    stream->preprocessor=NULL;
+}
+
+//目前已经读到的token总数，包括流式读取时已经丢弃的部分
+int token_stream_count(struct token_stream* stream){
+    return stream->base+vector_count(stream->types);
+}
+
+//流式读取时token的来源还没有读完
+static bool token_stream_is_pulling(struct token_stream* stream){
+    return stream->lexer||stream->preprocessor;
+}
+
+//从预处理器或者词法分析器再读一个token，已经读完时返回false
+static bool token_stream_pull(struct token_stream* stream){
+    if(stream->preprocessor){
+        struct token* token=preprocessor_next_token(stream->preprocessor);
+        if(!token){
+            stream->preprocessor=NULL;
+            return false;
+        }
+        token_stream_push(stream, token);
+        return true;
+    }
+
+    struct token* token=lex_next_token(stream->lexer);
+    if(!token){
+        stream->lexer=NULL;
+        return false;
+    }
+    token_stream_push(stream, token);
+
+    //词法分析器只需要记住上一个token
+    struct vector* lexer_tokens=lex_process_tokens(stream->lexer);
+    vector_pop_multiple_at(lexer_tokens, 0, vector_count(lexer_tokens)-1);
+    return true;
+}
+
+//第index个token是否存在，流式读取时不够就向词法分析器要
+//直接从词法分析器读取时多读一个，token后面的换行和注释已经进了附属表，whitespace标志不会再变
+bool token_stream_has(struct token_stream* stream, int index){
+    int needed=stream->lexer?index+1:index;
+    while(needed>=token_stream_count(stream)&&token_stream_is_pulling(stream)&&token_stream_pull(stream)){
+    }
+    return index>=stream->base&&index<token_stream_count(stream);
+}
+
+int token_stream_type(struct token_stream* stream, int index){
+    return ((uint8_t*)vector_data_ptr(stream->types))[index-stream->base];
+}
+
+unsigned long long token_stream_value(struct token_stream* stream, int index){
+    return ((unsigned long long*)vector_data_ptr(stream->values))[index-stream->base];
+}
+
+char token_stream_cval(struct token_stream* stream, int index){
+    struct token token={.llnum=token_stream_value(stream, index)};
+    return token.cval;
+}
+
+uint32_t token_stream_offset(struct token_stream* stream, int index){
+    return ((uint32_t*)vector_data_ptr(stream->offsets))[index-stream->base];
+}
+
+//把第index个token还原成struct token，越界时返回NULL
+struct token* token_stream_get(struct token_stream* stream, int index, struct token* out){
+    if(index<0||!token_stream_has(stream, index)){
+        return NULL;
+    }
+    uint8_t flags=*(uint8_t*)vector_at(stream->flags, index-stream->base);
+    memset(out, 0, sizeof(struct token));
+    out->type=token_stream_type(stream, index);
+    out->llnum=token_stream_value(stream, index);
+    out->offset=token_stream_offset(stream, index);
+    out->whitespace=flags&TOKEN_STREAM_FLAG_WHITESPACE;
+    out->line_start=flags&TOKEN_STREAM_FLAG_LINE_START;
+    out->num.type=(flags>>TOKEN_STREAM_NUMBER_TYPE_SHIFT)&TOKEN_STREAM_NUMBER_TYPE_MASK;
+    out->num.is_unsigned=flags&TOKEN_STREAM_FLAG_UNSIGNED;
+    out->between_brackets=*(uint32_t*)vector_at(stream->brackets, index-stream->base);
+    return out;
+}
+
+bool token_stream_line_start(struct token_stream* stream, int index){
+    return *(uint8_t*)vector_at(stream->flags, index-stream->base)&TOKEN_STREAM_FLAG_LINE_START;
+}
+
+//第index个token之前的附属项，*total为个数，没有时返回NULL
+//附属表按next排好序，二分查找第一个next不小于index的
+struct token_trivia* token_stream_trivia_before(struct token_stream* stream, int index, int* total){
+    struct token_trivia* trivia=vector_data_ptr(stream->trivia);
+    int count=vector_count(stream->trivia);
+    int low=0;
+    int high=count;
+    while(low<high){
+        int mid=(low+high)/2;
+        if(trivia[mid].next<index){
+            low=mid+1;
+        } else {
+            high=mid;
+        }
+    }
+    int end=low;
+    while(end<count&&trivia[end].next==index){
+        end++;
+    }
+    *total=end-low;
+    return *total?trivia+low:NULL;
+}
+
+//所有数组加起来平均每个token占用的字节数
+size_t token_stream_bytes_per_token(struct token_stream* stream){
+    return vector_element_size(stream->types)+
+           vector_element_size(stream->flags)+
+           vector_element_size(stream->values)+
+           vector_element_size(stream->offsets)+
+           vector_element_size(stream->brackets);
+}
+
+void token_stream_save(struct token_stream* stream){
+    vector_push(stream->saves, &stream->pindex);
+}
+
+void token_stream_restore(struct token_stream* stream){
+    stream->pindex=*(int*)vector_back(stream->saves);
+    vector_pop(stream->saves);
+}
+
+void token_stream_save_purge(struct token_stream* stream){
+    vector_pop(stream->saves);
+}
+
+//流式读取时丢弃语法分析已经用不到的token，保存的位置之后的token都要留着
+void token_stream_discard_consumed(struct token_stream* stream){
+    if(!token_stream_is_pulling(stream)){
+        return;
+    }
+    int keep_from=stream->pindex;
+    if(!vector_empty(stream->saves)){
+        int oldest_save=*(int*)vector_at(stream->saves, 0);
+        keep_from=oldest_save<keep_from?oldest_save:keep_from;
+    }
+    int total=keep_from-stream->base;
+    if(total<TOKEN_STREAM_WINDOW){
+        return;
+    }
+    vector_pop_multiple_at(stream->types, 0, total);
+    vector_pop_multiple_at(stream->flags, 0, total);
+    vector_pop_multiple_at(stream->values, 0, total);
+    vector_pop_multiple_at(stream->offsets, 0, total);
+    vector_pop_multiple_at(stream->brackets, 0, total);
+    stream->base+=total;
+
+    //丢弃的token之前的附属项也不再需要
+    struct token_trivia* trivia=vector_data_ptr(stream->trivia);
+    int discarded=0;
+    while(discarded<vector_count(stream->trivia)&&trivia[discarded].next<stream->base){
+        discarded++;
+    }
+    vector_pop_multiple_at(stream->trivia, 0, discarded);
+}